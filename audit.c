@@ -0,0 +1,332 @@
+/*
+ * Audit.c
+ * Records are appended by reserving a slot and pool space with atomic
+ * additions in the shared mapping and filling them in with plain
+ * stores; the AUDIT_DONE flag is stored last so a reader never decodes
+ * a half-written record. The file is preallocated when it is created,
+ * so appending never extends it. Nothing is formatted at run time: the
+ * cost of a record is a clock read, a getrusage() and a few copies.
+ * Authors : Aloysious Kok & Gerald
+ * Last Update : 18/10/26
+ */
+
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include "audit.h"
+#include "vars.h"
+#include "jobs.h"
+#include "common.h"
+
+/* Longest command line kept in a record */
+#define AUDIT_LINE_MAX 4096
+
+#define AUDIT_RECORDS_OF(h) ((audit_record *)((char *)(h) + sizeof(audit_header)))
+#define AUDIT_POOL_OF(h) ((char *)(AUDIT_RECORDS_OF(h) + (h)->max_records))
+
+static int log_fd = -1;
+static audit_header *log_map = NULL;
+static char log_path[MAX_BUF_SIZE];
+static unsigned log_generation = 0; // counts the files mapped
+
+// the working directory last written to the pool, reused while unchanged
+static char last_cwd[MAX_BUF_SIZE];
+static uint32_t last_cwd_off;
+static unsigned last_cwd_generation = 0;
+
+// the command being run
+static struct
+{
+    int active;
+    int64_t start_ns;
+    struct timespec start;
+    struct rusage self;
+    pid_t pid;
+    int has_child;
+    int has_usage;
+    struct rusage child;
+    struct rusage children; // of the children reaped before the command
+    pid_t stages[AUDIT_STAGES];
+    int n_stages;
+} current;
+
+static size_t log_size()
+{
+    return sizeof(audit_header) + AUDIT_RECORDS * sizeof(audit_record) + AUDIT_POOL;
+}
+
+static void audit_close()
+{
+    if (log_map != NULL)
+        munmap(log_map, log_size());
+    if (log_fd != -1)
+        close(log_fd);
+    log_map = NULL;
+    log_fd = -1;
+}
+
+/* Maps the log, creating and preallocating it if needed */
+static int audit_open()
+{
+    const char *name = var_get("AUDIT_LOG");
+    const char *home = var_get("HOME");
+    struct stat st;
+
+    if (log_map != NULL)
+    {
+        return 0;
+    }
+    if (name != NULL && name[0] != '\0')
+        snprintf(log_path, sizeof(log_path), "%s", name);
+    else if (home != NULL)
+        snprintf(log_path, sizeof(log_path), "%s/%s", home, AUDIT_FILE_NAME);
+    else
+        return -1;
+
+    log_fd = open(log_path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (log_fd == -1)
+    {
+        perror(log_path);
+        return -1;
+    }
+    flock(log_fd, LOCK_EX);
+    if (fstat(log_fd, &st) == 0 && st.st_size == 0)
+    {
+        audit_header h = {AUDIT_MAGIC, sizeof(audit_record), AUDIT_RECORDS, AUDIT_POOL, 0, 0, 0, 0};
+        if (posix_fallocate(log_fd, 0, log_size()) != 0 || pwrite(log_fd, &h, sizeof(h), 0) != sizeof(h))
+        {
+            ftruncate(log_fd, 0);
+            st.st_size = -1;
+        }
+        else
+            st.st_size = log_size();
+    }
+
+    audit_header h = {0};
+    if ((size_t)st.st_size != log_size() || pread(log_fd, &h, sizeof(h), 0) != sizeof(h) ||
+        h.magic != AUDIT_MAGIC || h.record_size != sizeof(audit_record))
+    {
+        fprintf(stderr, "audit: %s is not an audit log\n", log_path);
+        flock(log_fd, LOCK_UN);
+        audit_close();
+        return -1;
+    }
+
+    log_map = mmap(NULL, log_size(), PROT_READ | PROT_WRITE, MAP_SHARED, log_fd, 0);
+    flock(log_fd, LOCK_UN);
+    if (log_map == MAP_FAILED)
+    {
+        log_map = NULL;
+        audit_close();
+        return -1;
+    }
+    log_generation++;
+    return 0;
+}
+
+/* Moves a full log out of the way; the next audit_open() starts anew */
+static void audit_rotate()
+{
+    char old[MAX_BUF_SIZE + 2];
+
+    flock(log_fd, LOCK_EX);
+    if (!log_map->rotated)
+    {
+        snprintf(old, sizeof(old), "%s.1", log_path);
+        rename(log_path, old);
+        log_map->rotated = 1;
+    }
+    flock(log_fd, LOCK_UN);
+    audit_close();
+}
+
+/*
+ * Reserves a record and len bytes of pool in the mapped log. Returns
+ * NULL if the log is full or has been rotated by another shell; it is
+ * then unmapped and the caller tries again with a new one.
+ */
+static audit_record *audit_reserve(uint32_t len, uint32_t *off)
+{
+    if (log_map->rotated)
+    {
+        audit_close();
+        return NULL;
+    }
+    uint32_t idx = __atomic_fetch_add(&log_map->n_records, 1, __ATOMIC_RELAXED);
+    *off = __atomic_fetch_add(&log_map->pool_used, len, __ATOMIC_RELAXED);
+    if (idx < log_map->max_records && *off + len <= log_map->pool_size)
+    {
+        return &AUDIT_RECORDS_OF(log_map)[idx];
+    }
+    audit_rotate();
+    return NULL;
+}
+
+static int64_t tv_us(struct timeval tv)
+{
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+void audit_begin()
+{
+    current.active = shell_option(OPT_AUDIT);
+    if (!current.active)
+    {
+        return;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    current.start_ns = (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+    clock_gettime(CLOCK_MONOTONIC, &current.start);
+    getrusage(RUSAGE_SELF, &current.self);
+    getrusage(RUSAGE_CHILDREN, &current.children);
+    current.has_child = 0;
+    current.n_stages = 0;
+}
+
+void audit_child(pid_t pid, const struct rusage *usage)
+{
+    if (!current.active)
+    {
+        return;
+    }
+    current.has_child = 1;
+    current.pid = pid;
+    current.has_usage = usage != NULL;
+    if (usage != NULL)
+        current.child = *usage;
+}
+
+void audit_stage(pid_t pid)
+{
+    if (!current.active || current.n_stages == AUDIT_STAGES)
+    {
+        return;
+    }
+    current.stages[current.n_stages++] = pid;
+}
+
+void audit_end(command **cmd_stack, int first, int last, int builtin)
+{
+    char line[AUDIT_LINE_MAX];
+    char cwd[MAX_BUF_SIZE];
+    size_t len = 0;
+    struct timespec end;
+    struct rusage usage;
+
+    if (!current.active)
+    {
+        return;
+    }
+    current.active = 0;
+    // the earlier stages of a pipeline may outlive the last one
+    for (int i = 0; i < current.n_stages && cmd_stack[last]->background != 1; i++)
+    {
+        jobs_wait_stage(current.stages[i]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    // the command line, rebuilt from the expanded words
+    for (int i = first; i <= last; i++)
+    {
+        for (int j = 0; cmd_stack[i]->argv[j] != NULL; j++)
+        {
+            len += snprintf(line + len, sizeof(line) - len, "%s%s", j > 0 ? " " : (i > first ? " | " : ""),
+                            cmd_stack[i]->argv[j]);
+            if (len >= sizeof(line))
+                len = sizeof(line) - 1;
+        }
+    }
+    if (getcwd(cwd, sizeof(cwd)) == NULL)
+    {
+        cwd[0] = '\0';
+    }
+
+    size_t cwd_len = strlen(cwd);
+    int new_cwd = 0;
+    uint32_t off = 0;
+    audit_record *rec = NULL;
+    for (int tries = 0; rec == NULL && tries < 2; tries++)
+    {
+        if (audit_open() < 0)
+            return;
+        new_cwd = last_cwd_generation != log_generation || strcmp(cwd, last_cwd) != 0;
+        rec = audit_reserve(len + (new_cwd ? cwd_len : 0), &off);
+    }
+    if (rec == NULL)
+    {
+        return;
+    }
+    char *pool = AUDIT_POOL_OF(log_map);
+    memcpy(pool + off, line, len);
+    if (new_cwd)
+    {
+        memcpy(pool + off + len, cwd, cwd_len);
+        strcpy(last_cwd, cwd);
+        last_cwd_off = off + len;
+        last_cwd_generation = log_generation;
+    }
+
+    int background = cmd_stack[last]->background == 1;
+    uint32_t flags = AUDIT_DONE;
+    rec->start_ns = current.start_ns;
+    rec->wall_ns = (int64_t)(end.tv_sec - current.start.tv_sec) * 1000000000 + (end.tv_nsec - current.start.tv_nsec);
+    rec->argv_hash = hash64(line, len);
+    rec->argv_off = off;
+    rec->argv_len = len;
+    rec->cwd_off = last_cwd_off;
+    rec->cwd_len = cwd_len;
+    rec->pid = 0;
+    rec->status = last_status;
+    rec->user_us = rec->sys_us = rec->max_rss_kb = 0;
+
+    if (background)
+    {
+        flags |= AUDIT_BACKGROUND;
+        rec->pid = last_bg_pid;
+        rec->status = -1;
+    }
+    else if (builtin || (first == last && !current.has_child))
+    {
+        // ran in the shell (utilities too): charge what the shell used
+        flags |= AUDIT_BUILTIN;
+        getrusage(RUSAGE_SELF, &usage);
+        rec->user_us = tv_us(usage.ru_utime) - tv_us(current.self.ru_utime);
+        rec->sys_us = tv_us(usage.ru_stime) - tv_us(current.self.ru_stime);
+        rec->max_rss_kb = usage.ru_maxrss;
+    }
+    else if (first == last)
+    {
+        rec->pid = current.pid;
+        if (current.has_usage)
+        {
+            rec->user_us = tv_us(current.child.ru_utime);
+            rec->sys_us = tv_us(current.child.ru_stime);
+            rec->max_rss_kb = current.child.ru_maxrss;
+        }
+    }
+    else
+    {
+        // a pipeline: every child reaped meanwhile, all the stages among them
+        getrusage(RUSAGE_CHILDREN, &usage);
+        rec->pid = current.has_child ? current.pid : 0;
+        rec->user_us = tv_us(usage.ru_utime) - tv_us(current.children.ru_utime);
+        rec->sys_us = tv_us(usage.ru_stime) - tv_us(current.children.ru_stime);
+        // the peak of all children ever: only news if it grew
+        if (usage.ru_maxrss > current.children.ru_maxrss)
+            rec->max_rss_kb = usage.ru_maxrss;
+        if (current.has_usage && current.child.ru_maxrss > rec->max_rss_kb)
+            rec->max_rss_kb = current.child.ru_maxrss;
+        if (!current.has_child)
+        {
+            // the last stage ran in the shell
+            getrusage(RUSAGE_SELF, &usage);
+            rec->user_us += tv_us(usage.ru_utime) - tv_us(current.self.ru_utime);
+            rec->sys_us += tv_us(usage.ru_stime) - tv_us(current.self.ru_stime);
+            if (usage.ru_maxrss > rec->max_rss_kb)
+                rec->max_rss_kb = usage.ru_maxrss;
+        }
+    }
+    __atomic_store_n(&rec->flags, flags, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,127 @@
+#ifndef AUDIT_H
+#define AUDIT_H
+
+/*
+ * Audit.h
+ * Optional audit log (set -o audit): one fixed-layout binary record per
+ * command run, appended to a preallocated memory-mapped file. The file
+ * is decoded by the shell-logdump tool (logdump.c).
+ * Authors : Aloysious Kok & Gerald
+ * Last Update : 18/10/26
+ */
+
+#include <stdint.h>
+#include <sys/resource.h>
+#include "shell.h"
+
+/* Name of the log in $HOME, unless the AUDIT_LOG variable names one */
+#define AUDIT_FILE_NAME ".simpleshell_audit"
+
+/* Identifies the log file and its layout */
+#define AUDIT_MAGIC 0x31415353 // "SSA1"
+
+/* Capacities of a log file; a full log is renamed with a ".1" suffix
+ * and a new one is started */
+#define AUDIT_RECORDS 65536
+#define AUDIT_POOL (8 * 1024 * 1024)
+
+/* Flags of a record */
+#define AUDIT_DONE 1       // the record is complete
+#define AUDIT_BUILTIN 2    // run inside the shell
+#define AUDIT_BACKGROUND 4 // not waited for: no status or usage
+
+/* Most stages of a pipeline waited for before its record is written */
+#define AUDIT_STAGES 64
+
+/* Header of the log file. The file is the header, AUDIT_RECORDS records
+ * and a pool of AUDIT_POOL bytes holding the command lines and working
+ * directories. Writers reserve records and pool space with atomic
+ * additions, so several shells can append at once. */
+typedef struct Audit_header_struct
+{
+    uint32_t magic;
+    uint32_t record_size;
+    uint32_t max_records;
+    uint32_t pool_size;
+    uint32_t n_records; // records reserved, may exceed max_records
+    uint32_t pool_used; // pool bytes reserved, may exceed pool_size
+    uint32_t rotated;   // set when the file has been renamed away
+    uint32_t pad;
+} audit_header;
+
+/* A command. The command line is its words separated by spaces and its
+ * pipeline stages by " | "; strings in the pool are not terminated. */
+typedef struct Audit_record_struct
+{
+    int64_t start_ns; // wall clock time the command started
+    int64_t wall_ns;  // how long it ran
+    int64_t user_us;  // CPU time
+    int64_t sys_us;
+    int64_t max_rss_kb;
+    uint64_t argv_hash; // FNV-1a of the command line
+    uint32_t argv_off;
+    uint32_t argv_len;
+    uint32_t cwd_off;
+    uint32_t cwd_len;
+    int32_t pid;    // the waited-for process, 0 for builtins
+    int32_t status; // exit status, -1 for background commands
+    uint32_t flags;
+    uint32_t pad;
+} audit_record;
+
+/* void audit_begin()
+ *
+ * Marks the start of a command in execute_stack(). Does nothing unless
+ * the audit option is set.
+ *
+ * Returns :
+ *      None
+ */
+void audit_begin();
+
+/* void audit_child(pid_t pid, const struct rusage *usage)
+ *
+ * Hands over the process and resource usage of the foreground child
+ * waited for with wait4(), for the record of the current command.
+ *
+ * Arguments :
+ *      pid - the child
+ *      usage - its resource usage
+ *
+ * Returns :
+ *      None
+ */
+void audit_child(pid_t pid, const struct rusage *usage);
+
+/* void audit_stage(pid_t pid)
+ *
+ * Hands over a stage of a pipeline other than the last, forked and
+ * tracked with jobs_track(), for the record of the current command.
+ *
+ * Arguments :
+ *      pid - the stage
+ *
+ * Returns :
+ *      None
+ */
+void audit_stage(pid_t pid);
+
+/* void audit_end(command **cmd_stack, int first, int last, int builtin)
+ *
+ * This function writes the record of the command started by the last
+ * audit_begin(). Builtins are charged the CPU time the shell itself
+ * used meanwhile. A pipeline is charged every stage: the stages handed
+ * over with audit_stage() are waited for first, and the usage of all
+ * the children reaped since audit_begin() is taken.
+ *
+ * Arguments :
+ *      cmd_stack - the commands of the line
+ *      first, last - the stages of the command in cmd_stack
+ *      builtin - the command ran inside the shell
+ *
+ * Returns :
+ *      None
+ */
+void audit_end(command **cmd_stack, int first, int last, int builtin);
+
+#endif
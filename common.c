@@ -0,0 +1,110 @@
+/*
+ * Common.c
+ * One copy of the helpers several modules need, so a change to the hash,
+ * to how files are read or to how sockets are set up applies to all of them
+ * Authors : Aloysious Kok & Gerald
+ * Last Update : 18/10/26
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "common.h"
+
+uint64_t hash64(const void *data, size_t len)
+{
+    const unsigned char *s = data;
+    uint64_t hash = 14695981039346656037ull; // FNV-1a
+
+    for (size_t i = 0; i < len; i++)
+    {
+        hash ^= s[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+uint32_t hash32(const void *data, size_t len)
+{
+    const unsigned char *s = data;
+    uint32_t hash = 2166136261u; // FNV-1a
+
+    for (size_t i = 0; i < len; i++)
+    {
+        hash ^= s[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+char *read_whole_file(const char *path, size_t *len)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    char *text = NULL;
+    ssize_t n;
+
+    *len = 0;
+    if (fd != -1 && fstat(fd, &st) == 0 && (text = malloc(st.st_size + 1)) != NULL)
+    {
+        while ((n = read(fd, text + *len, st.st_size - *len)) > 0)
+            *len += n;
+        text[*len] = '\0';
+    }
+    if (fd != -1)
+    {
+        close(fd);
+    }
+    return text;
+}
+
+int unix_address(const char *path, struct sockaddr_un *addr)
+{
+    memset(addr, 0, sizeof(*addr));
+    if (strlen(path) >= sizeof(addr->sun_path))
+    {
+        fprintf(stderr, "%s: socket path too long\n", path);
+        return -1;
+    }
+    addr->sun_family = AF_UNIX;
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+int unix_listen(const char *path, int type, int backlog)
+{
+    struct sockaddr_un addr;
+    struct stat st;
+
+    if (unix_address(path, &addr) < 0)
+    {
+        return -1;
+    }
+    // a socket left behind by an earlier run is replaced
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+    {
+        unlink(path);
+    }
+
+    int sock = socket(AF_UNIX, type | SOCK_CLOEXEC, 0);
+    if (sock == -1 || bind(sock, (struct sockaddr *)&addr, sizeof(addr)) == -1 || listen(sock, backlog) == -1)
+    {
+        perror(path);
+        if (sock != -1)
+            close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+int stdin_is_null()
+{
+    struct stat in_st, null_st;
+
+    return fstat(STDIN_FILENO, &in_st) == 0 && S_ISCHR(in_st.st_mode) && stat("/dev/null", &null_st) == 0 &&
+           in_st.st_rdev == null_st.st_rdev;
+}
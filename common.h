@@ -0,0 +1,100 @@
+#ifndef COMMON_H
+#define COMMON_H
+
+/*
+ * Common.h
+ * Helpers shared by the modules: the FNV-1a hashes, reading a whole
+ * file into memory, Unix socket addresses and the /dev/null stdin test
+ * Authors : Aloysious Kok & Gerald
+ * Last Update : 18/10/26
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/un.h>
+
+/* uint64_t hash64(const void *data, size_t len)
+ *
+ * Computes the 64-bit FNV-1a hash of len bytes, for keys that are
+ * stored or compared across runs (file names, records).
+ *
+ * Arguments :
+ *      data - the bytes to hash
+ *      len - their number
+ *
+ * Returns :
+ *      the hash
+ */
+uint64_t hash64(const void *data, size_t len);
+
+/* uint32_t hash32(const void *data, size_t len)
+ *
+ * Computes the 32-bit FNV-1a hash of len bytes, for in-memory tables.
+ *
+ * Arguments :
+ *      data - the bytes to hash
+ *      len - their number
+ *
+ * Returns :
+ *      the hash
+ */
+uint32_t hash32(const void *data, size_t len);
+
+/* char *read_whole_file(const char *path, size_t *len)
+ *
+ * This function reads a whole file into a buffer, with a '\0' after the
+ * last byte so the text can be used as a string.
+ *
+ * Arguments :
+ *      path - the file
+ *      len - receives the number of bytes read, 0 on failure
+ *
+ * Returns :
+ *      the contents, to be freed by the caller
+ *      NULL - the file could not be opened or the memory allocated
+ */
+char *read_whole_file(const char *path, size_t *len);
+
+/* int unix_address(const char *path, struct sockaddr_un *addr)
+ *
+ * This function fills in the address of a Unix socket, reporting a path
+ * too long to fit.
+ *
+ * Arguments :
+ *      path - the socket path
+ *      addr - receives the address
+ *
+ * Returns :
+ *      0 - success
+ *      -1 - the path is too long
+ */
+int unix_address(const char *path, struct sockaddr_un *addr);
+
+/* int unix_listen(const char *path, int type, int backlog)
+ *
+ * This function binds a listening Unix socket at path, replacing a
+ * socket an earlier run left behind. The descriptor is close-on-exec.
+ *
+ * Arguments :
+ *      path - the socket path
+ *      type - the socket type and flags, e.g. SOCK_STREAM | SOCK_NONBLOCK
+ *      backlog - the length of the queue of pending connections
+ *
+ * Returns :
+ *      the socket
+ *      -1 - the address or the socket could not be set up, reported
+ */
+int unix_listen(const char *path, int type, int backlog);
+
+/* int stdin_is_null()
+ *
+ * This function checks whether stdin is /dev/null, an input that always
+ * reads the same and that several readers can share.
+ *
+ * Returns :
+ *      1 - stdin is /dev/null
+ *      0 - otherwise
+ */
+int stdin_is_null();
+
+#endif
@@ -0,0 +1,633 @@
+/*
+ * Dirs.c
+ * The frecency index is a file mapped with MAP_SHARED, so recording a
+ * visit touches a few bytes of memory and is seen at once by every
+ * shell of the user. Paths are found through an open addressing hash
+ * table stored in the file; queries scan the entries and their path
+ * pool, which stay compact enough to be read in well under a
+ * millisecond for tens of thousands of directories. The file is never
+ * resized in place: a bigger or aged copy is written next to it and
+ * renamed over it, and the old mapping is marked stale so that the
+ * other shells map the new file. Updates are serialised with flock().
+ * Authors : Aloysious Kok & Gerald
+ * Last Update : 18/10/26
+ */
+
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include "dirs.h"
+#include "vars.h"
+#include "common.h"
+
+#define Z_ENTRIES(h) ((z_entry *)((char *)(h) + sizeof(z_header)))
+#define Z_SLOTS(h) ((uint32_t *)(Z_ENTRIES(h) + (h)->max_entries))
+#define Z_POOL(h) ((char *)(Z_SLOTS(h) + (h)->n_slots))
+
+// the directory stack, top last; the current directory is not in it
+static char **stack = NULL;
+static int n_stack = 0;
+static int stack_size = 0;
+
+// the mapped index
+static int z_fd = -1;
+static z_header *z_map = NULL;
+static size_t z_size = 0;
+static pid_t z_owner = 0;
+
+/* A directory matching a z query */
+typedef struct Z_match_struct
+{
+    uint32_t entry;
+    int prefix; // the last term starts the last component of the path
+    double score;
+} z_match;
+
+static size_t z_file_size(uint32_t max_entries, uint32_t pool_size)
+{
+    return sizeof(z_header) + max_entries * sizeof(z_entry) + 2 * max_entries * sizeof(uint32_t) + pool_size;
+}
+
+static int z_path(char *path, size_t size, const char *suffix)
+{
+    const char *home = var_get("HOME");
+
+    if (home == NULL || home[0] == '\0')
+    {
+        return -1;
+    }
+    snprintf(path, size, "%s/%s%s", home, Z_FILE_NAME, suffix);
+    return 0;
+}
+
+static void z_close()
+{
+    if (z_map != NULL)
+        munmap(z_map, z_size);
+    if (z_fd != -1)
+        close(z_fd);
+    z_map = NULL;
+    z_fd = -1;
+}
+
+/* Fills in the header of a newly sized file */
+static void z_init(z_header *h, uint32_t max_entries, uint32_t pool_size)
+{
+    memset(h, 0, sizeof(*h));
+    h->magic = Z_MAGIC;
+    h->max_entries = max_entries;
+    h->n_slots = 2 * max_entries;
+    h->pool_size = pool_size;
+}
+
+/* Maps the index file, creating it if needed. Called with no lock. */
+static int z_open()
+{
+    char path[MAX_BUF_SIZE];
+    struct stat st;
+
+    // a forked shell must not share the parent's open file and its lock
+    if (z_map != NULL && z_owner != getpid())
+    {
+        z_close();
+    }
+    if (z_map != NULL)
+    {
+        return 0;
+    }
+    if (z_path(path, sizeof(path), "") < 0)
+    {
+        return -1;
+    }
+
+    z_fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (z_fd == -1)
+    {
+        return -1;
+    }
+    z_owner = getpid();
+    flock(z_fd, LOCK_EX);
+    if (fstat(z_fd, &st) == -1)
+    {
+        z_close();
+        return -1;
+    }
+
+    z_header h = {0};
+    if ((size_t)st.st_size >= sizeof(h))
+        pread(z_fd, &h, sizeof(h), 0);
+    if (h.magic != Z_MAGIC || (size_t)st.st_size != z_file_size(h.max_entries, h.pool_size))
+    {
+        // new or damaged: start an empty index
+        z_init(&h, Z_INITIAL_ENTRIES, Z_INITIAL_POOL);
+        st.st_size = z_file_size(h.max_entries, h.pool_size);
+        if (ftruncate(z_fd, 0) == -1 || ftruncate(z_fd, st.st_size) == -1 || pwrite(z_fd, &h, sizeof(h), 0) == -1)
+        {
+            z_close();
+            return -1;
+        }
+    }
+
+    z_size = st.st_size;
+    z_map = mmap(NULL, z_size, PROT_READ | PROT_WRITE, MAP_SHARED, z_fd, 0);
+    flock(z_fd, LOCK_UN);
+    if (z_map == MAP_FAILED)
+    {
+        z_map = NULL;
+        z_close();
+        return -1;
+    }
+    return 0;
+}
+
+/* Maps and locks the current index file */
+static int z_lock(int operation)
+{
+    while (1)
+    {
+        if (z_open() < 0)
+            return -1;
+        flock(z_fd, operation);
+        if (!z_map->stale)
+            return 0;
+        // replaced while we waited for the lock
+        z_close();
+    }
+}
+
+/* Finds the slot of a path: its entry, or the empty slot for it */
+static uint32_t *z_find(z_header *h, const char *path, size_t len, uint32_t hash)
+{
+    z_entry *entries = Z_ENTRIES(h);
+    uint32_t *slots = Z_SLOTS(h);
+    uint32_t mask = h->n_slots - 1;
+
+    for (uint32_t i = hash & mask;; i = (i + 1) & mask)
+    {
+        if (slots[i] == 0)
+            return &slots[i];
+        z_entry *e = &entries[slots[i] - 1];
+        if (e->hash == hash && e->len == len && memcmp(Z_POOL(h) + e->path, path, len) == 0)
+            return &slots[i];
+    }
+}
+
+/* Appends an entry; there must be room for it */
+static z_entry *z_append(z_header *h, uint32_t *slot, const char *path, size_t len, uint32_t hash)
+{
+    z_entry *e = &Z_ENTRIES(h)[h->n_entries];
+
+    memcpy(Z_POOL(h) + h->pool_used, path, len);
+    Z_POOL(h)[h->pool_used + len] = '\0';
+    e->path = h->pool_used;
+    e->len = len;
+    e->hash = hash;
+    e->rank = 0;
+    e->time = 0;
+    h->pool_used += len + 1;
+    *slot = ++h->n_entries;
+    return e;
+}
+
+/*
+ * Replaces the locked index with a copy of the given capacities. With
+ * age, every rank is multiplied by Z_AGING and the directories falling
+ * below Z_MIN_RANK are left out. The new file is locked when it is renamed into
+ * place, so the other shells wait for it rather than for the old one.
+ */
+static int z_rebuild(uint32_t max_entries, uint32_t pool_size, int age)
+{
+    char path[MAX_BUF_SIZE];
+    char tmp[MAX_BUF_SIZE];
+    size_t size = z_file_size(max_entries, pool_size);
+
+    if (z_path(path, sizeof(path), "") < 0 || z_path(tmp, sizeof(tmp), ".tmp") < 0)
+    {
+        return -1;
+    }
+    int fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd == -1)
+    {
+        return -1;
+    }
+    z_header *h = MAP_FAILED;
+    if (ftruncate(fd, size) == 0)
+        h = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (h == MAP_FAILED)
+    {
+        close(fd);
+        unlink(tmp);
+        return -1;
+    }
+    flock(fd, LOCK_EX);
+    z_init(h, max_entries, pool_size);
+
+    z_entry *old = Z_ENTRIES(z_map);
+    for (uint32_t i = 0; i < z_map->n_entries; i++)
+    {
+        float rank = age ? old[i].rank * Z_AGING : old[i].rank;
+        if (rank < Z_MIN_RANK)
+            continue;
+        const char *p = Z_POOL(z_map) + old[i].path;
+        z_entry *e = z_append(h, z_find(h, p, old[i].len, old[i].hash), p, old[i].len, old[i].hash);
+        e->rank = rank;
+        e->time = old[i].time;
+        h->total += rank;
+    }
+
+    if (rename(tmp, path) == -1)
+    {
+        munmap(h, size);
+        close(fd);
+        unlink(tmp);
+        return -1;
+    }
+    z_map->stale = 1;
+    z_close();
+    z_fd = fd;
+    z_map = h;
+    z_size = size;
+    return 0;
+}
+
+/* Records a visit to dir */
+static void z_add(const char *dir)
+{
+    const char *home = var_get("HOME");
+    size_t len = strlen(dir);
+    uint32_t hash = hash32(dir, len);
+
+    if ((home != NULL && strcmp(dir, home) == 0) || z_lock(LOCK_EX) < 0)
+    {
+        return;
+    }
+
+    uint32_t *slot = z_find(z_map, dir, len, hash);
+    if (*slot == 0)
+    {
+        uint32_t max_entries = z_map->max_entries;
+        uint32_t pool_size = z_map->pool_size;
+        while (z_map->n_entries >= max_entries)
+            max_entries *= 2;
+        while (z_map->pool_used + len + 1 > pool_size)
+            pool_size *= 2;
+        if (max_entries != z_map->max_entries || pool_size != z_map->pool_size)
+        {
+            if (z_rebuild(max_entries, pool_size, 0) < 0)
+            {
+                flock(z_fd, LOCK_UN);
+                return;
+            }
+            slot = z_find(z_map, dir, len, hash);
+        }
+        z_append(z_map, slot, dir, len, hash);
+    }
+
+    z_entry *e = &Z_ENTRIES(z_map)[*slot - 1];
+    e->rank += 1;
+    e->time = time(NULL);
+    z_map->total += 1;
+    if (z_map->total > Z_MAX_TOTAL)
+    {
+        z_rebuild(z_map->max_entries, z_map->pool_size, 1);
+    }
+    flock(z_fd, LOCK_UN);
+}
+
+/* Rank weighted by how recently the directory was visited */
+static double z_frecency(const z_entry *e, time_t now)
+{
+    time_t age = now - e->time;
+
+    if (age < 3600)
+        return e->rank * 4;
+    if (age < 86400)
+        return e->rank * 2;
+    if (age < 604800)
+        return e->rank / 2;
+    return e->rank / 4;
+}
+
+/*
+ * Checks that the terms appear in the path in order. Sets *prefix when
+ * the last term starts the last component of the path.
+ */
+static int z_matches(const char *path, char **terms, int n_terms, int icase, int *prefix)
+{
+    const char *p = path;
+    const char *found = path;
+
+    for (int i = 0; i < n_terms; i++)
+    {
+        found = icase ? strcasestr(p, terms[i]) : strstr(p, terms[i]);
+        if (found == NULL)
+            return 0;
+        p = found + strlen(terms[i]);
+    }
+    *prefix = n_terms > 0 && found > path && found[-1] == '/' && strchr(found, '/') == NULL;
+    return 1;
+}
+
+/* Best match last, as z lists them */
+static int z_compare(const void *a, const void *b)
+{
+    const z_match *x = a;
+    const z_match *y = b;
+
+    if (x->prefix != y->prefix)
+        return x->prefix - y->prefix;
+    return (x->score > y->score) - (x->score < y->score);
+}
+
+int dirs_chdir(const char *path)
+{
+    char old[MAX_BUF_SIZE];
+    char cwd[MAX_BUF_SIZE];
+
+    if (getcwd(old, sizeof(old)) == NULL)
+    {
+        old[0] = '\0';
+    }
+    if (chdir(path) != 0)
+    {
+        return -1;
+    }
+    if (old[0] != '\0')
+    {
+        strcpy(prev_dir, old);
+        prev_dir_flag = 1;
+    }
+    if (getcwd(cwd, sizeof(cwd)) != NULL)
+    {
+        z_add(cwd);
+    }
+    return 0;
+}
+
+/* Prints a directory with $HOME shown as ~ */
+static void print_dir(const char *dir)
+{
+    const char *home = var_get("HOME");
+    size_t home_len = home ? strlen(home) : 0;
+
+    if (home_len > 1 && strncmp(dir, home, home_len) == 0 && (dir[home_len] == '/' || dir[home_len] == '\0'))
+        printf("~%s", dir + home_len);
+    else
+        printf("%s", dir);
+}
+
+/* Prints the stack, the current directory first */
+static void print_stack(int verbose)
+{
+    char cwd[MAX_BUF_SIZE];
+
+    if (getcwd(cwd, sizeof(cwd)) == NULL)
+    {
+        strcpy(cwd, ".");
+    }
+    for (int i = 0; i <= n_stack; i++)
+    {
+        if (verbose)
+            printf("%2d  ", i);
+        else if (i > 0)
+            printf(" ");
+        print_dir(i == 0 ? cwd : stack[n_stack - i]);
+        if (verbose)
+            printf("\n");
+    }
+    if (!verbose)
+        printf("\n");
+}
+
+/* Parses "+N", returns -1 if arg is not of that form */
+static int stack_index(const char *arg)
+{
+    char *end;
+
+    if (arg[0] != '+' || !isdigit((unsigned char)arg[1]))
+    {
+        return -1;
+    }
+    long n = strtol(arg + 1, &end, 10);
+    return (*end == '\0' && n <= n_stack) ? (int)n : -2;
+}
+
+static void stack_push(const char *dir)
+{
+    if (n_stack == stack_size)
+    {
+        stack_size = stack_size ? stack_size * 2 : 8;
+        stack = realloc(stack, stack_size * sizeof(char *));
+    }
+    stack[n_stack++] = strdup(dir);
+}
+
+int builtin_pushd(command *cmd)
+{
+    char old[MAX_BUF_SIZE];
+    const char *arg = cmd->argv[1];
+
+    if (getcwd(old, sizeof(old)) == NULL)
+    {
+        perror("pushd");
+        return -1;
+    }
+
+    if (arg == NULL)
+    {
+        // swap the top two directories
+        if (n_stack == 0)
+        {
+            fprintf(stderr, "pushd: no other directory\n");
+            return -1;
+        }
+        if (dirs_chdir(stack[n_stack - 1]) != 0)
+        {
+            perror(stack[n_stack - 1]);
+            return -1;
+        }
+        free(stack[n_stack - 1]);
+        stack[n_stack - 1] = strdup(old);
+    }
+    else if (stack_index(arg) != -1)
+    {
+        // rotate: entry n of "dirs -v" becomes the current directory
+        int n = stack_index(arg);
+        if (n < 0)
+        {
+            fprintf(stderr, "pushd: %s: directory stack index out of range\n", arg);
+            return -1;
+        }
+        if (n > 0)
+        {
+            int total = n_stack + 1;
+            char **list = malloc(total * sizeof(char *));
+            list[0] = strdup(old);
+            for (int i = 1; i < total; i++)
+                list[i] = stack[n_stack - i];
+            if (dirs_chdir(list[n]) != 0)
+            {
+                perror(list[n]);
+                free(list[0]);
+                free(list);
+                return -1;
+            }
+            free(list[n]);
+            for (int i = 1; i < total; i++)
+                stack[n_stack - i] = list[(n + i) % total];
+            free(list);
+        }
+    }
+    else
+    {
+        if (dirs_chdir(arg) != 0)
+        {
+            perror(arg);
+            return -1;
+        }
+        stack_push(old);
+    }
+
+    print_stack(0);
+    return 0;
+}
+
+int builtin_popd(command *cmd)
+{
+    const char *arg = cmd->argv[1];
+    int n = 0;
+
+    if (n_stack == 0)
+    {
+        fprintf(stderr, "popd: directory stack empty\n");
+        return -1;
+    }
+    if (arg != NULL && (n = stack_index(arg)) < 0)
+    {
+        fprintf(stderr, "popd: %s: invalid argument\n", arg);
+        return -1;
+    }
+
+    if (n == 0)
+    {
+        if (dirs_chdir(stack[n_stack - 1]) != 0)
+        {
+            perror(stack[n_stack - 1]);
+            return -1;
+        }
+        free(stack[--n_stack]);
+    }
+    else
+    {
+        // entry n of "dirs -v" is stack[n_stack - n]
+        free(stack[n_stack - n]);
+        memmove(stack + n_stack - n, stack + n_stack - n + 1, (n - 1) * sizeof(char *));
+        n_stack--;
+    }
+
+    print_stack(0);
+    return 0;
+}
+
+int builtin_dirs(command *cmd)
+{
+    int verbose = 0;
+
+    for (int i = 1; cmd->argv[i] != NULL; i++)
+    {
+        if (strcmp(cmd->argv[i], "-v") == 0)
+            verbose = 1;
+        else if (strcmp(cmd->argv[i], "-c") == 0)
+        {
+            while (n_stack > 0)
+                free(stack[--n_stack]);
+            return 0;
+        }
+        else
+        {
+            fprintf(stderr, "dirs: %s: invalid option\n", cmd->argv[i]);
+            return -1;
+        }
+    }
+    print_stack(verbose);
+    return 0;
+}
+
+int builtin_z(command *cmd)
+{
+    char **terms = cmd->argv + 1;
+    int n_terms = 0;
+    int list = 0;
+    int n_matches = 0;
+    char *target = NULL;
+
+    if (terms[0] != NULL && strcmp(terms[0], "-l") == 0)
+    {
+        list = 1;
+        terms++;
+    }
+    while (terms[n_terms] != NULL)
+        n_terms++;
+    if (n_terms == 0)
+        list = 1;
+
+    if (z_lock(LOCK_SH) < 0)
+    {
+        fprintf(stderr, "z: no directory index\n");
+        return -1;
+    }
+
+    z_entry *entries = Z_ENTRIES(z_map);
+    const char *pool = Z_POOL(z_map);
+    z_match *matches = malloc((z_map->n_entries + 1) * sizeof(z_match));
+    time_t now = time(NULL);
+
+    // case sensitive first, then without case if nothing matched
+    for (int icase = 0; icase < 2 && n_matches == 0; icase++)
+    {
+        for (uint32_t i = 0; i < z_map->n_entries; i++)
+        {
+            int prefix;
+            if (entries[i].rank > 0 && z_matches(pool + entries[i].path, terms, n_terms, icase, &prefix))
+                matches[n_matches++] = (z_match){i, prefix, z_frecency(&entries[i], now)};
+        }
+    }
+    qsort(matches, n_matches, sizeof(z_match), z_compare);
+
+    if (list)
+    {
+        for (int i = 0; i < n_matches; i++)
+            printf("%-10.1f %s\n", matches[i].score, pool + entries[matches[i].entry].path);
+    }
+    else
+    {
+        // the best directory that still exists
+        for (int i = n_matches - 1; i >= 0 && target == NULL; i--)
+        {
+            struct stat st;
+            const char *path = pool + entries[matches[i].entry].path;
+            if (stat(path, &st) == 0 && S_ISDIR(st.st_mode))
+                target = strdup(path);
+        }
+    }
+    free(matches);
+    flock(z_fd, LOCK_UN);
+
+    if (list)
+    {
+        return n_matches > 0 ? 0 : -1;
+    }
+    if (target == NULL)
+    {
+        fprintf(stderr, "z: no match\n");
+        return -1;
+    }
+    int status = dirs_chdir(target);
+    if (status != 0)
+        perror(target);
+    else
+        printf("current directory: %s\n", target);
+    free(target);
+    return status;
+}
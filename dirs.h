@@ -0,0 +1,137 @@
+#ifndef DIRS_H
+#define DIRS_H
+
+/*
+ * Dirs.h
+ * Directory changes: the pushd / popd / dirs directory stack and the z
+ * command, which jumps to a directory by frecency using an index of the
+ * directories visited that persists across sessions
+ * Authors : Aloysious Kok & Gerald
+ * Last Update : 18/10/26
+ */
+
+#include <stdint.h>
+#include "shell.h"
+
+/* Name of the frecency index, in $HOME */
+#define Z_FILE_NAME ".simpleshell_z"
+
+/* Identifies the index file and its layout */
+#define Z_MAGIC 0x315a5353 // "SSZ1"
+
+/* Capacities of a new index; they double when full */
+#define Z_INITIAL_ENTRIES 1024
+#define Z_INITIAL_POOL (32 * 1024)
+
+/* When the ranks add up to more than this, they are all aged by
+ * Z_AGING and directories whose rank drops below Z_MIN_RANK are
+ * forgotten */
+#define Z_MAX_TOTAL 100000
+#define Z_AGING 0.9
+#define Z_MIN_RANK 0.5
+
+/* Header of the index file. The file is the header, max_entries
+ * entries, n_slots hash slots and a pool of pool_size bytes holding the
+ * paths. A slot holds an entry index plus one, 0 when empty. */
+typedef struct Z_header_struct
+{
+    uint32_t magic;
+    uint32_t stale; // set when the file has been replaced by a bigger one
+    uint32_t n_entries;
+    uint32_t max_entries;
+    uint32_t n_slots;
+    uint32_t pool_used;
+    uint32_t pool_size;
+    uint32_t pad;
+    double total; // sum of the ranks
+} z_header;
+
+/* A visited directory */
+typedef struct Z_entry_struct
+{
+    uint32_t path; // offset of the path in the pool
+    uint32_t len;  // length of the path, without '\0'
+    uint32_t hash;
+    float rank;   // number of visits, aged
+    int64_t time; // last visit
+} z_entry;
+
+/* int dirs_chdir(const char *path)
+ *
+ * This function changes the current directory, remembers the old one
+ * for "cd -" and records the new one in the frecency index. Used by
+ * every builtin that changes directory.
+ *
+ * Arguments :
+ *      path - the directory to go to
+ *
+ * Returns :
+ *      0 - successful
+ *     -1 - chdir() failed, errno is set
+ */
+int dirs_chdir(const char *path);
+
+/* int builtin_pushd(command *cmd)
+ *
+ * pushd [dir | +N]
+ * Pushes the current directory on the stack and goes to dir. Without an
+ * argument the top two directories are swapped; with +N the stack is
+ * rotated so that the Nth directory of "dirs -v" comes to the top.
+ *
+ * Arguments :
+ *      cmd - the command struct to be processed
+ *
+ * Returns :
+ *      0 - successful
+ *     -1 - the stack is too short or the directory cannot be entered
+ */
+int builtin_pushd(command *cmd);
+
+/* int builtin_popd(command *cmd)
+ *
+ * popd [+N]
+ * Removes the top directory from the stack and goes to it, or with +N
+ * removes the Nth directory of "dirs -v".
+ *
+ * Arguments :
+ *      cmd - the command struct to be processed
+ *
+ * Returns :
+ *      0 - successful
+ *     -1 - the stack is empty or the directory cannot be entered
+ */
+int builtin_popd(command *cmd);
+
+/* int builtin_dirs(command *cmd)
+ *
+ * dirs [-c] [-v]
+ * Prints the directory stack, the current directory first, numbered one
+ * per line with -v. -c clears the stack.
+ *
+ * Arguments :
+ *      cmd - the command struct to be processed
+ *
+ * Returns :
+ *      0 - successful
+ *     -1 - bad option
+ */
+int builtin_dirs(command *cmd);
+
+/* int builtin_z(command *cmd)
+ *
+ * z [-l] [term]...
+ * Goes to the directory with the highest frecency whose path contains
+ * the terms in order. Matching is case sensitive, unless no directory
+ * matches that way. With -l, or without terms, the matches are listed
+ * with their scores instead.
+ *
+ * Arguments :
+ *      cmd - the command struct to be processed
+ *
+ * Returns :
+ *      0 - successful
+ *     -1 - nothing matches
+ */
+int builtin_z(command *cmd);
+
+#endif
@@ -0,0 +1,501 @@
+/*
+ * Edit.c
+ * The line being edited is kept in a gap buffer, so inserting or
+ * deleting at the cursor is amortised O(1) whatever the length of the
+ * line. The screen is updated from the cursor onwards only: an edit in
+ * the middle of the line rewrites the tail after it, a cursor movement
+ * writes nothing but the escape sequence that moves the cursor. All
+ * output goes through the render buffer of term.c.
+ * Authors : Aloysious Kok & Gerald
+ * Last Update : 18/10/26
+ */
+
+#include <sys/ioctl.h>
+#include "edit.h"
+#include "term.h"
+
+/* Largest number of characters in a line */
+#define EDIT_MAX (CMD_LENGTH - 1)
+
+#define GAP(gb) ((gb)->gap_end - (gb)->gap_start)
+#define LENGTH(gb) ((gb)->size - GAP(gb))
+#define TAIL(gb) ((gb)->size - (gb)->gap_end)
+
+/* The state of the line on the screen */
+typedef struct Editor_struct
+{
+    gap_buffer gb;
+    const char *prompt;
+    size_t prompt_len; // columns taken by the prompt
+    size_t cols;       // width of the terminal
+    int tty;           // output is a terminal that wraps long lines
+    size_t shown;      // columns currently drawn after the prompt
+} editor;
+
+/* The line being edited, for edit_set_prompt() */
+static editor *active = NULL;
+
+/* Makes room for at least n more characters in the gap */
+static void gb_reserve(gap_buffer *gb, size_t n)
+{
+    if (GAP(gb) >= n)
+    {
+        return;
+    }
+
+    size_t size = gb->size;
+    while (size - LENGTH(gb) < n)
+        size *= 2;
+
+    size_t tail = TAIL(gb);
+    gb->buf = realloc(gb->buf, size);
+    memmove(gb->buf + size - tail, gb->buf + gb->gap_end, tail);
+    gb->gap_end = size - tail;
+    gb->size = size;
+}
+
+/* Moves the gap (the cursor) to position pos of the text */
+static void gb_move(gap_buffer *gb, size_t pos)
+{
+    if (pos < gb->gap_start)
+    {
+        size_t n = gb->gap_start - pos;
+        memmove(gb->buf + gb->gap_end - n, gb->buf + pos, n);
+        gb->gap_start -= n;
+        gb->gap_end -= n;
+    }
+    else if (pos > gb->gap_start)
+    {
+        size_t n = pos - gb->gap_start;
+        memmove(gb->buf + gb->gap_start, gb->buf + gb->gap_end, n);
+        gb->gap_start += n;
+        gb->gap_end += n;
+    }
+}
+
+/* Returns the character at position pos of the text */
+static char gb_at(const gap_buffer *gb, size_t pos)
+{
+    return pos < gb->gap_start ? gb->buf[pos] : gb->buf[pos + GAP(gb)];
+}
+
+/* Whether a byte continues a UTF-8 character rather than starting one */
+#define CONTINUATION(c) (((unsigned char)(c) & 0xC0) == 0x80)
+
+/* Start of the character before position pos */
+static size_t char_left(const gap_buffer *gb, size_t pos)
+{
+    while (pos > 0 && CONTINUATION(gb_at(gb, --pos)))
+        ;
+    return pos;
+}
+
+/* Position after the character at pos */
+static size_t char_right(const gap_buffer *gb, size_t pos)
+{
+    size_t len = LENGTH(gb);
+
+    if (pos < len)
+        pos++;
+    while (pos < len && CONTINUATION(gb_at(gb, pos)))
+        pos++;
+    return pos;
+}
+
+/* Columns taken by the text before position pos, one per character */
+static size_t text_width(const gap_buffer *gb, size_t pos)
+{
+    size_t width = 0;
+
+    for (size_t i = 0; i < pos; i++)
+    {
+        if (!CONTINUATION(gb_at(gb, i)))
+            width++;
+    }
+    return width;
+}
+
+/* Width of the terminal, 80 if it cannot be found */
+static size_t term_cols()
+{
+    struct winsize ws;
+
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == -1 || ws.ws_col == 0)
+    {
+        return 80;
+    }
+    return ws.ws_col;
+}
+
+/* Columns taken by a prompt: colour sequences and the continuation
+ * bytes of UTF-8 characters take none */
+static size_t prompt_width(const char *p)
+{
+    size_t width = 0;
+
+    while (*p != '\0')
+    {
+        if (p[0] == '\33' && p[1] == '[')
+        {
+            for (p += 2; *p != '\0' && !isalpha((unsigned char)*p); p++)
+                ;
+            if (*p != '\0')
+                p++;
+            continue;
+        }
+        if (!CONTINUATION(*p))
+            width++;
+        p++;
+    }
+    return width;
+}
+
+/* Moves the screen cursor between two positions of the text, across
+ * wrapped rows if needed; positions are bytes, the screen counts
+ * characters */
+static void move_cursor(editor *ed, size_t from, size_t to)
+{
+    char seq[32];
+
+    if (from == to)
+    {
+        return;
+    }
+    from = text_width(&ed->gb, from);
+    to = text_width(&ed->gb, to);
+
+    size_t from_row = (ed->prompt_len + from) / ed->cols;
+    size_t to_row = (ed->prompt_len + to) / ed->cols;
+    size_t to_col = (ed->prompt_len + to) % ed->cols;
+
+    if (from == to)
+    {
+        return;
+    }
+    if (from_row == to_row)
+    {
+        size_t from_col = (ed->prompt_len + from) % ed->cols;
+        snprintf(seq, sizeof(seq), "\33[%zu%c", from_col > to_col ? from_col - to_col : to_col - from_col,
+                 from_col > to_col ? 'D' : 'C');
+        term_puts(seq);
+        return;
+    }
+
+    snprintf(seq, sizeof(seq), "\33[%zu%c\r", from_row > to_row ? from_row - to_row : to_row - from_row,
+             from_row > to_row ? 'A' : 'B');
+    term_puts(seq);
+    if (to_col > 0)
+    {
+        snprintf(seq, sizeof(seq), "\33[%zuC", to_col);
+        term_puts(seq);
+    }
+}
+
+/*
+ * Redraws the screen from the cursor to the end of the line after the
+ * text from the cursor on has changed, then puts the cursor back. Only
+ * the changed region is written.
+ */
+static void redraw_tail(editor *ed, size_t from)
+{
+    gap_buffer *gb = &ed->gb;
+    size_t len = LENGTH(gb);
+    size_t width = text_width(gb, len);
+
+    move_cursor(ed, from, gb->gap_start);
+    term_write(gb->buf + gb->gap_end, TAIL(gb));
+    if (ed->shown > width)
+    {
+        // the line got shorter: clear what is left of the old one
+        term_puts("\33[J");
+    }
+    // at the right margin the terminal waits before wrapping
+    if (ed->tty && width > 0 && (ed->prompt_len + width) % ed->cols == 0)
+    {
+        term_puts("\n");
+    }
+    ed->shown = width;
+    move_cursor(ed, len, gb->gap_start);
+}
+
+/* Inserts n characters at the cursor and shows them */
+static void insert(editor *ed, const char *s, size_t n)
+{
+    gap_buffer *gb = &ed->gb;
+
+    if (n > EDIT_MAX - LENGTH(gb))
+        n = EDIT_MAX - LENGTH(gb);
+    gb_reserve(gb, n);
+    memcpy(gb->buf + gb->gap_start, s, n);
+    gb->gap_start += n;
+
+    term_write(s, n);
+    redraw_tail(ed, gb->gap_start);
+}
+
+/* Replaces the whole line, for history recall */
+static void replace_line(editor *ed, const char *s)
+{
+    gap_buffer *gb = &ed->gb;
+
+    move_cursor(ed, gb->gap_start, 0);
+    gb->gap_start = 0;
+    gb->gap_end = gb->size;
+    term_puts("\33[J");
+    ed->shown = 0;
+    insert(ed, s, strlen(s));
+}
+
+static void move_to(editor *ed, size_t pos)
+{
+    move_cursor(ed, ed->gb.gap_start, pos);
+    gb_move(&ed->gb, pos);
+}
+
+/* Position of the start of the word before the cursor */
+static size_t word_left(const gap_buffer *gb)
+{
+    size_t pos = gb->gap_start;
+
+    while (pos > 0 && isspace((unsigned char)gb_at(gb, pos - 1)))
+        pos--;
+    while (pos > 0 && !isspace((unsigned char)gb_at(gb, pos - 1)))
+        pos--;
+    return pos;
+}
+
+/* Position of the end of the word after the cursor */
+static size_t word_right(const gap_buffer *gb)
+{
+    size_t pos = gb->gap_start;
+    size_t len = LENGTH(gb);
+
+    while (pos < len && isspace((unsigned char)gb_at(gb, pos)))
+        pos++;
+    while (pos < len && !isspace((unsigned char)gb_at(gb, pos)))
+        pos++;
+    return pos;
+}
+
+/* Reads a pasted block straight into the gap */
+static void paste(editor *ed)
+{
+    gap_buffer *gb = &ed->gb;
+    size_t from = gb->gap_start;
+
+    gb_reserve(gb, EDIT_MAX - LENGTH(gb));
+    size_t n = term_read_paste(gb->buf + gb->gap_start, EDIT_MAX - LENGTH(gb));
+    for (size_t i = 0; i < n; i++)
+    {
+        if (gb->buf[from + i] == '\r')
+            gb->buf[from + i] = '\n';
+    }
+    gb->gap_start += n;
+
+    // the paste is echoed in one piece with the rest of the line
+    term_write(gb->buf + from, n);
+    redraw_tail(ed, gb->gap_start);
+}
+
+/*
+ * Handles the escape sequence following an ESC. Returns the history
+ * direction (-1 up, 1 down) for Up/Down, 0 otherwise.
+ */
+static int escape(editor *ed)
+{
+    gap_buffer *gb = &ed->gb;
+    int params[2] = {0, 0};
+    int n_params = 0;
+    int ch = term_getc();
+
+    // Alt-b and Alt-f
+    if (ch == 'b')
+    {
+        move_to(ed, word_left(gb));
+        return 0;
+    }
+    if (ch == 'f')
+    {
+        move_to(ed, word_right(gb));
+        return 0;
+    }
+    if (ch != '[' && ch != 'O')
+    {
+        return 0;
+    }
+
+    while (isdigit(ch = term_getc()) || ch == ';')
+    {
+        if (ch == ';')
+            n_params = 1;
+        else
+            params[n_params] = params[n_params] * 10 + ch - '0';
+    }
+    // a modifier (Ctrl 5, Alt 3) turns Left/Right into word jumps
+    int word = params[1] == 5 || params[1] == 3;
+
+    switch (ch)
+    {
+    case 'A':
+        return -1;
+    case 'B':
+        return 1;
+    case 'C':
+        if (gb->gap_start < LENGTH(gb))
+            move_to(ed, word ? word_right(gb) : char_right(gb, gb->gap_start));
+        break;
+    case 'D':
+        if (gb->gap_start > 0)
+            move_to(ed, word ? word_left(gb) : char_left(gb, gb->gap_start));
+        break;
+    case 'H':
+        move_to(ed, 0);
+        break;
+    case 'F':
+        move_to(ed, LENGTH(gb));
+        break;
+    case '~':
+        if (params[0] == 1 || params[0] == 7)
+            move_to(ed, 0);
+        else if (params[0] == 4 || params[0] == 8)
+            move_to(ed, LENGTH(gb));
+        else if (params[0] == 3 && TAIL(gb) > 0)
+        {
+            gb->gap_end += char_right(gb, gb->gap_start) - gb->gap_start;
+            redraw_tail(ed, gb->gap_start);
+        }
+        else if (params[0] == 200)
+            paste(ed);
+        break;
+    }
+    return 0;
+}
+
+void edit_set_prompt(const char *prompt)
+{
+    char seq[32];
+
+    if (active == NULL || !active->tty)
+    {
+        return;
+    }
+
+    // back to the start of the prompt, then draw everything again
+    size_t row = (active->prompt_len + text_width(&active->gb, active->gb.gap_start)) / active->cols;
+    if (row > 0)
+    {
+        snprintf(seq, sizeof(seq), "\33[%zuA", row);
+        term_puts(seq);
+    }
+    term_puts("\r\33[J");
+
+    active->prompt = prompt;
+    active->prompt_len = prompt_width(prompt);
+    term_puts(prompt);
+    term_write(active->gb.buf, active->gb.gap_start);
+    active->shown = 0;
+    redraw_tail(active, active->gb.gap_start);
+}
+
+char *edit_line(const char *prompt, char **history, int n_history)
+{
+    editor ed = {0};
+    gap_buffer *gb = &ed.gb;
+    int history_index = n_history - 1;
+    int ch;
+
+    gb->size = EDIT_INITIAL_SIZE;
+    gb->buf = malloc(gb->size);
+    gb->gap_end = gb->size;
+    ed.prompt = prompt;
+    ed.prompt_len = prompt_width(prompt);
+    ed.cols = term_cols();
+    ed.tty = isatty(STDOUT_FILENO);
+    active = &ed;
+
+    term_puts(prompt);
+    while ((ch = term_getc()) != '\n' && ch != '\r')
+    {
+        char c = ch;
+
+        // Handle Ctrl-D (EOF)
+        if (ch == EOF)
+        {
+            term_putc('\n'); // Reprint the prompt and the line
+            term_puts(ed.prompt);
+            term_write(gb->buf, gb->gap_start);
+            ed.shown = 0;
+            redraw_tail(&ed, gb->gap_start);
+            continue;
+        }
+
+        switch (ch)
+        {
+        case 27: // escape sequences: cursor keys, history, paste
+        {
+            int dir = escape(&ed);
+            if (dir < 0 && history_index >= 0)
+                replace_line(&ed, history[history_index--]);
+            else if (dir > 0 && history_index < n_history - 1)
+                replace_line(&ed, history[++history_index]);
+            break;
+        }
+        case 1: // Ctrl-A
+            move_to(&ed, 0);
+            break;
+        case 5: // Ctrl-E
+            move_to(&ed, LENGTH(gb));
+            break;
+        case 2: // Ctrl-B
+            if (gb->gap_start > 0)
+                move_to(&ed, char_left(gb, gb->gap_start));
+            break;
+        case 6: // Ctrl-F
+            if (gb->gap_start < LENGTH(gb))
+                move_to(&ed, char_right(gb, gb->gap_start));
+            break;
+        case 3:  // Ctrl-C, Ctrl-Z and Ctrl-\ only get here without ISIG
+        case 26:
+        case 28:
+            break;
+        case 8:   // Ctrl-H
+        case 127: // Backspace
+            if (gb->gap_start > 0)
+            {
+                // the cursor moves while the character is there to measure
+                size_t to = char_left(gb, gb->gap_start);
+                move_cursor(&ed, gb->gap_start, to);
+                gb->gap_start = to;
+                redraw_tail(&ed, gb->gap_start);
+            }
+            break;
+        default:
+        {
+            // the bytes of a UTF-8 character are inserted together
+            char seq[4] = {c};
+            size_t n = 1, need = 1;
+            if ((unsigned char)c >= 0xF0)
+                need = 4;
+            else if ((unsigned char)c >= 0xE0)
+                need = 3;
+            else if ((unsigned char)c >= 0xC0)
+                need = 2;
+            while (n < need && CONTINUATION(ch = term_getc()))
+                seq[n++] = ch;
+            if (LENGTH(gb) + n <= EDIT_MAX)
+                insert(&ed, seq, n);
+            break;
+        }
+        }
+    }
+
+    active = NULL;
+    move_to(&ed, LENGTH(gb));
+    term_putc('\n');
+    term_flush();
+
+    // the gap is at the end: the text is already contiguous
+    gb_reserve(gb, 1);
+    gb->buf[gb->gap_start] = '\0';
+    return gb->buf;
+}
@@ -0,0 +1,65 @@
+#ifndef EDIT_H
+#define EDIT_H
+
+/*
+ * Edit.h
+ * Line editor built on a gap buffer: cursor movement, word jumps and
+ * insertion or deletion anywhere in the line, redrawing only the part
+ * of the line that changed
+ * Authors : Aloysious Kok & Gerald
+ * Last Update : 18/10/26
+ */
+
+#include "shell.h"
+
+/* Initial size of the gap buffer; it doubles up to CMD_LENGTH */
+#define EDIT_INITIAL_SIZE 256
+
+/* The text is buf[0..gap_start) followed by buf[gap_end..size). The
+ * cursor is always at the gap, so typing at the cursor only fills the
+ * gap and moving the cursor moves the text between the two ends. */
+typedef struct Gap_buffer_struct
+{
+    char *buf;
+    size_t size;
+    size_t gap_start;
+    size_t gap_end;
+} gap_buffer;
+
+/* char *edit_line(const char *prompt, char **history, int n_history)
+ *
+ * This function prints the prompt and lets the user edit a line. The
+ * terminal must be in raw mode.
+ *
+ *  Left/Right, Ctrl-B/Ctrl-F        move by a character
+ *  Ctrl-Left/Right, Alt-B/Alt-F     move by a word
+ *  Home/End, Ctrl-A/Ctrl-E          move to the start or end
+ *  Backspace, Delete                delete before or at the cursor
+ *  Up/Down                          recall history
+ *
+ * Arguments :
+ *      prompt - the prompt, also used to place the cursor on wrapped lines
+ *      history - the history lines, oldest first
+ *      n_history - the number of history lines
+ *
+ * Returns :
+ *      the line as a newly allocated string
+ */
+char *edit_line(const char *prompt, char **history, int n_history);
+
+/* void edit_set_prompt(const char *prompt)
+ *
+ * This function replaces the prompt of the line being edited and redraws
+ * the prompt and the line in place, keeping the cursor where it was.
+ * Called when an asynchronous prompt segment finishes. Does nothing if
+ * no line is being edited or the output is not a terminal.
+ *
+ * Arguments :
+ *      prompt - the new prompt; it must stay valid while the line is edited
+ *
+ * Returns :
+ *      None
+ */
+void edit_set_prompt(const char *prompt);
+
+#endif
@@ -0,0 +1,395 @@
+/*
+ * Jobs.c
+ * Every child the shell does not wait for straight away is kept in a
+ * table with a pidfd registered in an epoll set. SIGCHLD only reaps the
+ * children epoll reports as exited, so a foreground waitpid() can no
+ * longer lose its child to the handler, and waiting for one of many
+ * children costs O(ready) rather than a scan of every child.
+ * Authors : Aloysious Kok & Gerald
+ * Last Update : 18/10/26
+ */
+
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include "jobs.h"
+#include "metrics.h"
+
+/* A slot of the child table. pid is 0 for a free slot. */
+typedef struct Child_struct
+{
+    pid_t pid;
+    int pidfd;  // -1 once reaped, or when polled with waitpid()
+    int done;   // reaped, the status has not been collected by wait
+    int status; // raw wait status
+    int job;    // a background command: the status is kept for wait
+    unsigned long reaped_seq; // when it was reaped, to drop the oldest
+} child;
+
+static child *children = NULL;
+static int n_slots = 0;    // slots handed out so far
+static int slots_size = 0; // slots allocated
+static int *free_slots = NULL;
+static int n_free = 0;
+static int n_running = 0;  // tracked children not reaped yet
+static int n_polled = 0;   // running children without a pidfd
+static int n_done = 0;     // reaped jobs whose status is kept
+static unsigned long reap_seq = 0;
+
+static int epoll_fd = -1;
+static pid_t owner_pid = 0;
+
+/*
+ * The table belongs to the process that created it. A forked child that
+ * keeps running shell code (a substitution, an in-process pipeline
+ * stage) starts with an empty table and its own epoll set.
+ */
+static void jobs_check_owner()
+{
+    if (owner_pid == getpid())
+    {
+        return;
+    }
+
+    if (epoll_fd != -1)
+    {
+        close(epoll_fd);
+    }
+    for (int i = 0; i < n_slots; i++)
+    {
+        if (children[i].pid != 0 && children[i].pidfd != -1)
+            close(children[i].pidfd);
+    }
+    n_slots = n_free = n_running = n_polled = n_done = 0;
+
+    owner_pid = getpid();
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+}
+
+static int open_pidfd(pid_t pid)
+{
+#ifdef SYS_pidfd_open
+    return syscall(SYS_pidfd_open, pid, 0);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+/* Converts a raw wait status into an exit status */
+static int exit_code(int status)
+{
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+static void release_slot(int idx)
+{
+    if (children[idx].done && children[idx].job)
+    {
+        n_done--;
+    }
+    children[idx].pid = 0;
+    free_slots[n_free++] = idx;
+}
+
+/* Returns the slot of the job reaped longest ago whose status is kept, or -1 */
+static int oldest_done()
+{
+    int oldest = -1;
+
+    for (int i = 0; i < n_slots && n_done > 0; i++)
+    {
+        if (children[i].pid != 0 && children[i].done && children[i].job &&
+            (oldest < 0 || children[i].reaped_seq < children[oldest].reaped_seq))
+            oldest = i;
+    }
+    return oldest;
+}
+
+/* Drops the status of the job reaped longest ago, nobody having waited for it */
+static void release_oldest_done()
+{
+    int oldest = oldest_done();
+
+    if (oldest >= 0)
+    {
+        release_slot(oldest);
+    }
+}
+
+/*
+ * Reaps the child in slot idx. options is WNOHANG or 0 to block, and
+ * report logs the reaped child. Returns 1 if the child was reaped. The
+ * slot of a child that is not a job is freed at once, nothing can wait
+ * for it; at most JOBS_MAX_DONE reaped jobs keep their status.
+ */
+static int reap_slot(int idx, int options, int report)
+{
+    child *c = &children[idx];
+    int status;
+
+    if (c->pid == 0 || c->done)
+    {
+        return 0;
+    }
+    if (waitpid(c->pid, &status, options) != c->pid)
+    {
+        return 0;
+    }
+
+    if (c->pidfd != -1)
+    {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, c->pidfd, NULL);
+        close(c->pidfd);
+        c->pidfd = -1;
+    }
+    else
+    {
+        n_polled--;
+    }
+    c->done = 1;
+    c->status = status;
+    n_running--;
+
+    if (report)
+    {
+        // log the PID and status of reaped children
+        printf("Reaped child process with PID: %d, Status: %d\n", c->pid, status);
+        metrics_count(M_REAPED, 1);
+    }
+
+    if (!c->job)
+    {
+        release_slot(idx);
+    }
+    else
+    {
+        c->reaped_seq = reap_seq++;
+        if (++n_done > JOBS_MAX_DONE)
+            release_oldest_done();
+    }
+    return 1;
+}
+
+static int find_slot(pid_t pid)
+{
+    for (int i = 0; i < n_slots; i++)
+    {
+        if (children[i].pid == pid)
+            return i;
+    }
+    return -1;
+}
+
+/*
+ * Waits up to timeout milliseconds (-1 for ever) for tracked children
+ * to exit and reaps them. Returns the slot of one of the jobs reaped,
+ * or -1 if none was.
+ */
+static int reap_ready(int timeout, int report)
+{
+    struct epoll_event events[JOBS_EVENTS];
+    int reaped = -1;
+    int n;
+
+    if (n_polled > 0)
+    {
+        // without pidfds there is nothing to sleep on but waitpid()
+        for (int i = 0; i < n_slots; i++)
+        {
+            if (children[i].pidfd == -1 && reap_slot(i, WNOHANG, report) && children[i].pid != 0)
+                reaped = i;
+        }
+        if (reaped >= 0 || timeout == 0)
+            return reaped;
+        for (int i = 0; i < n_slots && n_running == n_polled; i++)
+        {
+            if (children[i].pidfd == -1 && reap_slot(i, 0, report) && children[i].pid != 0)
+                return i;
+        }
+    }
+
+    do
+    {
+        n = epoll_wait(epoll_fd, events, JOBS_EVENTS, timeout);
+        for (int i = 0; i < n; i++)
+        {
+            if (reap_slot(events[i].data.u32, WNOHANG, report) && children[events[i].data.u32].pid != 0)
+                reaped = events[i].data.u32;
+        }
+        // drain the set when more children are ready than one call returns
+        timeout = 0;
+    } while (n == JOBS_EVENTS || (n == -1 && errno == EINTR && !interrupted));
+
+    return reaped;
+}
+
+/*
+ * Waits for each child named in the NULL terminated list of pids.
+ * Returns the exit status of the last one.
+ */
+static int wait_pids(char **pids)
+{
+    int status = 0;
+
+    for (int i = 0; pids[i] != NULL; i++)
+    {
+        char *end;
+        pid_t pid = strtol(pids[i], &end, 10);
+        int idx = (*end == '\0' && pid > 0) ? find_slot(pid) : -1;
+
+        if (idx < 0)
+        {
+            fprintf(stderr, "wait: pid %s is not a child of this shell\n", pids[i]);
+            status = 127;
+            continue;
+        }
+        if (!children[idx].done)
+        {
+            // the only waiter for this child: a blocking waitpid() is exact
+            reap_slot(idx, 0, 0);
+        }
+        status = exit_code(children[idx].status);
+        release_slot(idx);
+    }
+    return status;
+}
+
+void jobs_track(pid_t pid, int job)
+{
+    sigset_t block, old_mask;
+    int idx;
+
+    sigemptyset(&block);
+    sigaddset(&block, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &block, &old_mask);
+    jobs_check_owner();
+
+    if (n_free > 0)
+    {
+        idx = free_slots[--n_free];
+    }
+    else
+    {
+        if (n_slots == slots_size)
+        {
+            slots_size = slots_size ? slots_size * 2 : JOBS_INITIAL_SIZE;
+            children = realloc(children, slots_size * sizeof(child));
+            free_slots = realloc(free_slots, slots_size * sizeof(int));
+        }
+        idx = n_slots++;
+    }
+
+    children[idx] = (child){pid, open_pidfd(pid), 0, 0, job, 0};
+    n_running++;
+
+    if (children[idx].pidfd != -1)
+    {
+        struct epoll_event ev = {0};
+        ev.events = EPOLLIN;
+        ev.data.u32 = idx;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, children[idx].pidfd, &ev) == -1)
+        {
+            close(children[idx].pidfd);
+            children[idx].pidfd = -1;
+        }
+    }
+    if (children[idx].pidfd == -1)
+    {
+        n_polled++;
+    }
+
+    sigprocmask(SIG_SETMASK, &old_mask, NULL);
+}
+
+void jobs_wait_stage(pid_t pid)
+{
+    sigset_t block, old_mask;
+    int idx;
+
+    // the slot of a reaped stage is freed: SIGCHLD must not do it meanwhile
+    sigemptyset(&block);
+    sigaddset(&block, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &block, &old_mask);
+    jobs_check_owner();
+
+    if ((idx = find_slot(pid)) >= 0 && !children[idx].job)
+    {
+        reap_slot(idx, 0, 0);
+    }
+    sigprocmask(SIG_SETMASK, &old_mask, NULL);
+}
+
+void jobs_reap()
+{
+    int errno_saved = errno;
+
+    jobs_check_owner();
+    if (n_running > 0)
+    {
+        reap_ready(0, 1);
+    }
+    errno = errno_saved;
+}
+
+int jobs_running()
+{
+    jobs_check_owner();
+    return n_running;
+}
+
+int builtin_wait(command *cmd)
+{
+    sigset_t block, old_mask;
+    int status = 0;
+
+    // reaping happens here, not in claim_zombies()
+    sigemptyset(&block);
+    sigaddset(&block, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &block, &old_mask);
+    jobs_check_owner();
+
+    // Ctrl-C ends the wait, the children keep running
+    if (cmd->argv[1] == NULL)
+    {
+        while (n_running > 0 && !interrupted)
+        {
+            reap_ready(-1, 0);
+        }
+        for (int j = 0; j < n_slots; j++)
+        {
+            if (children[j].pid != 0 && children[j].done)
+                release_slot(j);
+        }
+        if (interrupted)
+            status = 128 + SIGINT;
+    }
+    else if (strcmp(cmd->argv[1], "-n") == 0)
+    {
+        // a job that has already exited comes first, in the order it did
+        int idx = oldest_done();
+        while (idx < 0 && n_running > 0 && !interrupted)
+        {
+            idx = reap_ready(-1, 0);
+        }
+        if (idx < 0 && interrupted)
+        {
+            status = 128 + SIGINT;
+        }
+        else if (idx < 0)
+        {
+            status = 127;
+        }
+        else
+        {
+            status = exit_code(children[idx].status);
+            release_slot(idx);
+        }
+    }
+    else
+    {
+        status = wait_pids(&cmd->argv[1]);
+    }
+
+    sigprocmask(SIG_SETMASK, &old_mask, NULL);
+    return status;
+}
@@ -0,0 +1,94 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+/*
+ * Jobs.h
+ * Tracking of the children the shell does not wait for straight away
+ * (background commands, pipeline stages, process substitutions) with
+ * pidfds registered in an epoll set
+ * Authors : Aloysious Kok & Gerald
+ * Last Update : 18/10/26
+ */
+
+#include "shell.h"
+
+/* Initial number of slots in the child table */
+#define JOBS_INITIAL_SIZE 64
+
+/* Reaped background commands whose status is kept until wait collects
+ * it; beyond that the oldest are forgotten */
+#define JOBS_MAX_DONE 64
+
+/* Number of epoll events collected per epoll_wait() call */
+#define JOBS_EVENTS 64
+
+/* void jobs_track(pid_t pid, int job)
+ *
+ * This function hands a child over to the child table. A pidfd is
+ * opened for it and added to the epoll set, so that the child is reaped
+ * exactly once, by jobs_reap() or builtin_wait(). Children that the
+ * caller waits for itself (foreground commands) must not be tracked.
+ * If pidfds are not supported the child is polled with waitpid(). The
+ * slot of a child that is not a job is freed as soon as it is reaped.
+ *
+ * Arguments :
+ *      pid - the process id of the child
+ *      job - 1 for a background command, whose status is kept for wait;
+ *            0 for a pipeline stage, substitution or fan-out
+ *
+ * Returns :
+ *      None
+ */
+void jobs_track(pid_t pid, int job);
+
+/* void jobs_wait_stage(pid_t pid)
+ *
+ * This function waits for a tracked child that is not a job, such as an
+ * earlier stage of a pipeline, to exit and reaps it. It returns at once
+ * if the child has already been reaped.
+ *
+ * Arguments :
+ *      pid - the process id of the child
+ *
+ * Returns :
+ *      None
+ */
+void jobs_wait_stage(pid_t pid);
+
+/* void jobs_reap()
+ *
+ * This function reaps the tracked children that have exited, using
+ * epoll_wait() so the cost depends on the number of ready children,
+ * not on the number of children being tracked. The exit status is kept
+ * until it is collected by builtin_wait(). Called from claim_zombies().
+ *
+ * Returns :
+ *      None
+ */
+void jobs_reap();
+
+/* int jobs_running()
+ *
+ * Returns the number of tracked children that have not exited yet.
+ */
+int jobs_running();
+
+/* int builtin_wait(command *cmd)
+ *
+ * wait [-n] [pid]...
+ * Waits for every tracked child, for the given children, or with -n for
+ * the next background job to exit; a job that has exited already and was
+ * not waited for is taken first, the earliest one to exit.
+ *
+ * Arguments :
+ *      cmd - the command struct to be processed
+ *
+ * Returns :
+ *      the exit status of the last child waited for (0 without arguments)
+ *      127 - a pid is not a child of the shell, or -n found no job that is
+ *            running or has a status kept
+ *      130 - Ctrl-C ended the wait (without pids), the children go on
+ */
+int builtin_wait(command *cmd);
+
+#endif
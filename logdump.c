@@ -0,0 +1,147 @@
+/*
+ * Logdump.c
+ * shell-logdump: decodes the audit log written with set -o audit.
+ *
+ *   shell-logdump [-s start] [-e end] [-c text] [log]
+ *
+ * -s and -e keep the commands started within a time range, given as
+ * seconds since the epoch or as YYYY-MM-DD[THH:MM[:SS]] local time.
+ * -c keeps the commands whose command line contains text. The log
+ * defaults to $AUDIT_LOG, then ~/.simpleshell_audit.
+ * Authors : Aloysious Kok & Gerald
+ * Last Update : 18/10/26
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include "audit.h"
+
+#define RECORDS_OF(h) ((const audit_record *)((const char *)(h) + sizeof(audit_header)))
+#define POOL_OF(h) ((const char *)(RECORDS_OF(h) + (h)->max_records))
+
+static void usage()
+{
+    fprintf(stderr, "usage: shell-logdump [-s start] [-e end] [-c text] [log]\n");
+    exit(2);
+}
+
+/* Parses a time argument into nanoseconds since the epoch */
+static int64_t parse_time(const char *arg)
+{
+    static const char *formats[] = {"%Y-%m-%dT%H:%M:%S", "%Y-%m-%d %H:%M:%S", "%Y-%m-%dT%H:%M", "%Y-%m-%d"};
+    char *end;
+    struct tm tm;
+
+    long long secs = strtoll(arg, &end, 10);
+    if (*arg != '\0' && *end == '\0')
+    {
+        return secs * 1000000000;
+    }
+    for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++)
+    {
+        memset(&tm, 0, sizeof(tm));
+        end = strptime(arg, formats[i], &tm);
+        if (end != NULL && *end == '\0')
+        {
+            tm.tm_isdst = -1;
+            return (int64_t)mktime(&tm) * 1000000000;
+        }
+    }
+    fprintf(stderr, "shell-logdump: bad time: %s\n", arg);
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    int64_t start = INT64_MIN;
+    int64_t end = INT64_MAX;
+    const char *text = NULL;
+    char path[MAX_BUF_SIZE];
+    struct stat st;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:e:c:")) != -1)
+    {
+        switch (opt)
+        {
+        case 's':
+            start = parse_time(optarg);
+            break;
+        case 'e':
+            end = parse_time(optarg);
+            break;
+        case 'c':
+            text = optarg;
+            break;
+        default:
+            usage();
+        }
+    }
+    if (optind < argc - 1)
+    {
+        usage();
+    }
+
+    if (optind < argc)
+        snprintf(path, sizeof(path), "%s", argv[optind]);
+    else if (getenv("AUDIT_LOG") != NULL)
+        snprintf(path, sizeof(path), "%s", getenv("AUDIT_LOG"));
+    else if (getenv("HOME") != NULL)
+        snprintf(path, sizeof(path), "%s/%s", getenv("HOME"), AUDIT_FILE_NAME);
+    else
+        usage();
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1 || fstat(fd, &st) == -1)
+    {
+        perror(path);
+        return 1;
+    }
+    const audit_header *h = MAP_FAILED;
+    if ((size_t)st.st_size >= sizeof(audit_header))
+        h = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (h == MAP_FAILED || h->magic != AUDIT_MAGIC || h->record_size != sizeof(audit_record) ||
+        (size_t)st.st_size < sizeof(audit_header) + (size_t)h->max_records * sizeof(audit_record) + h->pool_size)
+    {
+        fprintf(stderr, "shell-logdump: %s is not an audit log\n", path);
+        return 1;
+    }
+
+    const char *pool = POOL_OF(h);
+    uint32_t n = h->n_records < h->max_records ? h->n_records : h->max_records;
+
+    printf("%-23s %7s %6s %10s %9s %9s %8s  %s\n", "start", "pid", "status", "wall(s)", "user(s)", "sys(s)",
+           "rss(KB)", "directory: command");
+    for (uint32_t i = 0; i < n; i++)
+    {
+        const audit_record *r = &RECORDS_OF(h)[i];
+        char when[32];
+        char status[16];
+
+        // records still being written by a shell are skipped
+        if (!(__atomic_load_n(&r->flags, __ATOMIC_ACQUIRE) & AUDIT_DONE))
+            continue;
+        if (r->start_ns < start || r->start_ns > end)
+            continue;
+        if (r->argv_off + r->argv_len > h->pool_size || r->cwd_off + r->cwd_len > h->pool_size)
+            continue;
+        if (text != NULL && memmem(pool + r->argv_off, r->argv_len, text, strlen(text)) == NULL)
+            continue;
+
+        time_t secs = r->start_ns / 1000000000;
+        struct tm tm;
+        localtime_r(&secs, &tm);
+        strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", &tm);
+        if (r->flags & AUDIT_BACKGROUND)
+            strcpy(status, "&");
+        else
+            snprintf(status, sizeof(status), "%d", r->status);
+
+        printf("%s.%03d %7d %6s %10.3f %9.3f %9.3f %8lld  %.*s: %.*s%s\n", when,
+               (int)(r->start_ns / 1000000 % 1000), r->pid, status, r->wall_ns / 1e9, r->user_us / 1e6,
+               r->sys_us / 1e6, (long long)r->max_rss_kb, (int)r->cwd_len, pool + r->cwd_off, (int)r->argv_len,
+               pool + r->argv_off, (r->flags & AUDIT_BUILTIN) ? " (builtin)" : "");
+    }
+    return 0;
+}
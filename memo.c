@@ -0,0 +1,420 @@
+/*
+ * Memo.c
+ * An entry is a file named after the FNV-1a hash of its key, so equal
+ * inputs find the same file without any index. The full key is stored
+ * in the entry as well and compared on a hit, so a hash collision is a
+ * miss rather than wrong output. Entries are written to a temporary
+ * file and renamed into place, so readers never see half an entry, and
+ * a hit sets the modification time of the entry, which orders eviction.
+ * Authors : Aloysious Kok & Gerald
+ * Last Update : 18/10/26
+ */
+
+#include <dirent.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include "memo.h"
+#include "common.h"
+
+/* Size of the buffer used to pass the output on */
+#define MEMO_BUF_SIZE 65536
+
+// an entry of the cache directory, for eviction
+typedef struct Memo_file_struct
+{
+    char name[32];
+    off_t size;
+    struct timespec used;
+} memo_file;
+
+int memo_is_prefix(const char *name)
+{
+    return name != NULL && strcmp(name, "memo") == 0;
+}
+
+static const char *env_get(char **envp, const char *name)
+{
+    size_t len = strlen(name);
+
+    for (int i = 0; envp[i] != NULL; i++)
+    {
+        if (strncmp(envp[i], name, len) == 0 && envp[i][len] == '=')
+            return envp[i] + len + 1;
+    }
+    return NULL;
+}
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+    const char *p = buf;
+
+    while (len > 0)
+    {
+        ssize_t n = write(fd, p, len);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static void key_add_stat(FILE *key, const char *what, const struct stat *st)
+{
+    fprintf(key, "%s %llx:%llx:%lld:%lld.%09ld", what, (unsigned long long)st->st_dev,
+            (unsigned long long)st->st_ino, (long long)st->st_size, (long long)st->st_mtim.tv_sec,
+            st->st_mtim.tv_nsec);
+    fputc('\0', key);
+}
+
+/* Adds the identity of the program that will be executed */
+static void key_add_program(FILE *key, const char *name, char **envp)
+{
+    char path[MAX_BUF_SIZE];
+    struct stat st;
+    const char *search = env_get(envp, "PATH");
+
+    if (strchr(name, '/') != NULL)
+    {
+        if (stat(name, &st) == 0)
+            key_add_stat(key, "program", &st);
+        return;
+    }
+    if (search == NULL)
+    {
+        search = "/bin:/usr/bin";
+    }
+    while (*search != '\0')
+    {
+        size_t len = strcspn(search, ":");
+        snprintf(path, sizeof(path), "%.*s%s%s", (int)len, search, len ? "/" : "", name);
+        if (stat(path, &st) == 0 && S_ISREG(st.st_mode) && access(path, X_OK) == 0)
+        {
+            key_add_stat(key, path, &st);
+            return;
+        }
+        search += len;
+        if (*search == ':')
+            search++;
+    }
+}
+
+/* Builds the key of a command; NULL if the command cannot be cached */
+static char *memo_key(char **argv, char **envp, size_t *key_len)
+{
+    char cwd[MAX_BUF_SIZE];
+    char names[MAX_BUF_SIZE];
+    struct stat st;
+    char *key = NULL;
+
+    if (fstat(STDIN_FILENO, &st) == 0 && !S_ISREG(st.st_mode) && !S_ISDIR(st.st_mode) && !stdin_is_null())
+    {
+        // the input of a pipe, socket, terminal or device cannot be told
+        // apart from before; /dev/null always reads the same
+        return NULL;
+    }
+    FILE *fp = open_memstream(&key, key_len);
+    if (fp == NULL)
+    {
+        return NULL;
+    }
+
+    for (int i = 0; argv[i] != NULL; i++)
+    {
+        fputs(argv[i], fp);
+        fputc('\0', fp);
+    }
+    fputc('\n', fp);
+
+    if (S_ISREG(st.st_mode))
+    {
+        key_add_stat(fp, "stdin", &st);
+    }
+    key_add_program(fp, argv[0], envp);
+    for (int i = 1; argv[i] != NULL; i++)
+    {
+        const char *eq = strchr(argv[i], '=');
+        if (stat(argv[i], &st) == 0)
+            key_add_stat(fp, argv[i], &st);
+        else if (eq != NULL && stat(eq + 1, &st) == 0)
+            key_add_stat(fp, eq + 1, &st);
+    }
+
+    fprintf(fp, "cwd %s", getcwd(cwd, sizeof(cwd)) != NULL ? cwd : "");
+    fputc('\0', fp);
+
+    const char *extra = env_get(envp, "MEMO_ENV");
+    snprintf(names, sizeof(names), "%s %s", MEMO_DEFAULT_ENV, extra != NULL ? extra : "");
+    for (char *save, *name = strtok_r(names, " \t:,", &save); name != NULL; name = strtok_r(NULL, " \t:,", &save))
+    {
+        const char *value = env_get(envp, name);
+        fprintf(fp, "env %s%s%s", name, value != NULL ? "=" : "", value != NULL ? value : "");
+        fputc('\0', fp);
+    }
+
+    fclose(fp);
+    return key;
+}
+
+static size_t memo_cap(char **envp)
+{
+    const char *value = env_get(envp, "MEMO_SIZE");
+    char *end;
+
+    if (value == NULL)
+    {
+        return MEMO_DEFAULT_SIZE;
+    }
+    unsigned long long size = strtoull(value, &end, 10);
+    switch (*end)
+    {
+    case 'G':
+    case 'g':
+        size *= 1024;
+        // fall through
+    case 'M':
+    case 'm':
+        size *= 1024;
+        // fall through
+    case 'K':
+    case 'k':
+        size *= 1024;
+    }
+    return size > 0 ? size : MEMO_DEFAULT_SIZE;
+}
+
+/* Writes a stored entry out; returns its status, or -1 if it does not match */
+static int memo_replay(int fd, const char *key, size_t key_len)
+{
+    memo_header h;
+    memo_chunk c;
+    char *buf = malloc(MEMO_BUF_SIZE > key_len ? MEMO_BUF_SIZE : key_len);
+
+    if (read(fd, &h, sizeof(h)) != sizeof(h) || h.magic != MEMO_MAGIC || h.key_len != key_len ||
+        read(fd, buf, key_len) != (ssize_t)key_len || memcmp(buf, key, key_len) != 0)
+    {
+        free(buf);
+        return -1;
+    }
+
+    // the entry has just been used
+    futimens(fd, NULL);
+    while (read(fd, &c, sizeof(c)) == sizeof(c))
+    {
+        while (c.len > 0)
+        {
+            ssize_t n = read(fd, buf, c.len < MEMO_BUF_SIZE ? c.len : MEMO_BUF_SIZE);
+            if (n <= 0)
+                break;
+            write_all(c.fd == 2 ? STDERR_FILENO : STDOUT_FILENO, buf, n);
+            c.len -= n;
+        }
+    }
+    free(buf);
+    return h.status;
+}
+
+static int by_use(const void *a, const void *b)
+{
+    const memo_file *x = a, *y = b;
+
+    if (x->used.tv_sec != y->used.tv_sec)
+        return x->used.tv_sec < y->used.tv_sec ? -1 : 1;
+    return (x->used.tv_nsec > y->used.tv_nsec) - (x->used.tv_nsec < y->used.tv_nsec);
+}
+
+/* Removes the least recently used entries until the cache fits in cap */
+static void memo_evict(const char *dir, size_t cap)
+{
+    memo_file *files = NULL;
+    int n = 0, max = 0;
+    size_t total = 0;
+    struct dirent *entry;
+    struct stat st;
+
+    DIR *d = opendir(dir);
+    if (d == NULL)
+    {
+        return;
+    }
+    while ((entry = readdir(d)) != NULL)
+    {
+        if (entry->d_name[0] == '.' && (entry->d_name[1] == '\0' || strcmp(entry->d_name, "..") == 0))
+            continue;
+        if (strlen(entry->d_name) >= sizeof(files->name) ||
+            fstatat(dirfd(d), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == -1 || !S_ISREG(st.st_mode))
+            continue;
+        if (n == max)
+        {
+            max = max ? 2 * max : 64;
+            files = realloc(files, max * sizeof(memo_file));
+        }
+        strcpy(files[n].name, entry->d_name);
+        files[n].size = st.st_size;
+        files[n].used = st.st_mtim;
+        total += st.st_size;
+        n++;
+    }
+
+    if (total > cap)
+    {
+        qsort(files, n, sizeof(memo_file), by_use);
+        for (int i = 0; i < n && total > cap; i++)
+        {
+            if (unlinkat(dirfd(d), files[i].name, 0) == 0)
+                total -= files[i].size;
+        }
+    }
+    closedir(d);
+    free(files);
+}
+
+/* Runs the command in a child, passing its output on and storing it */
+static char **memo_record(char **argv, char **envp, const char *dir, const char *path, const char *key,
+                          size_t key_len)
+{
+    int out[2], err[2];
+    char tmp[MAX_BUF_SIZE + 16];
+    size_t cap = memo_cap(envp);
+    size_t stored = 0;
+    int status;
+
+    snprintf(tmp, sizeof(tmp), "%s/.tmp.XXXXXX", dir);
+    int fd = mkstemp(tmp);
+    if (fd == -1 || pipe2(out, O_CLOEXEC) == -1 || pipe2(err, O_CLOEXEC) == -1)
+    {
+        // the command still runs, it is just not stored
+        if (fd != -1)
+        {
+            unlink(tmp);
+            close(fd);
+        }
+        return argv;
+    }
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        close(fd);
+        dup2(out[1], STDOUT_FILENO);
+        dup2(err[1], STDERR_FILENO);
+        return argv;
+    }
+    close(out[1]);
+    close(err[1]);
+    signal(SIGPIPE, SIG_IGN);
+
+    memo_header h = {MEMO_MAGIC, 0, key_len, 0};
+    int ok = pid > 0 && write_all(fd, &h, sizeof(h)) == 0 && write_all(fd, key, key_len) == 0;
+    struct pollfd pfd[2] = {{out[0], POLLIN, 0}, {err[0], POLLIN, 0}};
+    int open_fds = 2;
+    char *buf = malloc(MEMO_BUF_SIZE);
+
+    while (pid > 0 && open_fds > 0)
+    {
+        if (poll(pfd, 2, -1) == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        for (int i = 0; i < 2; i++)
+        {
+            if (pfd[i].revents == 0)
+                continue;
+            ssize_t n = read(pfd[i].fd, buf, MEMO_BUF_SIZE);
+            if (n == -1 && errno == EINTR)
+                continue;
+            if (n <= 0)
+            {
+                close(pfd[i].fd);
+                pfd[i].fd = -1;
+                open_fds--;
+                continue;
+            }
+            write_all(i == 0 ? STDOUT_FILENO : STDERR_FILENO, buf, n);
+
+            // an output larger than a quarter of the cache is not kept
+            memo_chunk c = {i + 1, n};
+            stored += n;
+            if (ok && stored <= cap / 4)
+                ok = write_all(fd, &c, sizeof(c)) == 0 && write_all(fd, buf, n) == 0;
+            else
+                ok = 0;
+        }
+    }
+    free(buf);
+
+    while (pid > 0 && waitpid(pid, &status, 0) == -1 && errno == EINTR)
+        ;
+    if (pid < 0)
+    {
+        perror("fork");
+        status = W_EXITCODE(126, 0);
+    }
+
+    // only a command that exited by itself is replayed
+    h.status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    if (ok && WIFEXITED(status) && pwrite(fd, &h, sizeof(h), 0) == sizeof(h) && rename(tmp, path) == 0)
+    {
+        memo_evict(dir, cap);
+    }
+    else
+    {
+        unlink(tmp);
+    }
+    close(fd);
+    exit(h.status);
+}
+
+char **memo_apply(char **argv, char **envp)
+{
+    char dir[MAX_BUF_SIZE];
+    char path[MAX_BUF_SIZE + 32];
+    const char *name = env_get(envp, "MEMO_DIR");
+    const char *home = env_get(envp, "HOME");
+    size_t key_len;
+
+    argv++;
+    if (argv[0] != NULL && strcmp(argv[0], "--") == 0)
+    {
+        argv++;
+    }
+    if (argv[0] == NULL)
+    {
+        fprintf(stderr, "usage: memo [--] command [args]...\n");
+        return NULL;
+    }
+
+    if (name != NULL && name[0] != '\0')
+        snprintf(dir, sizeof(dir), "%s", name);
+    else if (home != NULL)
+        snprintf(dir, sizeof(dir), "%s/%s", home, MEMO_DIR_NAME);
+    else
+        return argv;
+    mkdir(dir, 0700);
+
+    char *key = memo_key(argv, envp, &key_len);
+    if (key == NULL)
+    {
+        return argv;
+    }
+    snprintf(path, sizeof(path), "%s/%016llx", dir, (unsigned long long)hash64(key, key_len));
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd != -1)
+    {
+        int status = memo_replay(fd, key, key_len);
+        close(fd);
+        if (status >= 0)
+        {
+            exit(status);
+        }
+    }
+    argv = memo_record(argv, envp, dir, path, key, key_len);
+    free(key);
+    return argv;
+}
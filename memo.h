@@ -0,0 +1,80 @@
+#ifndef MEMO_H
+#define MEMO_H
+
+/*
+ * Memo.h
+ * The memo command prefix: the stdout, stderr and exit status of a
+ * command are cached, keyed on everything the command is assumed to
+ * depend on, and replayed instead of running it again
+ * Authors : Aloysious Kok & Gerald
+ * Last Update : 18/10/26
+ */
+
+#include <stdint.h>
+#include "shell.h"
+
+/* Name of the cache in $HOME, unless the MEMO_DIR variable names one */
+#define MEMO_DIR_NAME ".simpleshell_memo"
+
+/* Size of the cache, unless MEMO_SIZE gives it (a number of bytes with
+ * an optional K, M or G suffix); least recently used entries go first */
+#define MEMO_DEFAULT_SIZE (64 * 1024 * 1024)
+
+/* Variables that are part of the key, besides those named in MEMO_ENV */
+#define MEMO_DEFAULT_ENV "PATH"
+
+/* Identifies a cache entry and its layout */
+#define MEMO_MAGIC 0x314d5353 // "SSM1"
+
+/* Header of a cache entry. The key follows, then the output as chunks,
+ * each a memo_chunk and its bytes, in the order they were written */
+typedef struct Memo_header_struct
+{
+    uint32_t magic;
+    int32_t status;
+    uint32_t key_len;
+    uint32_t pad;
+} memo_header;
+
+typedef struct Memo_chunk_struct
+{
+    uint32_t fd; // 1 or 2
+    uint32_t len;
+} memo_chunk;
+
+/* int memo_is_prefix(const char *name)
+ *
+ * Checks whether a command name is the memo prefix.
+ *
+ * Returns :
+ *      1 - name is the prefix
+ *      0 - otherwise
+ */
+int memo_is_prefix(const char *name);
+
+/* char **memo_apply(char **argv, char **envp)
+ *
+ * memo [--] command [args]...
+ * This function is called in the child before the command is executed.
+ * The key is the arguments, the variables PATH and those named in
+ * $MEMO_ENV, the working directory, and the device, inode, size and
+ * modification time of the program, of stdin when it is a file, and of
+ * every argument naming an existing file (also after an '='). On a hit
+ * the stored output is written and the process exits with the stored
+ * status. On a miss a child is forked to run the command with its
+ * output going through pipes; this process passes the output on, stores
+ * it with the status and exits. Commands reading a pipe, a socket, the
+ * terminal or any device but /dev/null are not cached.
+ * Files the command writes are not part of the entry.
+ *
+ * Arguments :
+ *      argv - the arguments, starting with the prefix itself
+ *      envp - the environment of the command
+ *
+ * Returns :
+ *      the arguments of the command, to be executed by the caller
+ *      NULL - no command given (a message has been printed)
+ */
+char **memo_apply(char **argv, char **envp);
+
+#endif
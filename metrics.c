@@ -0,0 +1,327 @@
+/*
+ * Metrics.c
+ * The metrics live in one MAP_SHARED anonymous mapping created at start
+ * up and inherited by every child, so a forked pipeline stage can count
+ * its own execve() and the socket server reads the live values without
+ * any message passing. Updates are relaxed atomic additions: they are
+ * never read back by the writer, only summed up when scraped.
+ * Authors : Aloysious Kok & Gerald
+ * Last Update : 18/10/26
+ */
+
+#include <dirent.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "metrics.h"
+#include "common.h"
+
+/* A histogram; the buckets are not cumulative here */
+typedef struct Histogram_struct
+{
+    uint64_t buckets[METRICS_BUCKETS];
+    uint64_t count;
+    uint64_t sum_ns;
+} histogram;
+
+typedef struct Metrics_struct
+{
+    uint64_t counters[M_COUNTERS];
+    histogram histograms[H_HISTOGRAMS];
+    pid_t shell_pid;
+} metrics_page;
+
+static const struct
+{
+    const char *name;
+    const char *help;
+} counter_info[M_COUNTERS] = {
+    {"shell_commands_total", "Simple commands executed, pipeline stages included."},
+    {"shell_builtin_commands_total", "Commands run inside the shell."},
+    {"shell_external_commands_total", "Commands executed as a program."},
+    {"shell_children_reaped_total", "Background children reaped by the SIGCHLD handler."},
+    {"shell_glob_expansions_total", "Wildcard patterns expanded."},
+    {"shell_glob_entries_scanned_total", "Directory entries read while expanding wildcards."},
+};
+
+static const struct
+{
+    const char *name;
+    const char *help;
+} histogram_info[H_HISTOGRAMS] = {
+    {"shell_fork_exec_seconds", "Time from fork() to execve() of an external command."},
+    {"shell_glob_seconds", "Time spent expanding a wildcard pattern."},
+    {"shell_parse_seconds", "Time to parse a command line."},
+};
+
+// upper bounds of the buckets, in nanoseconds; the last one is +Inf
+static const uint64_t bucket_ns[METRICS_BUCKETS - 1] = {
+    10000, 100000, 1000000, 10000000, 100000000, 1000000000, 10000000000};
+static const char *bucket_le[METRICS_BUCKETS] = {"1e-05", "0.0001", "0.001", "0.01", "0.1", "1", "10", "+Inf"};
+
+static metrics_page private_page;
+static metrics_page *page = &private_page;
+
+static uint64_t fork_start = 0;
+static uint64_t glob_entries = 0;
+
+static pid_t server_pid = 0;
+
+void metrics_init()
+{
+    metrics_page *shared = mmap(NULL, sizeof(metrics_page), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    if (shared != MAP_FAILED)
+    {
+        page = shared;
+    }
+    page->shell_pid = getpid();
+}
+
+void metrics_count(int counter, uint64_t n)
+{
+    __atomic_fetch_add(&page->counters[counter], n, __ATOMIC_RELAXED);
+}
+
+uint64_t metrics_now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void metrics_observe(int index, uint64_t start)
+{
+    histogram *h = &page->histograms[index];
+    uint64_t ns = metrics_now() - start;
+    int b = 0;
+
+    while (b < METRICS_BUCKETS - 1 && ns > bucket_ns[b])
+        b++;
+    __atomic_fetch_add(&h->buckets[b], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->sum_ns, ns, __ATOMIC_RELAXED);
+}
+
+void metrics_fork_start()
+{
+    fork_start = metrics_now();
+}
+
+void metrics_exec_start()
+{
+    metrics_count(M_EXTERNAL, 1);
+    if (fork_start != 0)
+    {
+        metrics_observe(H_FORK_EXEC, fork_start);
+        fork_start = 0;
+    }
+}
+
+/* Directory functions for glob(): readdir() counts the entries */
+static void *glob_opendir(const char *name)
+{
+    return opendir(name);
+}
+
+static struct dirent *glob_readdir(void *dir)
+{
+    struct dirent *entry = readdir(dir);
+
+    if (entry != NULL)
+        glob_entries++;
+    return entry;
+}
+
+static void glob_closedir(void *dir)
+{
+    closedir(dir);
+}
+
+static int glob_stat(const char *path, struct stat *st)
+{
+    return stat(path, st);
+}
+
+static int glob_lstat(const char *path, struct stat *st)
+{
+    return lstat(path, st);
+}
+
+int metrics_glob(const char *pattern, int flags, glob_t *pglob)
+{
+    uint64_t start = metrics_now();
+
+    pglob->gl_opendir = glob_opendir;
+    pglob->gl_readdir = glob_readdir;
+    pglob->gl_closedir = glob_closedir;
+    pglob->gl_stat = glob_stat;
+    pglob->gl_lstat = glob_lstat;
+
+    glob_entries = 0;
+    int status = glob(pattern, flags | GLOB_ALTDIRFUNC, NULL, pglob);
+
+    metrics_observe(H_GLOB, start);
+    metrics_count(M_GLOBS, 1);
+    metrics_count(M_GLOB_ENTRIES, glob_entries);
+    return status;
+}
+
+/* Number of descriptors open in the shell */
+static int count_fds(pid_t pid)
+{
+    char path[64];
+    struct dirent *entry;
+    int n = 0;
+
+    snprintf(path, sizeof(path), "/proc/%d/fd", pid);
+    DIR *dir = opendir(path);
+    if (dir == NULL)
+    {
+        return -1;
+    }
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (entry->d_name[0] != '.')
+            n++;
+    }
+    closedir(dir);
+    // the descriptor of the directory itself when the shell reads it
+    return pid == getpid() ? n - 1 : n;
+}
+
+/* Writes every metric in the Prometheus text exposition format */
+static void metrics_write(FILE *fp)
+{
+    for (int i = 0; i < M_COUNTERS; i++)
+    {
+        fprintf(fp, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n", counter_info[i].name, counter_info[i].help,
+                counter_info[i].name, counter_info[i].name,
+                (unsigned long long)__atomic_load_n(&page->counters[i], __ATOMIC_RELAXED));
+    }
+
+    for (int i = 0; i < H_HISTOGRAMS; i++)
+    {
+        const char *name = histogram_info[i].name;
+        histogram *h = &page->histograms[i];
+        uint64_t cumulative = 0;
+
+        fprintf(fp, "# HELP %s %s\n# TYPE %s histogram\n", name, histogram_info[i].help, name);
+        for (int b = 0; b < METRICS_BUCKETS; b++)
+        {
+            cumulative += __atomic_load_n(&h->buckets[b], __ATOMIC_RELAXED);
+            fprintf(fp, "%s_bucket{le=\"%s\"} %llu\n", name, bucket_le[b], (unsigned long long)cumulative);
+        }
+        fprintf(fp, "%s_sum %.9f\n%s_count %llu\n", name,
+                __atomic_load_n(&h->sum_ns, __ATOMIC_RELAXED) / 1e9, name, (unsigned long long)cumulative);
+    }
+
+    int fds = count_fds(page->shell_pid);
+    if (fds >= 0)
+    {
+        fprintf(fp, "# HELP shell_open_fds Descriptors open in the shell.\n# TYPE shell_open_fds gauge\n");
+        fprintf(fp, "shell_open_fds %d\n", fds);
+    }
+}
+
+/* The socket server: answers every connection with the metrics */
+static void metrics_serve(int sock)
+{
+    char request[1024];
+
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+    signal(SIGCHLD, SIG_DFL);
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGTERM, SIG_DFL);
+
+    while (1)
+    {
+        int conn = accept4(sock, NULL, NULL, SOCK_CLOEXEC);
+        if (conn == -1)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            _exit(1);
+        }
+
+        // a scraper speaks HTTP; a plain reader sends nothing at all
+        struct pollfd pfd = {conn, POLLIN, 0};
+        ssize_t n = 0;
+        if (poll(&pfd, 1, 100) == 1)
+            n = read(conn, request, sizeof(request) - 1);
+
+        FILE *fp = fdopen(conn, "w");
+        if (fp == NULL)
+        {
+            close(conn);
+            continue;
+        }
+        if (n >= 4 && strncmp(request, "GET ", 4) == 0)
+        {
+            fprintf(fp, "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                        "Connection: close\r\n\r\n");
+        }
+        metrics_write(fp);
+        fclose(fp);
+    }
+}
+
+static void metrics_stop()
+{
+    if (server_pid > 0)
+    {
+        kill(server_pid, SIGTERM);
+        waitpid(server_pid, NULL, 0);
+        server_pid = 0;
+    }
+}
+
+static int metrics_listen(const char *path)
+{
+    metrics_stop();
+    int sock = unix_listen(path, SOCK_STREAM, METRICS_BACKLOG);
+    if (sock == -1)
+    {
+        return -1;
+    }
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        metrics_serve(sock);
+    }
+    close(sock);
+    if (pid < 0)
+    {
+        perror("fork");
+        return -1;
+    }
+    server_pid = pid;
+    return 0;
+}
+
+int builtin_stats(command *cmd)
+{
+    if (cmd->argv[1] == NULL)
+    {
+        metrics_write(stdout);
+        return 0;
+    }
+    if (strcmp(cmd->argv[1], "-l") == 0 && cmd->argv[2] != NULL && cmd->argv[3] == NULL)
+    {
+        return metrics_listen(cmd->argv[2]);
+    }
+    if (strcmp(cmd->argv[1], "-u") == 0 && cmd->argv[2] == NULL)
+    {
+        metrics_stop();
+        return 0;
+    }
+    fprintf(stderr, "usage: stats [-l socket | -u]\n");
+    return -1;
+}
@@ -0,0 +1,119 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+/*
+ * Metrics.h
+ * Runtime counters and latency histograms of the shell, shown by the
+ * stats builtin and optionally served over a Unix domain socket in the
+ * Prometheus text format
+ * Authors : Aloysious Kok & Gerald
+ * Last Update : 18/10/26
+ */
+
+#include <stdint.h>
+#include "shell.h"
+
+/* Counters */
+enum metric_counter
+{
+    M_COMMANDS,     // simple commands executed, pipeline stages included
+    M_BUILTINS,     // of which run inside the shell (builtins, utilities)
+    M_EXTERNAL,     // of which executed as a program
+    M_REAPED,       // background children reaped by claim_zombies()
+    M_GLOBS,        // glob() calls for wildcard arguments
+    M_GLOB_ENTRIES, // directory entries read by those calls
+    M_COUNTERS
+};
+
+/* Histograms */
+enum metric_histogram
+{
+    H_FORK_EXEC, // from fork() to execve() of an external command
+    H_GLOB,      // time spent in glob()
+    H_PARSE,     // time to parse a command line
+    H_HISTOGRAMS
+};
+
+/* Number of histogram buckets: 10us, 100us, ... 10s and +Inf */
+#define METRICS_BUCKETS 8
+
+/* Pending connections of the metrics socket */
+#define METRICS_BACKLOG 16
+
+/* void metrics_init()
+ *
+ * This function allocates the metrics in a shared anonymous mapping, so
+ * that children of the shell (pipeline stages, background commands)
+ * update the same counters as the shell, and so does the socket server.
+ * Before it is called, metrics are recorded in private memory.
+ *
+ * Returns :
+ *      None
+ */
+void metrics_init();
+
+/* void metrics_count(int counter, uint64_t n)
+ *
+ * Adds n to a counter.
+ */
+void metrics_count(int counter, uint64_t n);
+
+/* uint64_t metrics_now()
+ *
+ * Returns the monotonic clock in nanoseconds, the start of a duration
+ * given to metrics_observe().
+ */
+uint64_t metrics_now();
+
+/* void metrics_observe(int histogram, uint64_t start)
+ *
+ * Records the time elapsed since start in a histogram.
+ */
+void metrics_observe(int histogram, uint64_t start);
+
+/* void metrics_fork_start()
+ *
+ * Marks the start of a fork(); the child inherits the mark, and
+ * metrics_exec_start() records the time elapsed since.
+ */
+void metrics_fork_start();
+
+/* void metrics_exec_start()
+ *
+ * Called in the child just before execve(): counts an external command
+ * and records its fork to exec latency.
+ */
+void metrics_exec_start();
+
+/* int metrics_glob(const char *pattern, int flags, glob_t *pglob)
+ *
+ * This function is glob() with its duration and the number of directory
+ * entries it reads recorded.
+ *
+ * Arguments :
+ *      pattern, flags, pglob - as for glob(); the GLOB_ALTDIRFUNC
+ *      functions of pglob are set by this function
+ *
+ * Returns :
+ *      the return value of glob()
+ */
+int metrics_glob(const char *pattern, int flags, glob_t *pglob);
+
+/* int builtin_stats(command *cmd)
+ *
+ * stats [-l socket | -u]
+ * Prints the metrics in the Prometheus text format. -l starts serving
+ * them on a Unix domain socket, replacing the server already running;
+ * -u stops the server. Both plain reads and HTTP GET requests are
+ * answered.
+ *
+ * Arguments :
+ *      cmd - the command struct to be processed
+ *
+ * Returns :
+ *      0 - successful
+ *     -1 - bad arguments or the socket cannot be set up
+ */
+int builtin_stats(command *cmd);
+
+#endif
@@ -0,0 +1,363 @@
+/*
+ * Par.c
+ * A batch is built one statement at a time: a statement is expanded, its
+ * files are gathered and compared with those of the statements already
+ * in the batch, and the first one that conflicts is left expanded for
+ * execute_stack() to run after the batch. Expanding a statement early is
+ * only safe when its expansion does not depend on the statements before
+ * it, so one using $?, $!, command or process substitution ends the
+ * batch unexpanded. The output of a statement that is not first is kept
+ * in a memfd rather than a pipe, so it never blocks however much it
+ * writes before its turn comes.
+ * Authors : Aloysious Kok & Gerald
+ * Last Update : 18/10/26
+ */
+
+#include <fnmatch.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "par.h"
+#include "vars.h"
+#include "term.h"
+#include "rc.h"
+#include "common.h"
+
+// a statement of a batch and the files it touches
+typedef struct Par_statement_struct
+{
+    int first, last;
+    char *reads[PAR_MAX_PATHS];
+    char *writes[PAR_MAX_PATHS];
+    int n_reads, n_writes;
+    int reads_stdin; // the first command takes the input of the shell
+    int out, err; // where the output is kept, -1 if it is not
+    pid_t pid;
+} par_statement;
+
+/* Whether a parsed word can expand differently once earlier statements ran */
+static int order_sensitive(const char *word)
+{
+    return word != NULL && (strchr(word, '`') != NULL || strstr(word, "$(") != NULL || strstr(word, "$?") != NULL ||
+                            strstr(word, "${?") != NULL || strstr(word, "$!") != NULL || strstr(word, "${!") != NULL ||
+                            strstr(word, "<(") != NULL || strstr(word, ">(") != NULL);
+}
+
+static int command_order_sensitive(command *cmd)
+{
+    for (int i = 0; cmd->argv[i] != NULL; i++)
+    {
+        if (order_sensitive(cmd->argv[i]))
+            return 1;
+    }
+    for (int i = 0; cmd->redirect_tee != NULL && cmd->redirect_tee[i] != NULL; i++)
+    {
+        if (order_sensitive(cmd->redirect_tee[i]))
+            return 1;
+    }
+    return order_sensitive(cmd->redirect_in) || order_sensitive(cmd->redirect_out);
+}
+
+/* Adds a path, made absolute, to a set; returns -1 if the set is full */
+static int add_path(char **set, int *n, const char *path)
+{
+    char cwd[MAX_BUF_SIZE];
+    char *full;
+    size_t len;
+
+    if (*n == PAR_MAX_PATHS)
+    {
+        return -1;
+    }
+    while (path[0] == '.' && path[1] == '/')
+    {
+        path += 2;
+    }
+    if (path[0] == '/' || getcwd(cwd, sizeof(cwd)) == NULL)
+    {
+        full = strdup(path);
+    }
+    else
+    {
+        full = malloc(strlen(cwd) + strlen(path) + 2);
+        sprintf(full, "%s/%s", cwd, path);
+    }
+    len = strlen(full);
+    while (len > 1 && full[len - 1] == '/')
+    {
+        full[--len] = '\0';
+    }
+    set[(*n)++] = full;
+    return 0;
+}
+
+/* Gathers the files of the stages of a statement; returns -1 if there are too many */
+static int gather_paths(command **cmd_stack, par_statement *st)
+{
+    for (int i = st->first; i <= st->last; i++)
+    {
+        command *cmd = cmd_stack[i];
+        if (cmd->redirect_in != NULL && add_path(st->reads, &st->n_reads, cmd->redirect_in) < 0)
+            return -1;
+        if (cmd->redirect_out != NULL && add_path(st->writes, &st->n_writes, cmd->redirect_out) < 0)
+            return -1;
+        for (int j = 0; cmd->redirect_tee != NULL && cmd->redirect_tee[j] != NULL; j++)
+        {
+            if (add_path(st->writes, &st->n_writes, cmd->redirect_tee[j]) < 0)
+                return -1;
+        }
+        for (int j = 1; cmd->argv[j] != NULL; j++)
+        {
+            // the value of an option such as --output=file
+            const char *word = cmd->argv[j];
+            if (word[0] == '-')
+            {
+                const char *eq = strchr(word, '=');
+                if (eq == NULL)
+                    continue;
+                word = eq + 1;
+            }
+            // any word may name a file, even one an earlier statement creates
+            if (word[0] != '\0' && add_path(st->writes, &st->n_writes, word) < 0)
+                return -1;
+        }
+    }
+    return 0;
+}
+
+/* Whether two paths may name the same file, or files that go together */
+static int paths_overlap(const char *a, const char *b)
+{
+    size_t la = strlen(a), lb = strlen(b);
+
+    if (la <= lb && strncmp(a, b, la) == 0 && (b[la] == '\0' || b[la] == '/' || b[la] == '.'))
+    {
+        return 1;
+    }
+    if (lb < la && strncmp(a, b, lb) == 0 && (a[lb] == '/' || a[lb] == '.'))
+    {
+        return 1;
+    }
+    return (strpbrk(a, "*?[") != NULL && fnmatch(a, b, 0) == 0) ||
+           (strpbrk(b, "*?[") != NULL && fnmatch(b, a, 0) == 0);
+}
+
+static int sets_overlap(char **a, int n_a, char **b, int n_b)
+{
+    for (int i = 0; i < n_a; i++)
+    {
+        for (int j = 0; j < n_b; j++)
+        {
+            if (paths_overlap(a[i], b[j]))
+                return 1;
+        }
+    }
+    return 0;
+}
+
+static int statements_conflict(const par_statement *s, const par_statement *t)
+{
+    return (s->reads_stdin && t->reads_stdin) || sets_overlap((char **)s->writes, s->n_writes, (char **)t->writes, t->n_writes) ||
+           sets_overlap((char **)s->writes, s->n_writes, (char **)t->reads, t->n_reads) ||
+           sets_overlap((char **)s->reads, s->n_reads, (char **)t->writes, t->n_writes);
+}
+
+static void free_paths(par_statement *st)
+{
+    for (int i = 0; i < st->n_reads; i++)
+    {
+        free(st->reads[i]);
+    }
+    for (int i = 0; i < st->n_writes; i++)
+    {
+        free(st->writes[i]);
+    }
+    st->n_reads = st->n_writes = 0;
+}
+
+/* Whether a statement may run in a batch, judged on its parsed words */
+static int statement_eligible(command **cmd_stack, int first, int last)
+{
+    for (int i = first; i <= last; i++)
+    {
+        command *cmd = cmd_stack[i];
+        int word = 0;
+        while (cmd->argv != NULL && cmd->argv[word] != NULL && !cmd->expanded && var_is_assignment(cmd->argv[word]))
+        {
+            word++;
+        }
+        if (cmd->background == 1 || cmd->argv == NULL || cmd->argv[word] == NULL || is_builtin(cmd->argv[word]) ||
+            rc_is_function(cmd->argv[word]))
+            return 0;
+    }
+    return 1;
+}
+
+/* Writes what a statement kept to where its output would have gone */
+static void replay(int from, int to)
+{
+    char buf[BUFSIZ];
+    ssize_t n;
+
+    lseek(from, 0, SEEK_SET);
+    while ((n = read(from, buf, sizeof(buf))) > 0)
+    {
+        for (ssize_t done = 0, w; done < n; done += w)
+        {
+            if ((w = write(to, buf + done, n - done)) < 0)
+                return;
+        }
+    }
+}
+
+/* Starts a statement in a child shell, with its output kept unless it comes first */
+static pid_t start_statement(command **cmd_stack, par_statement *st, int first_of_batch, int shared_output)
+{
+    st->out = st->err = -1;
+    if (!first_of_batch)
+    {
+        st->out = memfd_create("autopar", MFD_CLOEXEC);
+        st->err = shared_output ? st->out : memfd_create("autopar", MFD_CLOEXEC);
+        if (st->out == -1 || st->err == -1)
+        {
+            perror("memfd_create");
+            return -1;
+        }
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        int n = st->last - st->first + 1;
+        command **sub = malloc((n + 1) * sizeof(command *));
+
+        if (!first_of_batch)
+        {
+            dup2(st->out, STDOUT_FILENO);
+            dup2(st->err, STDERR_FILENO);
+        }
+        memcpy(sub, &cmd_stack[st->first], n * sizeof(command *));
+        sub[n] = NULL;
+        execute_stack(sub);
+        fflush(stdout);
+        exit(last_status);
+    }
+    if (pid == -1)
+    {
+        perror("fork");
+    }
+    return pid;
+}
+
+int par_execute(command **cmd_stack, int first)
+{
+    par_statement batch[PAR_MAX_STATEMENTS];
+    int n = 0;
+    int idx = first;
+
+    // reading /dev/null together is harmless and statements typed at the
+    // terminal seldom read it; any other input is shared
+    int shared_stdin = !isatty(STDIN_FILENO) && !stdin_is_null();
+
+    while (cmd_stack[idx] != NULL && n < PAR_MAX_STATEMENTS)
+    {
+        par_statement *st = &batch[n];
+        int last = idx;
+        int fail = 0;
+
+        while (cmd_stack[last]->pipe_to > 0 && cmd_stack[last + 1] != NULL)
+        {
+            last++;
+        }
+        if (!statement_eligible(cmd_stack, idx, last))
+            break;
+        for (int i = idx; i <= last && n > 0; i++)
+        {
+            if (!cmd_stack[i]->expanded && command_order_sensitive(cmd_stack[i]))
+                fail = 1;
+        }
+        for (int i = idx; i <= last && !fail; i++)
+        {
+            fail = expand_command(cmd_stack[i]) < 0;
+        }
+        // expanded, the statement may still turn out to be a builtin
+        if (fail || !statement_eligible(cmd_stack, idx, last))
+            break;
+
+        st->first = idx;
+        st->last = last;
+        st->n_reads = st->n_writes = 0;
+        st->out = st->err = -1;
+        st->reads_stdin = shared_stdin && cmd_stack[idx]->redirect_in == NULL;
+        fail = gather_paths(cmd_stack, st) < 0;
+        for (int j = 0; j < n && !fail; j++)
+        {
+            fail = statements_conflict(&batch[j], st);
+        }
+        if (fail)
+        {
+            free_paths(st);
+            break;
+        }
+        n++;
+        idx = last + 1;
+    }
+
+    if (n < 2)
+    {
+        // the first statement stays expanded for execute_stack()
+        for (int j = 0; j < n; j++)
+        {
+            free_paths(&batch[j]);
+        }
+        return 0;
+    }
+
+    // stdout and stderr that go to the same place are kept together, interleaved
+    struct stat out_st, err_st;
+    int shared_output = fstat(STDOUT_FILENO, &out_st) == 0 && fstat(STDERR_FILENO, &err_st) == 0 &&
+                        out_st.st_dev == err_st.st_dev && out_st.st_ino == err_st.st_ino;
+
+    term_cooked();
+    int started = 0;
+    for (; started < n; started++)
+    {
+        if ((batch[started].pid = start_statement(cmd_stack, &batch[started], started == 0, shared_output)) == -1)
+            break;
+    }
+
+    // the batch is the barrier: all of it is waited for, in order
+    for (int j = 0; j < started; j++)
+    {
+        int wstatus;
+        while (waitpid(batch[j].pid, &wstatus, 0) == -1 && errno == EINTR)
+            ;
+        last_status = WIFEXITED(wstatus) ? WEXITSTATUS(wstatus) : 128 + WTERMSIG(wstatus);
+        if (batch[j].out != -1)
+        {
+            replay(batch[j].out, STDOUT_FILENO);
+            if (batch[j].err != batch[j].out)
+                replay(batch[j].err, STDERR_FILENO);
+        }
+    }
+    for (int j = 0; j < n; j++)
+    {
+        if (batch[j].err != -1 && batch[j].err != batch[j].out)
+            close(batch[j].err);
+        if (batch[j].out != -1)
+            close(batch[j].out);
+        free_paths(&batch[j]);
+        if (j < started)
+        {
+            for (int i = batch[j].first; i <= batch[j].last; i++)
+                unexpand_command(cmd_stack[i]);
+        }
+    }
+    if (started == n)
+    {
+        return idx;
+    }
+    // what could not be started runs as usual, after the rest
+    return started > 0 ? batch[started].first : 0;
+}
@@ -0,0 +1,52 @@
+#ifndef PAR_H
+#define PAR_H
+
+/*
+ * Par.h
+ * Concurrent execution of independent statements of a command line (set
+ * -o autopar): statements that name no file in common run at the same
+ * time, and their output is still written in statement order
+ * Authors : Aloysious Kok & Gerald
+ * Last Update : 18/10/26
+ */
+
+#include "shell.h"
+
+/* Most statements run at once; the ones after that form the next batch */
+#define PAR_MAX_STATEMENTS 64
+
+/* Most files a statement is checked for */
+#define PAR_MAX_PATHS 64
+
+/* int par_execute(command **cmd_stack, int first)
+ *
+ * This function is called by execute_stack() with set -o autopar before
+ * the statement at first runs. It gathers the statements from there on,
+ * a single command or a pipeline ended by ';' or the end of the line,
+ * as long as none is a builtin, an assignment or a background job, and
+ * none touches a file an earlier one of the batch writes or reads. The
+ * redirections are read and written as they say; every argument but an
+ * option is taken as a file written, whether it exists yet or not, and
+ * conflicts with the same path, with paths below or beside it (a and
+ * a.gz) and with a pattern matching it. A conflicting statement starts
+ * the next batch, so it waits for everything before it. Each statement
+ * of the batch runs in a child shell; the output of all but the first
+ * is kept in a memory file and written out, in order, once every
+ * statement before it has finished. The input of the shell counts as a
+ * file read by every statement that does not redirect its own, so only
+ * one of them joins a batch, unless that input is /dev/null or the
+ * terminal, which statements of a batch read together. Commands are
+ * assumed to touch only the files they name.
+ *
+ * Arguments :
+ *      cmd_stack - the commands of the line
+ *      first - the statement to start from
+ *
+ * Returns :
+ *      the index of the statement after the batch; last_status is that
+ *      of the last statement of the batch
+ *      0 - fewer than two statements could run at once, nothing was run
+ */
+int par_execute(command **cmd_stack, int first);
+
+#endif
@@ -10,6 +10,188 @@
 
 // #define DEBUG
 
+/*
+ * This function returns a pointer just past the $(...) or `...` command
+ * substitution, or the <(...) or >(...) process substitution, that
+ * starts at p. Quotes and nested substitutions inside it are skipped over.
+ *
+ * Arguments :
+ *      p - points at the '$', '<' or '>' before the '(', or at the
+ *          opening '`'.
+ *
+ * Returns :
+ *      A pointer after the closing ')' or '`', or to the terminating
+ *      '\0' if the substitution is not closed.
+ *
+ */
+char *skip_substitution(const char *p)
+{
+   int depth = 0;
+
+   if (*p == '`')
+   {
+      for (p++; *p && *p != '`'; p++)
+      {
+         if (*p == '\\' && p[1])
+            p++;
+      }
+      return (char *)(*p ? p + 1 : p);
+   }
+
+   for (p++; *p; p++)
+   {
+      if (*p == '(')
+      {
+         depth++;
+      }
+      else if (*p == ')')
+      {
+         if (--depth == 0)
+            return (char *)(p + 1);
+      }
+      else if (*p == '\\' && p[1])
+      {
+         p++;
+      }
+      else if (*p == '\'' || *p == '"')
+      {
+         char quote = *p;
+         for (p++; *p && *p != quote; p++)
+         {
+            if (*p == '\\' && quote == '"' && p[1])
+               p++;
+         }
+         if (!*p)
+            break;
+      }
+      else if (*p == '`' || (*p == '$' && p[1] == '(') || IS_PROC_SUBST(p))
+      {
+         p = skip_substitution(p) - 1;
+      }
+   }
+   return (char *)p;
+}
+
+/*
+ * This function finds the first character of cmd that is one of the
+ * characters in set and is not quoted, escaped or inside a command
+ * substitution.
+ *
+ * Arguments :
+ *      cmd - the string to be searched.
+ *      set - the characters to search for.
+ *
+ * Returns :
+ *      A pointer to the character found, or NULL.
+ *
+ */
+char *find_unquoted(const char *cmd, const char *set)
+{
+   char quote = 0;
+   const char *p = cmd;
+
+   while (*p)
+   {
+      if (quote == 0 && IS_PROC_SUBST(p))
+      {
+         // the '<' or '>' of "<(" is not a redirection
+         p = skip_substitution(p);
+         continue;
+      }
+      if (quote == 0 && strchr(set, *p))
+      {
+         return (char *)p;
+      }
+      if (*p == '\\' && quote != '\'' && p[1])
+      {
+         p += 2;
+      }
+      else if (quote == 0 && (*p == '\'' || *p == '"'))
+      {
+         quote = *p++;
+      }
+      else if (quote != 0 && *p == quote)
+      {
+         quote = 0;
+         p++;
+      }
+      else if (quote != '\'' && (*p == '`' || (*p == '$' && p[1] == '(')))
+      {
+         p = skip_substitution(p);
+      }
+      else
+      {
+         p++;
+      }
+   }
+   return NULL;
+}
+
+/*
+ * Isolates the redirection target that follows a '<' or '>'. Like
+ * strtok() it skips leading white space and ends the word at the next
+ * white space, but a quoted or substituted target such as <(cmd args)
+ * is kept whole. Returns NULL if there is no target.
+ */
+static char *redirect_word(char *p)
+{
+   while (*p == ' ' || *p == '\t')
+      p++;
+   if (*p == '\0')
+      return NULL;
+
+   char *end = find_unquoted(p, white_space);
+   if (end)
+      *end = '\0';
+   return p;
+}
+
+/*
+ * Splits off the output targets after the first one, as in cmd > a > b:
+ * every further '>' ends the text of the target before it. Returns the
+ * further targets in a NULL terminated array, NULL if there are none,
+ * and sets *error if one of them is missing.
+ */
+static char **redirect_more(char *out, int *error)
+{
+   char *parts[MAX_TEE_TARGETS];
+   int n = 0;
+   char *next;
+
+   *error = 0;
+   while ((next = find_unquoted(out, ">")) != NULL && n < MAX_TEE_TARGETS)
+   {
+      *next = '\0';
+      out = parts[n++] = next + 1;
+   }
+   if (n == 0)
+   {
+      return NULL;
+   }
+
+   char **targets = calloc(n + 1, sizeof(char *));
+   for (int i = 0; i < n; i++)
+   {
+      char *word = redirect_word(parts[i]);
+      if (word == NULL)
+      {
+         *error = 1;
+         break;
+      }
+      targets[i] = strdup(word);
+   }
+   return targets;
+}
+
+static void free_targets(char **targets)
+{
+   for (int i = 0; targets != NULL && targets[i] != NULL; i++)
+   {
+      free(targets[i]);
+   }
+   free(targets);
+}
+
 /*
  * This function breakes the simple command token isolated in other functions
  * into a sequence of arguments. Each argument is bounded by white-spaces, and
@@ -42,20 +224,30 @@ void process_simple_cmd(char *cmd, command *result)
 
       if (*cmd == '\0') break;
 
-      char *end;
-      int is_quoted = 0;
-      if (*cmd == '"' || *cmd == '\'') {
-         char quote = *cmd++;
-         end = strchr(cmd, quote);
-         if (!end) {
-            fprintf(stderr, "Unmatched quote\n");
-            clean_up_single(result);
-            return;
+      // A word ends at unquoted white space. The quotes stay in the word
+      // and are removed when it is expanded (see expand_word()).
+      char *end = cmd;
+      char quote = 0;
+      while (*end && (quote || !isspace((unsigned char)*end))) {
+         if ((quote != '\'' && (*end == '`' || (*end == '$' && end[1] == '('))) ||
+             (quote == 0 && IS_PROC_SUBST(end))) {
+            end = skip_substitution(end);
+            continue;
+         } else if (*end == '\\' && quote != '\'' && end[1]) {
+            end++;
+         } else if (quote == 0 && (*end == '"' || *end == '\'')) {
+            quote = *end;
+         } else if (*end == quote) {
+            quote = 0;
          }
-         is_quoted = 1;
-      } else {
-         end = cmd;
-         while (*end && !isspace((unsigned char)*end)) end++;
+         end++;
+      }
+      if (quote) {
+         fprintf(stderr, "Unmatched quote\n");
+         for (int i = 0; i < arg_count; i++) free(result->argv[i]);
+         free(result->argv);
+         result->argv = NULL;
+         break;
       }
 
       char *token = strndup(cmd, end - cmd);
@@ -78,12 +270,13 @@ void process_simple_cmd(char *cmd, command *result)
       arg_count++;
       arg_size++;
 
-      if (is_quoted) end++;
-      cmd = (*end) ? end + 1 : end;
+      cmd = end;
    }
 
-   result->argv[arg_count] = NULL; // Ensure the last element of argv is NULL
-   if (arg_count == 0) {
+   if (result->argv != NULL) {
+      result->argv[arg_count] = NULL; // Ensure the last element of argv is NULL
+   }
+   if (result->argv == NULL || arg_count == 0) {
       result->argv = calloc(1, sizeof(char *));
       if (!result->argv) {
          fprintf(stderr, "Memory allocation failed in process_simple_cmd\n");
@@ -117,13 +310,32 @@ void process_cmd(char *cmd, command *result)
    char *simple_cmd = NULL;
    char *input_part = NULL;
    char *output_part = NULL;
+   char **more_targets = NULL;
+   int error = 0;
 
    // Initialize result structure
    *result = (command){0};
 
    // Check for redirections
-   input_redirect_ptr = strchr(cmd, '<');
-   output_redirect_ptr = strchr(cmd, '>');
+   input_redirect_ptr = find_unquoted(cmd, "<");
+   output_redirect_ptr = find_unquoted(cmd, ">");
+   if (input_redirect_ptr && output_redirect_ptr)
+   {
+      // the targets of '>' end where the text of '<' begins
+      *input_redirect_ptr = '\0';
+      more_targets = redirect_more(output_redirect_ptr + 1, &error);
+      *input_redirect_ptr = '<';
+   }
+   else if (output_redirect_ptr)
+   {
+      more_targets = redirect_more(output_redirect_ptr + 1, &error);
+   }
+   if (error)
+   {
+      fprintf(stderr, "Syntax error in output redirection path\n");
+      free_targets(more_targets);
+      return;
+   }
 
    if (input_redirect_ptr && output_redirect_ptr)
    {
@@ -134,8 +346,8 @@ void process_cmd(char *cmd, command *result)
       output_redirect_ptr++;
 
       // Trim leading white spaces
-      input_redirect_ptr = strtok(input_redirect_ptr, white_space);
-      output_redirect_ptr = strtok(output_redirect_ptr, white_space);
+      input_redirect_ptr = redirect_word(input_redirect_ptr);
+      output_redirect_ptr = redirect_word(output_redirect_ptr);
 
       // Additional error handling for strtok returns
       if (!input_redirect_ptr || !output_redirect_ptr)
@@ -173,7 +385,7 @@ void process_cmd(char *cmd, command *result)
       input_redirect_ptr++;       // Move past the '<' character
 
       // Trim leading white spaces
-      input_redirect_ptr = strtok(input_redirect_ptr, white_space);
+      input_redirect_ptr = redirect_word(input_redirect_ptr);
       if (!input_redirect_ptr)
       {
          fprintf(stderr, "Syntax error in input redirection path\n");
@@ -202,7 +414,7 @@ void process_cmd(char *cmd, command *result)
       output_redirect_ptr++;       // Move past the '>' character
 
       // Trim leading white spaces
-      output_redirect_ptr = strtok(output_redirect_ptr, white_space);
+      output_redirect_ptr = redirect_word(output_redirect_ptr);
       if (!output_redirect_ptr)
       {
          fprintf(stderr, "Syntax error in output redirection path\n");
@@ -230,6 +442,8 @@ void process_cmd(char *cmd, command *result)
       process_simple_cmd(cmd, result);
    }
 
+   result->redirect_tee = more_targets;
+
    // Free the temporary simple_cmd buffer if it was used
    if (simple_cmd)
    {
@@ -319,9 +533,15 @@ command **process_cmd_line(char *cmd, int new)
    }
    else
    {
-      char *next_cmd;
-      char *current_cmd = strtok(cmd, &sep);
-      next_cmd = strtok(NULL, "");
+      // Split at the separator, ignoring quoted or substituted ones
+      char *current_cmd = cmd;
+      char *next_cmd = find_unquoted(cmd, ";&|");
+      *next_cmd++ = '\0';
+      next_cmd += strspn(next_cmd, " \t");
+      if (*next_cmd == '\0')
+      {
+         next_cmd = NULL;
+      }
 
       if (current_cmd)
       {
@@ -401,6 +621,7 @@ void clean_up_single(command *cmd)
    {
       free(cmd->redirect_out); // Free redirect_out
    }
+   free_targets(cmd->redirect_tee);
    free(cmd);
 }
 
@@ -582,17 +803,12 @@ int check_cmd_input(char *cmd)
  */
 char lead_separator(const char *cmd)
 {
-   char separators[] = {';', '&', '|', '\0'}; // Include the null terminator to end the array
+   // Separators inside quotes or command substitutions do not count
+   char *sep = find_unquoted(cmd, ";&|");
 
-   for (int i = 0; cmd[i] != '\0'; ++i)
+   if (sep != NULL)
    {
-      for (int j = 0; separators[j] != '\0'; ++j)
-      {
-         if (cmd[i] == separators[j])
-         {
-            return cmd[i]; // Return the first encountered separator
-         }
-      }
+      return *sep; // Return the first encountered separator
    }
 
    return '0';
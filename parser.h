@@ -11,16 +11,23 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 
 /*The length of the command line.*/
 #define CMD_LENGTH 100000
 #define MIN_LENGTH 2
 
+/*The most output targets of one command after the first.*/
+#define MAX_TEE_TARGETS 64
+
 /*Whitespaces that are searched for*/
 // nick modified this
 // static const char white_space[2] = { (char) 0x20, (char) 0x09 };
 static const char white_space[3] = {(char)0x20, (char)0x09, (char)0x00};
 
+/*True if p starts a process substitution <(...) or >(...)*/
+#define IS_PROC_SUBST(p) (((p)[0] == '<' || (p)[0] == '>') && (p)[1] == '(')
+
 /*The Structure we create for the commands.*/
 typedef struct Command_struct
 {
@@ -30,7 +37,18 @@ typedef struct Command_struct
    int sequential;
    char *redirect_in;
    char *redirect_out;
+   /* Further output targets, as in cmd > a > b; NULL terminated */
+   char **redirect_tee;
    int pipe_to;
+   /* Parsed words kept while argv holds their expansion (see vars.h) */
+   char **raw_argv;
+   char *raw_redirect_in;
+   char *raw_redirect_out;
+   char **raw_redirect_tee;
+   char **assigns;
+   int expanded;
+   /* Pipe ends of <(...) and >(...) kept open while the command runs */
+   int *subst_fds;
 } command;
 
 /* Function prototypes added by Nick Nelissen 11/9/2001 */
@@ -42,6 +60,8 @@ void free_cmd_line(command **cmd_line);
 void clean_up_single(command *cmd);
 void clean_up(command **cmd);
 char lead_separator(const char *cmd);
+char *skip_substitution(const char *p);
+char *find_unquoted(const char *cmd, const char *set);
 int check_cmd_input(char *cmd);
 
 #endif
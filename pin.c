@@ -0,0 +1,272 @@
+/*
+ * Pin.c
+ * Placement of launched commands on CPUs and NUMA nodes. The settings
+ * are applied in the forked child, just before the command is executed,
+ * with sched_setaffinity() and set_mempolicy(); both are inherited
+ * across execve().
+ * Authors : Aloysious Kok & Gerald
+ * Last Update : 18/10/26
+ */
+
+#include <sched.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include "pin.h"
+#include "vars.h"
+
+#define BITS_PER_WORD (8 * sizeof(unsigned long))
+#define MASK_WORDS(n) (((n) + BITS_PER_WORD - 1) / BITS_PER_WORD)
+#define MASK_SET(mask, i) ((mask)[(i) / BITS_PER_WORD] |= 1UL << ((i) % BITS_PER_WORD))
+#define MASK_ISSET(mask, i) (((mask)[(i) / BITS_PER_WORD] >> ((i) % BITS_PER_WORD)) & 1)
+
+// next round-robin slot handed out by pin_next_slot()
+static int next_slot = 0;
+
+int pin_is_prefix(const char *name)
+{
+    return name != NULL && (strcmp(name, "pin") == 0 || strcmp(name, "affinity") == 0);
+}
+
+/*
+ * Adds the numbers of a list such as 0-7,16,18-19 to a bit mask of max
+ * bits. Returns -1 if the list is malformed or a number is too large.
+ */
+static int parse_list(const char *list, unsigned long *mask, int max)
+{
+    const char *p = list;
+    char *end;
+
+    while (*p != '\0')
+    {
+        long lo = strtol(p, &end, 10);
+        long hi = lo;
+        if (end == p || lo < 0)
+            return -1;
+        if (*end == '-')
+        {
+            p = end + 1;
+            hi = strtol(p, &end, 10);
+            if (end == p || hi < lo)
+                return -1;
+        }
+        if (hi >= max)
+            return -1;
+
+        for (long i = lo; i <= hi; i++)
+            MASK_SET(mask, i);
+
+        if (*end == ',')
+            end++;
+        else if (*end != '\0')
+            return -1;
+        p = end;
+    }
+    return 0;
+}
+
+/* Reads a list from a sysfs file (such as a node's cpulist) into mask */
+static int read_list(const char *path, unsigned long *mask, int max)
+{
+    char buf[MAX_BUF_SIZE];
+    FILE *fp = fopen(path, "r");
+
+    if (fp == NULL)
+    {
+        return -1;
+    }
+    if (fgets(buf, sizeof(buf), fp) == NULL)
+    {
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+    buf[strcspn(buf, "\n")] = '\0';
+    return parse_list(buf, mask, max);
+}
+
+/* Adds the CPUs of every node of nodes to cpus */
+static int node_cpus(const unsigned long *nodes, unsigned long *cpus)
+{
+    char path[MAX_BUF_SIZE];
+
+    for (int node = 0; node < PIN_MAX_NODES; node++)
+    {
+        if (!MASK_ISSET(nodes, node))
+            continue;
+
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        if (read_list(path, cpus, CPU_SETSIZE) < 0)
+        {
+            fprintf(stderr, "pin: no such NUMA node: %d\n", node);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int set_cpus(const unsigned long *cpus)
+{
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+        if (MASK_ISSET(cpus, cpu))
+            CPU_SET(cpu, &set);
+    }
+    return sched_setaffinity(0, sizeof(set), &set);
+}
+
+static int set_memory(int mode, const unsigned long *nodes)
+{
+    // the kernel reads maxnode - 1 bits of the mask
+    return syscall(SYS_set_mempolicy, mode, nodes, PIN_MAX_NODES + 1);
+}
+
+char **pin_apply(char **argv)
+{
+    unsigned long cpus[MASK_WORDS(CPU_SETSIZE)] = {0};
+    unsigned long cpu_nodes[MASK_WORDS(PIN_MAX_NODES)] = {0};
+    unsigned long mem_nodes[MASK_WORDS(PIN_MAX_NODES)] = {0};
+    int has_cpus = 0, has_cpu_nodes = 0, has_mem_nodes = 0;
+    int i = 1;
+
+    for (; argv[i] != NULL && argv[i][0] == '-'; i += 2)
+    {
+        int bad;
+
+        if (strcmp(argv[i], "--") == 0)
+        {
+            i++;
+            break;
+        }
+        if (argv[i + 1] == NULL)
+        {
+            fprintf(stderr, "%s: option requires a list: %s\n", argv[0], argv[i]);
+            return NULL;
+        }
+
+        if (strcmp(argv[i], "-c") == 0)
+        {
+            bad = parse_list(argv[i + 1], cpus, CPU_SETSIZE);
+            has_cpus = 1;
+        }
+        else if (strcmp(argv[i], "-N") == 0)
+        {
+            bad = parse_list(argv[i + 1], cpu_nodes, PIN_MAX_NODES);
+            has_cpu_nodes = 1;
+        }
+        else if (strcmp(argv[i], "-m") == 0)
+        {
+            bad = parse_list(argv[i + 1], mem_nodes, PIN_MAX_NODES);
+            has_mem_nodes = 1;
+        }
+        else
+        {
+            fprintf(stderr, "%s: unknown option: %s\n", argv[0], argv[i]);
+            return NULL;
+        }
+
+        if (bad < 0)
+        {
+            fprintf(stderr, "%s: bad list: %s\n", argv[0], argv[i + 1]);
+            return NULL;
+        }
+    }
+
+    if (argv[i] == NULL)
+    {
+        fprintf(stderr, "usage: %s [-c cpus] [-N nodes] [-m nodes] [--] command [args]...\n", argv[0]);
+        return NULL;
+    }
+
+    if (has_cpu_nodes && node_cpus(cpu_nodes, cpus) < 0)
+    {
+        return NULL;
+    }
+    if ((has_cpus || has_cpu_nodes) && set_cpus(cpus) < 0)
+    {
+        perror(argv[0]);
+        return NULL;
+    }
+    if (has_mem_nodes && set_memory(MPOL_BIND, mem_nodes) < 0)
+    {
+        perror(argv[0]);
+        return NULL;
+    }
+    return &argv[i];
+}
+
+int pin_next_slot(char **argv)
+{
+    if (!shell_option(OPT_AUTOPIN) && !shell_option(OPT_AUTONUMA))
+    {
+        return -1;
+    }
+    if (pin_is_prefix(argv[0]))
+    {
+        return -1;
+    }
+    return next_slot++;
+}
+
+/* Returns the number of the n-th set bit of a mask of max bits, or -1 */
+static int nth_bit(const unsigned long *mask, int max, int n)
+{
+    int count = 0;
+
+    for (int i = 0; i < max; i++)
+        count += MASK_ISSET(mask, i);
+    if (count == 0)
+        return -1;
+
+    n %= count;
+    for (int i = 0; i < max; i++)
+    {
+        if (MASK_ISSET(mask, i) && n-- == 0)
+            return i;
+    }
+    return -1;
+}
+
+void pin_auto(int slot)
+{
+    unsigned long cpus[MASK_WORDS(CPU_SETSIZE)] = {0};
+
+    // placement is best effort: the job still runs if it fails
+    if (shell_option(OPT_AUTONUMA))
+    {
+        unsigned long online[MASK_WORDS(PIN_MAX_NODES)] = {0};
+        unsigned long node[MASK_WORDS(PIN_MAX_NODES)] = {0};
+        int n;
+
+        if (read_list("/sys/devices/system/node/online", online, PIN_MAX_NODES) < 0 ||
+            (n = nth_bit(online, PIN_MAX_NODES, slot)) < 0)
+            return;
+
+        MASK_SET(node, n);
+        if (node_cpus(node, cpus) == 0)
+            set_cpus(cpus);
+        set_memory(MPOL_PREFERRED, node);
+    }
+    else
+    {
+        // round-robin over the CPUs the shell itself may run on
+        cpu_set_t allowed;
+        int cpu;
+
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0)
+            return;
+        for (int i = 0; i < CPU_SETSIZE; i++)
+        {
+            if (CPU_ISSET(i, &allowed))
+                MASK_SET(cpus, i);
+        }
+        if ((cpu = nth_bit(cpus, CPU_SETSIZE, slot)) < 0)
+            return;
+
+        memset(cpus, 0, sizeof(cpus));
+        MASK_SET(cpus, cpu);
+        set_cpus(cpus);
+    }
+}
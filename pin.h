@@ -0,0 +1,76 @@
+#ifndef PIN_H
+#define PIN_H
+
+/*
+ * Pin.h
+ * CPU affinity and NUMA memory placement of launched commands: the pin
+ * (or affinity) command prefix and the autopin / autonuma options that
+ * spread background jobs round-robin
+ * Authors : Aloysious Kok & Gerald
+ * Last Update : 18/10/26
+ */
+
+#include "shell.h"
+
+/* Highest NUMA node number accepted in a node list, plus one */
+#define PIN_MAX_NODES 1024
+
+/* int pin_is_prefix(const char *name)
+ *
+ * Checks whether a command name is the pin prefix ("pin" or "affinity").
+ *
+ * Returns :
+ *      1 - name is the prefix
+ *      0 - otherwise
+ */
+int pin_is_prefix(const char *name);
+
+/* char **pin_apply(char **argv)
+ *
+ * pin [-c cpus] [-N nodes] [-m nodes] [--] command [args]...
+ * This function is called in the child before the command is executed.
+ * It applies the placement given by the options of the prefix to the
+ * calling process: -c runs it on the listed CPUs, -N on the CPUs of the
+ * listed NUMA nodes and -m binds its memory to the listed nodes. Lists
+ * are written like 0-7,16,18-19.
+ *
+ * Arguments :
+ *      argv - the arguments, starting with the prefix itself
+ *
+ * Returns :
+ *      the arguments of the command that follows the options
+ *      NULL - bad option or placement (a message has been printed)
+ */
+char **pin_apply(char **argv);
+
+/* int pin_next_slot(char **argv)
+ *
+ * This function is called in the shell before a background command is
+ * forked. When the autopin or autonuma option is on it hands out the
+ * next round-robin slot. Commands with an explicit pin prefix do not
+ * take a slot.
+ *
+ * Arguments :
+ *      argv - the arguments of the command
+ *
+ * Returns :
+ *      the slot to pass to pin_auto() in the child
+ *     -1 - no automatic placement
+ */
+int pin_next_slot(char **argv);
+
+/* void pin_auto(int slot)
+ *
+ * This function places the calling child on the CPU (autopin) or the
+ * NUMA node (autonuma) for the slot returned by pin_next_slot(). With
+ * autonuma, memory is preferably allocated on the same node.
+ *
+ * Arguments :
+ *      slot - the round-robin slot
+ *
+ * Returns :
+ *      None
+ */
+void pin_auto(int slot);
+
+#endif
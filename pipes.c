@@ -0,0 +1,343 @@
+/*
+ * Pipes.c
+ * A metered pipe is two pipes with a meter process in between. The
+ * meter moves the data with splice(), so it is never copied to user
+ * space, and it polls the upstream pipe before each splice(): the time
+ * spent in poll() is spent waiting for the writer, the time spent in
+ * splice() is spent waiting for the reader to make room.
+ * A fan-out reads one pipe into several files. tee() copies what is in
+ * the pipe into a second pipe per extra file without consuming it, each
+ * copy is spliced to its file, and the original is spliced to the last
+ * file, which consumes it. Only page references are copied.
+ * Authors : Aloysious Kok & Gerald
+ * Last Update : 18/10/26
+ */
+
+#include <poll.h>
+#include <sys/mman.h>
+#include "pipes.h"
+#include "vars.h"
+#include "metrics.h"
+#include "jobs.h"
+
+/* The result of a meter, written by the meter process */
+typedef struct Pipes_meter_struct
+{
+    uint64_t bytes;
+    uint64_t elapsed_ns;  // from the start of the meter to end of file
+    uint64_t in_wait_ns;  // waiting for the stage writing to the pipe
+    uint64_t out_wait_ns; // waiting for the stage reading from it
+} pipes_result;
+
+static pipes_result *results = NULL;
+
+// fan-outs of foreground commands, waited for by pipes_fanout_wait()
+static pid_t fanouts[PIPES_FANOUT_MAX];
+static int n_fanouts = 0;
+
+static int pipe_max_size()
+{
+    static int max_size = 0;
+
+    if (max_size == 0)
+    {
+        FILE *fp = fopen(PIPES_MAX_SIZE_FILE, "r");
+        if (fp == NULL || fscanf(fp, "%d", &max_size) != 1 || max_size < PIPES_DEFAULT_SIZE)
+            max_size = PIPES_DEFAULT_SIZE;
+        if (fp != NULL)
+            fclose(fp);
+    }
+    return max_size;
+}
+
+int pipes_open(int fds[2])
+{
+    if (pipe(fds) == -1)
+    {
+        return -1;
+    }
+    if (!shell_option(OPT_BIGPIPE))
+    {
+        return 0;
+    }
+
+    const char *want = var_get("PIPE_SIZE");
+    int size = pipe_max_size();
+    if (want != NULL && want[0] != '\0' && atoi(want) > 0 && atoi(want) < size)
+    {
+        size = atoi(want);
+    }
+    // past the per-user allowance of pipe memory the kernel refuses
+    while (fcntl(fds[1], F_SETPIPE_SZ, size) == -1 && errno == EPERM && size > PIPES_DEFAULT_SIZE)
+    {
+        size /= 2;
+    }
+    return 0;
+}
+
+/* The meter process: relays one pipe to the other until end of file */
+static void meter_run(const int from[2], const int to[2], pipes_result *result)
+{
+    uint64_t start = metrics_now();
+    int in = from[0], out = to[1];
+    struct pollfd pfd = {in, POLLIN, 0};
+    int null = open("/dev/null", O_RDONLY);
+
+    // hold on to no other end of the pipeline, or end of file never comes
+    close(from[1]);
+    close(to[0]);
+    dup2(null, STDIN_FILENO);
+    close(null);
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGCHLD, SIG_DFL);
+
+    while (1)
+    {
+        uint64_t t = metrics_now();
+        if (poll(&pfd, 1, -1) == -1 && errno != EINTR)
+            break;
+        uint64_t t2 = metrics_now();
+        result->in_wait_ns += t2 - t;
+
+        ssize_t n = splice(in, NULL, out, NULL, PIPES_SPLICE_MAX, SPLICE_F_MOVE | SPLICE_F_MORE);
+        result->out_wait_ns += metrics_now() - t2;
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break; // end of file, or the reader has gone
+        result->bytes += n;
+    }
+    result->elapsed_ns = metrics_now() - start;
+    _exit(0);
+}
+
+pid_t pipes_meter(const int from[2], const int to[2], int slot)
+{
+    if (results == NULL)
+    {
+        results = mmap(NULL, PIPES_METER_MAX * sizeof(pipes_result), PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (results == MAP_FAILED)
+        {
+            results = NULL;
+            return -1;
+        }
+    }
+    if (slot < 0 || slot >= PIPES_METER_MAX)
+    {
+        return -1;
+    }
+    memset(&results[slot], 0, sizeof(results[slot]));
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        meter_run(from, to, &results[slot]);
+    }
+    return pid;
+}
+
+/* Formats a number of bytes with a binary unit */
+static void format_bytes(char *buf, size_t size, double bytes)
+{
+    static const char *units[] = {"B", "KiB", "MiB", "GiB", "TiB"};
+    int u = 0;
+
+    while (bytes >= 1024 && u < 4)
+    {
+        bytes /= 1024;
+        u++;
+    }
+    snprintf(buf, size, u == 0 ? "%.0f %s" : "%.1f %s", bytes, units[u]);
+}
+
+void pipes_report(command **cmd_stack, int first, const pid_t *meters, int count)
+{
+    char total[32], rate[32];
+
+    for (int i = 0; i < count; i++)
+    {
+        if (meters[i] > 0)
+            waitpid(meters[i], NULL, 0);
+    }
+    for (int i = 0; i < count; i++)
+    {
+        if (meters[i] <= 0)
+            continue;
+        pipes_result *r = &results[i];
+        double secs = r->elapsed_ns / 1e9;
+        double busy = r->elapsed_ns > 0 ? 100.0 / r->elapsed_ns : 0;
+
+        format_bytes(total, sizeof(total), r->bytes);
+        format_bytes(rate, sizeof(rate), secs > 0 ? r->bytes / secs : 0);
+        fprintf(stderr, "[%d] %s -> %s: %s in %.3f s, %s/s; waited %.0f%% for %s, %.0f%% for %s\n", i + 1,
+                cmd_stack[first + i]->argv[0], cmd_stack[first + i + 1]->argv[0], total, secs, rate,
+                r->in_wait_ns * busy, cmd_stack[first + i]->argv[0], r->out_wait_ns * busy,
+                cmd_stack[first + i + 1]->argv[0]);
+    }
+}
+
+/* Writes len bytes from a pipe to a target; a target that fails is dropped */
+static void fanout_drain(int pipe_in, int *target, size_t len, int null)
+{
+    while (len > 0)
+    {
+        ssize_t n = splice(pipe_in, NULL, *target != -1 ? *target : null, NULL, len, SPLICE_F_MOVE);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+        {
+            if (*target == -1)
+                break;
+            perror("multios");
+            *target = -1;
+            continue;
+        }
+        len -= n;
+    }
+}
+
+/* The fan-out process: copies the pipe in to the n >= 2 files until end of file */
+static void fanout_run(int in, int *files, int n)
+{
+    int (*copies)[2] = malloc((n - 1) * sizeof(*copies));
+    int null = open("/dev/null", O_WRONLY);
+    int keep[MAX_TEE_TARGETS + 4];
+    int n_keep = 0;
+
+    // hold on to no other descriptor of the shell, or a pipe the shell
+    // waits on might never see end of file
+    keep[n_keep++] = in;
+    keep[n_keep++] = null;
+    for (int i = 0; i < n; i++)
+        keep[n_keep++] = files[i];
+    for (int i = 1; i < n_keep; i++)
+    {
+        for (int j = i; j > 0 && keep[j] < keep[j - 1]; j--)
+        {
+            int t = keep[j];
+            keep[j] = keep[j - 1];
+            keep[j - 1] = t;
+        }
+    }
+    int lo = 3;
+    for (int i = 0; i < n_keep; i++)
+    {
+        if (keep[i] > lo)
+            close_range(lo, keep[i] - 1, 0);
+        if (keep[i] >= lo)
+            lo = keep[i] + 1;
+    }
+    close_range(lo, ~0U, 0);
+    dup2(null, STDIN_FILENO);
+
+    // a copy holds as many buffers as the pipe itself, so tee() does not
+    // come up short while the copy is empty
+    int size = fcntl(in, F_GETPIPE_SZ);
+    for (int i = 0; i < n - 1; i++)
+    {
+        if (pipe(copies[i]) == -1)
+            _exit(1);
+        if (size > 0)
+            fcntl(copies[i][1], F_SETPIPE_SZ, size);
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    while (1)
+    {
+        ssize_t len = tee(in, copies[0][1], PIPES_SPLICE_MAX, 0);
+        if (len == -1 && errno == EINTR)
+            continue;
+        if (len <= 0)
+            break;
+
+        // what every copy holds; the rest of a longer copy is discarded
+        // and teed again on the next round
+        size_t got[MAX_TEE_TARGETS + 1];
+        size_t least = len;
+        got[0] = len;
+        for (int i = 1; i < n - 1; i++)
+        {
+            ssize_t m;
+            while ((m = tee(in, copies[i][1], least, 0)) == -1 && errno == EINTR)
+                ;
+            got[i] = m > 0 ? (size_t)m : 0;
+            if (got[i] < least)
+                least = got[i];
+        }
+        for (int i = 0; i < n - 1; i++)
+        {
+            int discard = -1;
+            fanout_drain(copies[i][0], &files[i], least, null);
+            fanout_drain(copies[i][0], &discard, got[i] - least, null);
+        }
+        fanout_drain(in, &files[n - 1], least, null);
+    }
+    _exit(0);
+}
+
+int pipes_open_output(command *cmd, int background)
+{
+    int files[MAX_TEE_TARGETS + 1];
+    int fds[2];
+    int n = 0;
+
+    if (cmd->redirect_tee == NULL || cmd->redirect_tee[0] == NULL || !shell_option(OPT_MULTIOS))
+    {
+        // write/create a output file with read and execute access
+        int fd = open(cmd->redirect_out, O_WRONLY | O_CREAT, 0755);
+        if (fd == -1)
+            perror(cmd->redirect_out);
+        return fd;
+    }
+
+    for (n = 0; n == 0 || cmd->redirect_tee[n - 1] != NULL; n++)
+    {
+        const char *path = n == 0 ? cmd->redirect_out : cmd->redirect_tee[n - 1];
+        if ((files[n] = open(path, O_WRONLY | O_CREAT, 0755)) == -1)
+        {
+            perror(path);
+            while (n > 0)
+                close(files[--n]);
+            return -1;
+        }
+    }
+    if (pipes_open(fds) == -1)
+    {
+        while (n > 0)
+            close(files[--n]);
+        return -1;
+    }
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        close(fds[1]);
+        fanout_run(fds[0], files, n);
+    }
+    close(fds[0]);
+    while (n > 0)
+        close(files[--n]);
+    if (pid < 0)
+    {
+        close(fds[1]);
+        return -1;
+    }
+
+    if (background || n_fanouts == PIPES_FANOUT_MAX)
+        jobs_track(pid, 0);
+    else
+        fanouts[n_fanouts++] = pid;
+    return fds[1];
+}
+
+void pipes_fanout_wait()
+{
+    for (int i = 0; i < n_fanouts; i++)
+    {
+        waitpid(fanouts[i], NULL, 0);
+    }
+    n_fanouts = 0;
+}
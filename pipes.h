@@ -0,0 +1,116 @@
+#ifndef PIPES_H
+#define PIPES_H
+
+/*
+ * Pipes.h
+ * The pipes between the stages of a pipeline: their buffer size (set -o
+ * bigpipe) and the throughput meter that reports on each of them when
+ * the pipeline finishes (set -o pipemeter), and the fan-out of output
+ * to several files (set -o multios)
+ * Authors : Aloysious Kok & Gerald
+ * Last Update : 18/10/26
+ */
+
+#include "shell.h"
+
+/* Upper bound of the pipe size, unless the kernel says otherwise */
+#define PIPES_MAX_SIZE_FILE "/proc/sys/fs/pipe-max-size"
+
+/* Size of a pipe when F_SETPIPE_SZ is refused: the kernel default */
+#define PIPES_DEFAULT_SIZE 65536
+
+/* Pipes metered in one pipeline; the ones after that are plain pipes */
+#define PIPES_METER_MAX 32
+
+/* Largest splice() or tee() of a meter or fan-out */
+#define PIPES_SPLICE_MAX (1024 * 1024)
+
+/* Fan-outs of foreground commands waited for at once; more are reaped
+ * in the background */
+#define PIPES_FANOUT_MAX 16
+
+/* int pipes_open(int fds[2])
+ *
+ * This function creates a pipe for a pipeline like pipe(). With set -o
+ * bigpipe the buffer is enlarged with F_SETPIPE_SZ to $PIPE_SIZE bytes,
+ * or to /proc/sys/fs/pipe-max-size if PIPE_SIZE is not set; it never
+ * exceeds the latter, and it is halved until the kernel accepts it when
+ * the per-user pipe allowance is used up.
+ *
+ * Arguments :
+ *      fds - the read and write ends, as from pipe()
+ *
+ * Returns :
+ *      0 - success, -1 - pipe() failed
+ */
+int pipes_open(int fds[2]);
+
+/* pid_t pipes_meter(const int from[2], const int to[2], int slot)
+ *
+ * This function forks a meter: a process relaying the output of a
+ * stage (from) to the input of the next (to) with splice(), counting
+ * the bytes and the time spent waiting on either side. The result is
+ * kept in a shared slot for pipes_report(). The caller still closes
+ * the ends it does not need.
+ *
+ * Arguments :
+ *      from - the pipe the stage writes to
+ *      to - the pipe the next stage reads from
+ *      slot - the pipe in the pipeline, from 0, below PIPES_METER_MAX
+ *
+ * Returns :
+ *      the process id of the meter, -1 on failure
+ */
+pid_t pipes_meter(const int from[2], const int to[2], int slot);
+
+/* void pipes_report(command **cmd_stack, int first, const pid_t *meters, int count)
+ *
+ * This function waits for the meters of a pipeline and prints, on
+ * stderr, the bytes each stage wrote, its rate, and how long the pipe
+ * waited for the stage writing to it and for the stage reading from it.
+ * A stage the next one keeps waiting for is the bottleneck.
+ *
+ * Arguments :
+ *      cmd_stack - the commands of the line
+ *      first - the first stage of the pipeline in cmd_stack
+ *      meters - the meters, one per pipe, -1 where none was started
+ *      count - the number of pipes
+ *
+ * Returns :
+ *      None
+ */
+void pipes_report(command **cmd_stack, int first, const pid_t *meters, int count);
+
+/* int pipes_open_output(command *cmd, int background)
+ *
+ * This function opens the output redirection of a command. With set -o
+ * multios and more than one target (cmd > a > b) every target is opened
+ * and a fan-out process is forked: it duplicates a pipe into all of
+ * them with tee() and splice(), so the data never leaves the kernel.
+ * The write end of that pipe is returned and the fan-out ends once it
+ * has been closed everywhere. Without multios only the first target is
+ * used.
+ *
+ * Arguments :
+ *      cmd - the command, expanded
+ *      background - the command is not waited for; neither is the
+ *                   fan-out, it is reaped as a background child
+ *
+ * Returns :
+ *      the descriptor for the stdout of the command, -1 on failure,
+ *      which has been reported
+ */
+int pipes_open_output(command *cmd, int background);
+
+/* void pipes_fanout_wait()
+ *
+ * This function waits for the fan-outs of the foreground commands just
+ * run, so their files are complete before the next command starts. The
+ * shell must have closed its copies of their pipes.
+ *
+ * Returns :
+ *      None
+ */
+void pipes_fanout_wait();
+
+#endif
@@ -0,0 +1,423 @@
+/*
+ * Prompt.c
+ * Rendering the prompt must not delay the next command line, so nothing
+ * in here runs a command in the foreground. The git branch is read from
+ * the repository files directly, and HEAD is read again only when its
+ * modification time changes. Command segments are evaluated by children
+ * writing into pipes watched by term_getc(); until they finish the
+ * prompt shows the previous value, or nothing the first time.
+ * Authors : Aloysious Kok & Gerald
+ * Last Update : 18/10/26
+ */
+
+#include <pwd.h>
+#include <sys/stat.h>
+#include "prompt.h"
+#include "script.h"
+#include "jobs.h"
+#include "term.h"
+#include "edit.h"
+
+/* A command segment and its cached output */
+typedef struct Segment_struct
+{
+    char *cmd;                  // the command, NULL for a free slot
+    char value[PROMPT_SEG_MAX]; // the last complete output
+    int fresh;                  // value belongs to the current directory
+    int used;                   // found in the last rendered template
+    pid_t pid;                  // the running evaluation, 0 if none
+    int fd;                     // its output pipe
+    char pending[PROMPT_SEG_MAX];
+    size_t n_pending;
+} segment;
+
+static segment segments[PROMPT_MAX_SEGS];
+
+static char rendered[MAX_BUF_SIZE];
+static size_t n_rendered;
+static char template_copy[MAX_BUF_SIZE];
+static char last_cwd[MAX_BUF_SIZE];
+
+// where HEAD of the current repository is, and what it said last time
+static char head_path[MAX_BUF_SIZE];
+static struct timespec head_mtime;
+static ino_t head_ino;
+static char branch[PROMPT_SEG_MAX];
+
+static void put(const char *s, size_t n)
+{
+    if (n > sizeof(rendered) - 1 - n_rendered)
+        n = sizeof(rendered) - 1 - n_rendered;
+    memcpy(rendered + n_rendered, s, n);
+    n_rendered += n;
+}
+
+/* Finds the HEAD file of the repository containing dir */
+static void find_head(const char *dir)
+{
+    char up[MAX_BUF_SIZE];
+    char path[MAX_BUF_SIZE];
+    char line[MAX_BUF_SIZE];
+    struct stat st;
+
+    head_path[0] = '\0';
+    snprintf(up, sizeof(up), "%s", dir);
+    while (up[0] == '/')
+    {
+        // "/" is kept as an empty prefix so paths get a single slash
+        const char *prefix = up[1] == '\0' ? "" : up;
+        // a path too long to hold is skipped rather than cut short
+        if (snprintf(path, sizeof(path), "%s/.git", prefix) >= (int)sizeof(path))
+            return;
+
+        if (stat(path, &st) == 0 && S_ISDIR(st.st_mode))
+        {
+            if (snprintf(head_path, sizeof(head_path), "%s/HEAD", path) >= (int)sizeof(head_path))
+                head_path[0] = '\0';
+            return;
+        }
+        if (stat(path, &st) == 0 && S_ISREG(st.st_mode))
+        {
+            // a worktree or submodule: ".git" names the real directory
+            FILE *fp = fopen(path, "r");
+            if (fp != NULL && fgets(line, sizeof(line), fp) != NULL && strncmp(line, "gitdir: ", 8) == 0)
+            {
+                int n;
+                line[strcspn(line, "\n")] = '\0';
+                if (line[8] == '/')
+                    n = snprintf(head_path, sizeof(head_path), "%s/HEAD", line + 8);
+                else
+                    n = snprintf(head_path, sizeof(head_path), "%s/%s/HEAD", prefix, line + 8);
+                if (n >= (int)sizeof(head_path))
+                    head_path[0] = '\0';
+            }
+            if (fp != NULL)
+                fclose(fp);
+            return;
+        }
+
+        if (up[1] == '\0')
+            return;
+        char *slash = strrchr(up, '/');
+        slash[slash == up ? 1 : 0] = '\0';
+    }
+}
+
+/* Reads the branch from HEAD when the file has changed */
+static void update_branch()
+{
+    struct stat st;
+    char line[MAX_BUF_SIZE];
+
+    if (head_path[0] == '\0' || stat(head_path, &st) == -1)
+    {
+        branch[0] = '\0';
+        return;
+    }
+    if (st.st_ino == head_ino && st.st_mtim.tv_sec == head_mtime.tv_sec &&
+        st.st_mtim.tv_nsec == head_mtime.tv_nsec)
+    {
+        return;
+    }
+    head_ino = st.st_ino;
+    head_mtime = st.st_mtim;
+
+    branch[0] = '\0';
+    FILE *fp = fopen(head_path, "r");
+    if (fp == NULL)
+        return;
+    if (fgets(line, sizeof(line), fp) != NULL)
+    {
+        line[strcspn(line, "\n")] = '\0';
+        if (strncmp(line, "ref: refs/heads/", 16) == 0)
+            snprintf(branch, sizeof(branch), "%.*s", (int)sizeof(branch) - 1, line + 16);
+        else
+            snprintf(branch, sizeof(branch), "%.7s", line); // detached
+    }
+    fclose(fp);
+}
+
+/* Stops a running evaluation; its output is thrown away */
+static void seg_cancel(segment *seg)
+{
+    if (seg->pid == 0)
+        return;
+    term_unwatch(seg->fd);
+    close(seg->fd);
+    kill(seg->pid, SIGKILL);
+    waitpid(seg->pid, NULL, 0);
+    seg->pid = 0;
+}
+
+/* Called by term_getc() when a segment has written or finished */
+static void seg_ready(int fd)
+{
+    segment *seg = NULL;
+    char buf[PROMPT_SEG_MAX];
+    int status;
+
+    for (int i = 0; i < PROMPT_MAX_SEGS; i++)
+    {
+        if (segments[i].pid != 0 && segments[i].fd == fd)
+            seg = &segments[i];
+    }
+    if (seg == NULL)
+    {
+        term_unwatch(fd);
+        return;
+    }
+
+    ssize_t n = read(fd, buf, sizeof(buf));
+    if (n > 0 || (n == -1 && (errno == EINTR || errno == EAGAIN)))
+    {
+        // output past the limit is read and dropped
+        if (n > 0 && seg->n_pending < PROMPT_SEG_MAX - 1)
+        {
+            size_t room = PROMPT_SEG_MAX - 1 - seg->n_pending;
+            memcpy(seg->pending + seg->n_pending, buf, (size_t)n < room ? (size_t)n : room);
+            seg->n_pending += (size_t)n < room ? (size_t)n : room;
+        }
+        return;
+    }
+
+    term_unwatch(fd);
+    close(fd);
+    waitpid(seg->pid, &status, 0);
+    seg->pid = 0;
+    if (!WIFEXITED(status))
+        return; // interrupted: tried again at the next prompt
+
+    // the prompt is one line: drop trailing newlines, flatten the rest
+    while (seg->n_pending > 0 && seg->pending[seg->n_pending - 1] == '\n')
+        seg->n_pending--;
+    for (size_t i = 0; i < seg->n_pending; i++)
+    {
+        if (seg->pending[i] == '\n' || seg->pending[i] == '\t' || seg->pending[i] == '\r')
+            seg->pending[i] = ' ';
+    }
+    seg->pending[seg->n_pending] = '\0';
+
+    int changed = strcmp(seg->value, seg->pending) != 0;
+    memcpy(seg->value, seg->pending, seg->n_pending + 1);
+    seg->fresh = 1;
+    if (changed)
+        edit_set_prompt(prompt_render(template_copy));
+}
+
+static void seg_start(segment *seg)
+{
+    int fds[2];
+
+    if (pipe2(fds, O_CLOEXEC) == -1)
+        return;
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        // nothing may reach the terminal while the user is typing
+        int null = open("/dev/null", O_RDWR);
+        signal(SIGCHLD, SIG_DFL);
+        dup2(null, STDIN_FILENO);
+        dup2(fds[1], STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        exit(script_run_text(seg->cmd));
+    }
+    close(fds[1]);
+    if (pid < 0 || term_watch(fds[0], seg_ready) < 0)
+    {
+        close(fds[0]);
+        if (pid > 0)
+        {
+            kill(pid, SIGKILL);
+            waitpid(pid, NULL, 0);
+        }
+        return;
+    }
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    seg->pid = pid;
+    seg->fd = fds[0];
+    seg->n_pending = 0;
+}
+
+/* Finds the cached segment for a command, or a slot for it */
+static segment *seg_lookup(const char *cmd, size_t len)
+{
+    segment *free_slot = NULL;
+
+    for (int i = 0; i < PROMPT_MAX_SEGS; i++)
+    {
+        segment *seg = &segments[i];
+        if (seg->cmd == NULL)
+        {
+            if (free_slot == NULL)
+                free_slot = seg;
+        }
+        else if (strlen(seg->cmd) == len && strncmp(seg->cmd, cmd, len) == 0)
+            return seg;
+    }
+    if (free_slot != NULL)
+    {
+        free_slot->cmd = strndup(cmd, len);
+        free_slot->value[0] = '\0';
+        free_slot->fresh = 0;
+    }
+    return free_slot;
+}
+
+const char *prompt_skip_segment(const char *p)
+{
+    int depth = 0;
+    char quote = 0;
+
+    for (p += 1; *p != '\0'; p++)
+    {
+        if (quote != 0)
+        {
+            if (*p == quote)
+                quote = 0;
+        }
+        else if (*p == '\'' || *p == '"')
+            quote = *p;
+        else if (*p == '(')
+            depth++;
+        else if (*p == ')' && --depth == 0)
+            return p + 1;
+    }
+    return NULL;
+}
+
+const char *prompt_render(const char *template)
+{
+    char cwd[MAX_BUF_SIZE];
+    static char host[MAX_BUF_SIZE];
+    const char *home = getenv("HOME");
+
+    if (template != template_copy)
+        snprintf(template_copy, sizeof(template_copy), "%s", template);
+
+    // a new directory makes every cached value stale
+    if (getcwd(cwd, sizeof(cwd)) == NULL)
+        cwd[0] = '\0';
+    if (strcmp(cwd, last_cwd) != 0)
+    {
+        strcpy(last_cwd, cwd);
+        find_head(cwd);
+        head_ino = 0;
+        for (int i = 0; i < PROMPT_MAX_SEGS; i++)
+        {
+            seg_cancel(&segments[i]);
+            segments[i].fresh = 0;
+        }
+    }
+
+    for (int i = 0; i < PROMPT_MAX_SEGS; i++)
+        segments[i].used = 0;
+
+    n_rendered = 0;
+    for (const char *p = template; *p != '\0'; p++)
+    {
+        if (*p != '\\' || p[1] == '\0')
+        {
+            put(p, 1);
+            continue;
+        }
+
+        char num[16];
+        p++;
+        switch (*p)
+        {
+        case 'w':
+        {
+            size_t home_len = home ? strlen(home) : 0;
+            if (home_len > 1 && strncmp(cwd, home, home_len) == 0 &&
+                (cwd[home_len] == '/' || cwd[home_len] == '\0'))
+            {
+                put("~", 1);
+                put(cwd + home_len, strlen(cwd + home_len));
+            }
+            else
+                put(cwd, strlen(cwd));
+            break;
+        }
+        case 'W':
+        {
+            const char *base = strrchr(cwd, '/');
+            if (home != NULL && strcmp(cwd, home) == 0)
+                put("~", 1);
+            else if (base == NULL || base[1] == '\0')
+                put(cwd, strlen(cwd));
+            else
+                put(base + 1, strlen(base + 1));
+            break;
+        }
+        case '?':
+            snprintf(num, sizeof(num), "%d", last_status);
+            put(num, strlen(num));
+            break;
+        case 'j':
+            snprintf(num, sizeof(num), "%d", jobs_running());
+            put(num, strlen(num));
+            break;
+        case 'g':
+            update_branch();
+            put(branch, strlen(branch));
+            break;
+        case 'u':
+        {
+            struct passwd *pw = getpwuid(getuid());
+            if (pw != NULL)
+                put(pw->pw_name, strlen(pw->pw_name));
+            break;
+        }
+        case 'h':
+            if (host[0] == '\0' && gethostname(host, sizeof(host) - 1) == 0)
+                host[strcspn(host, ".")] = '\0';
+            put(host, strlen(host));
+            break;
+        case '$':
+            put(getuid() == 0 ? "#" : "$", 1);
+            break;
+        case 'e':
+            put("\33", 1);
+            break;
+        case '(':
+        {
+            const char *end = prompt_skip_segment(p - 1);
+            if (end == NULL)
+            {
+                put(p - 1, strlen(p - 1));
+                p += strlen(p) - 1;
+                break;
+            }
+            segment *seg = seg_lookup(p + 1, end - p - 2);
+            if (seg != NULL)
+            {
+                seg->used = 1;
+                if (!seg->fresh && seg->pid == 0)
+                    seg_start(seg);
+                put(seg->value, strlen(seg->value));
+            }
+            p = end - 1;
+            break;
+        }
+        default:
+            put(p - 1, 2);
+            break;
+        }
+    }
+    rendered[n_rendered] = '\0';
+
+    // segments no longer in the prompt are forgotten
+    for (int i = 0; i < PROMPT_MAX_SEGS; i++)
+    {
+        segment *seg = &segments[i];
+        if (seg->cmd != NULL && !seg->used)
+        {
+            seg_cancel(seg);
+            free(seg->cmd);
+            seg->cmd = NULL;
+        }
+    }
+    return rendered;
+}
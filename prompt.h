@@ -0,0 +1,63 @@
+#ifndef PROMPT_H
+#define PROMPT_H
+
+/*
+ * Prompt.h
+ * Expansion of the prompt escapes. Values that are slow to find are
+ * cached: the git branch until HEAD changes, and the output of command
+ * segments until the current directory changes. Command segments run in
+ * the background, so the prompt is shown at once with the old values
+ * and redrawn in place when the new ones arrive.
+ * Authors : Aloysious Kok & Gerald
+ * Last Update : 18/10/26
+ */
+
+#include "shell.h"
+
+/* Largest number of command segments cached at a time */
+#define PROMPT_MAX_SEGS 8
+
+/* Largest output kept from a command segment, including the '\0' */
+#define PROMPT_SEG_MAX 256
+
+/* const char *prompt_render(const char *template)
+ *
+ * This function expands the escapes of a prompt string:
+ *
+ *  \w    current directory, with $HOME shown as ~
+ *  \W    last component of the current directory
+ *  \?    exit status of the last command
+ *  \j    number of background children still running
+ *  \g    git branch (or short commit) of the current directory
+ *  \u    user name
+ *  \h    host name up to the first '.'
+ *  \$    '#' for root, '$' otherwise
+ *  \e    escape character, for colours
+ *  \\    backslash
+ *  \(c)  output of the command c, run in the background
+ *
+ * A command segment that has no fresh value is started in a child whose
+ * output is collected by term_getc() while the user types; the prompt
+ * is then redrawn through edit_set_prompt().
+ *
+ * Arguments :
+ *      template - the prompt string set with the prompt builtin
+ *
+ * Returns :
+ *      the expanded prompt, in a static buffer
+ */
+const char *prompt_render(const char *template);
+
+/* const char *prompt_skip_segment(const char *p)
+ *
+ * Finds the end of a command segment.
+ *
+ * Arguments :
+ *      p - points at the '\' of a "\(" in a prompt string
+ *
+ * Returns :
+ *      a pointer just after the closing ')', or NULL if it is missing
+ */
+const char *prompt_skip_segment(const char *p);
+
+#endif
@@ -0,0 +1,565 @@
+/*
+ * Rc.c
+ * The startup file is read whole and kept: an alias or function is a
+ * name in a hash table and the place of its text in the file, so indexing
+ * it costs a scan of its lines and no parsing. The statements between
+ * definitions are gathered per section and run with script_run_text(),
+ * so compound commands may span lines. Aliases are replaced in the text
+ * of a line before it is parsed; functions are looked up by name once
+ * the line has been expanded.
+ * Authors : Aloysious Kok & Gerald
+ * Last Update : 18/10/26
+ */
+
+#include <ctype.h>
+#include <sys/stat.h>
+#include "rc.h"
+#include "script.h"
+#include "vars.h"
+#include "metrics.h"
+#include "common.h"
+
+enum rc_kind
+{
+    RC_ALIAS,
+    RC_FUNCTION
+};
+
+// an alias or function
+typedef struct Rc_def_struct
+{
+    char *name;
+    int kind;
+    const char *text; // the value or body in the startup file, until parsed
+    size_t len;
+    char *value;   // alias: the value once parsed
+    script *prog;  // function: the body once compiled
+    int running;   // function: calls in progress
+    struct Rc_def_struct *next;
+} rc_def;
+
+// a section of the startup file, for the profile
+typedef struct Rc_section_struct
+{
+    char name[64];
+    uint64_t ns;
+    int aliases, functions, lines;
+} rc_section;
+
+static rc_def *table[RC_BUCKETS];
+static int n_aliases = 0;
+static char *rc_text = NULL; // definitions point into it
+static int depth = 0;
+static int profiling = 0;
+static uint64_t started = 0;
+
+static unsigned rc_hash(const char *name, size_t len)
+{
+    return hash32(name, len) % RC_BUCKETS;
+}
+
+static rc_def *rc_lookup(const char *name, size_t len, int kind)
+{
+    for (rc_def *def = table[rc_hash(name, len)]; def != NULL; def = def->next)
+    {
+        if (def->kind == kind && strlen(def->name) == len && strncmp(def->name, name, len) == 0)
+            return def;
+    }
+    return NULL;
+}
+
+/* Finds or adds a definition; an existing one loses what it had */
+static rc_def *rc_define(const char *name, size_t len, int kind)
+{
+    rc_def *def = rc_lookup(name, len, kind);
+
+    if (def == NULL)
+    {
+        unsigned b = rc_hash(name, len);
+        def = calloc(1, sizeof(rc_def));
+        def->name = strndup(name, len);
+        def->kind = kind;
+        def->next = table[b];
+        table[b] = def;
+        n_aliases += kind == RC_ALIAS;
+    }
+    else if (def->running == 0)
+    {
+        free(def->value);
+        script_free(def->prog);
+        def->value = NULL;
+        def->prog = NULL;
+    }
+    def->text = NULL;
+    return def;
+}
+
+static const char *alias_value(rc_def *def)
+{
+    if (def->value == NULL && def->text != NULL)
+    {
+        // parsed on first use: quotes are removed, variables expanded
+        char *raw = strndup(def->text, def->len);
+        def->value = expand_string(raw, 0);
+        if (def->value == NULL)
+            def->value = strdup(raw);
+        free(raw);
+    }
+    return def->value != NULL ? def->value : "";
+}
+
+static int is_name_char(int c)
+{
+    return isalnum(c) || c == '_' || c == '-' || c == '.';
+}
+
+/* The end of the shell word at p, quotes included, not going past eol */
+static const char *word_end(const char *p, const char *eol)
+{
+    while (p < eol && !isspace((unsigned char)*p) && *p != ';')
+    {
+        if ((*p == '\'' || *p == '"') && memchr(p + 1, *p, eol - p - 1) != NULL)
+            p = (const char *)memchr(p + 1, *p, eol - p - 1) + 1;
+        else if (*p == '\\' && p + 1 < eol)
+            p += 2;
+        else
+            p++;
+    }
+    return p;
+}
+
+static const char *skip_blanks(const char *p, const char *eol)
+{
+    while (p < eol && (*p == ' ' || *p == '\t'))
+    {
+        p++;
+    }
+    return p;
+}
+
+/* Indexes "alias name=value" holding one word; returns 0 if the line is one */
+static int index_alias(const char *p, const char *eol)
+{
+    const char *name, *value, *end;
+
+    if (eol - p < 6 || strncmp(p, "alias", 5) != 0 || (p[5] != ' ' && p[5] != '\t'))
+        return -1;
+    name = skip_blanks(p + 5, eol);
+    for (p = name; p < eol && is_name_char((unsigned char)*p); p++)
+        ;
+    if (p == name || p == eol || *p != '=')
+        return -1;
+    value = p + 1;
+    end = word_end(value, eol);
+    if (skip_blanks(end, eol) != eol)
+        return -1;
+
+    rc_def *def = rc_define(name, p - name, RC_ALIAS);
+    def->text = value;
+    def->len = end - value;
+    return 0;
+}
+
+/* Indexes "name() {"; returns the line after the body, or NULL if the line is not one */
+static const char *index_function(const char *p, const char *eol, const char *text_end, int *error)
+{
+    const char *name = p, *body, *end;
+
+    for (; p < eol && is_name_char((unsigned char)*p); p++)
+        ;
+    if (p == name)
+        return NULL;
+    size_t len = p - name;
+    p = skip_blanks(p, eol);
+    if (eol - p < 2 || p[0] != '(' || p[1] != ')')
+        return NULL;
+    p = skip_blanks(p + 2, eol);
+    if (p == eol || *p != '{')
+        return NULL;
+    body = skip_blanks(p + 1, eol);
+
+    if (body < eol)
+    {
+        // name() { commands; }
+        end = eol;
+        while (end > body && isspace((unsigned char)end[-1]))
+            end--;
+        if (end == body || end[-1] != '}')
+        {
+            fprintf(stderr, "%s: unterminated function %.*s\n", RC_FILE_NAME, (int)len, name);
+            *error = 1;
+            return eol;
+        }
+        end--;
+        eol = eol < text_end ? eol + 1 : eol;
+    }
+    else
+    {
+        // the body runs until a line holding only '}'
+        body = eol < text_end ? eol + 1 : eol;
+        for (end = body; end < text_end;)
+        {
+            const char *next = memchr(end, '\n', text_end - end);
+            const char *line_end = next != NULL ? next : text_end;
+            const char *s = skip_blanks(end, line_end);
+            if (s < line_end && *s == '}' && skip_blanks(s + 1, line_end) == line_end)
+                break;
+            end = next != NULL ? next + 1 : text_end;
+        }
+        if (end == text_end)
+        {
+            fprintf(stderr, "%s: unterminated function %.*s\n", RC_FILE_NAME, (int)len, name);
+            *error = 1;
+            return text_end;
+        }
+        const char *next = memchr(end, '\n', text_end - end);
+        eol = next != NULL ? next + 1 : text_end;
+    }
+
+    rc_def *def = rc_define(name, len, RC_FUNCTION);
+    def->text = body;
+    def->len = end - body;
+    return eol;
+}
+
+/* Runs the statements gathered for a section */
+static void run_statements(char **pending, size_t *pending_len)
+{
+    if (*pending_len == 0)
+    {
+        return;
+    }
+    script_run_text(*pending);
+    free(*pending);
+    *pending = NULL;
+    *pending_len = 0;
+}
+
+static void add_statement(char **pending, size_t *pending_len, const char *line, size_t len)
+{
+    *pending = realloc(*pending, *pending_len + len + 2);
+    memcpy(*pending + *pending_len, line, len);
+    *pending_len += len;
+    (*pending)[(*pending_len)++] = '\n';
+    (*pending)[*pending_len] = '\0';
+}
+
+static void print_profile(const char *path, rc_section *sections, int n_sections, uint64_t total)
+{
+    fprintf(stderr, "startup file %s: %.3f ms\n", path, total / 1e6);
+    fprintf(stderr, "  %-24s %10s %6s %8s %9s\n", "section", "ms", "lines", "aliases", "functions");
+    for (int i = 0; i < n_sections; i++)
+    {
+        fprintf(stderr, "  %-24s %10.3f %6d %8d %9d\n", sections[i].name, sections[i].ns / 1e6, sections[i].lines,
+                sections[i].aliases, sections[i].functions);
+    }
+}
+
+void rc_load(uint64_t start, int profile)
+{
+    const char *path = var_get("SIMPLESHRC");
+    char buf[MAX_BUF_SIZE];
+    rc_section sections[RC_MAX_SECTIONS];
+    int n_sections = 1;
+    char *pending = NULL;
+    size_t pending_len = 0;
+    size_t len;
+    int error = 0;
+
+    started = start;
+    profiling = profile;
+    if (path == NULL)
+    {
+        const char *home = var_get("HOME");
+        if (home == NULL)
+            return;
+        snprintf(buf, sizeof(buf), "%s/%s", home, RC_FILE_NAME);
+        path = buf;
+    }
+    uint64_t load_start = metrics_now();
+    if ((rc_text = read_whole_file(path, &len)) == NULL)
+    {
+        return;
+    }
+
+    memset(sections, 0, sizeof(sections));
+    snprintf(sections[0].name, sizeof(sections[0].name), "(top)");
+    uint64_t section_start = metrics_now();
+    const char *text_end = rc_text + len;
+    for (const char *line = rc_text; line < text_end && !error;)
+    {
+        const char *nl = memchr(line, '\n', text_end - line);
+        const char *eol = nl != NULL ? nl : text_end;
+        const char *next = nl != NULL ? nl + 1 : text_end;
+        const char *p = skip_blanks(line, eol);
+        rc_section *sec = &sections[n_sections - 1];
+
+        if ((size_t)(eol - p) >= strlen(RC_SECTION_MARK) && strncmp(p, RC_SECTION_MARK, strlen(RC_SECTION_MARK)) == 0 &&
+            n_sections < RC_MAX_SECTIONS)
+        {
+            // the statements so far are part of the section they were in
+            run_statements(&pending, &pending_len);
+            sec->ns += metrics_now() - section_start;
+            section_start = metrics_now();
+            sec = &sections[n_sections++];
+            p = skip_blanks(p + strlen(RC_SECTION_MARK), eol);
+            snprintf(sec->name, sizeof(sec->name), "%.*s", (int)(eol - p), p);
+        }
+        sec->lines++;
+        if (p == eol || *p == '#')
+        {
+            // blank lines and comments
+        }
+        else if (index_alias(p, eol) == 0)
+        {
+            sec->aliases++;
+        }
+        else
+        {
+            const char *after = index_function(p, eol, text_end, &error);
+            if (after != NULL)
+            {
+                sec->functions += !error;
+                for (const char *s = next; s < after; s++)
+                    sec->lines += *s == '\n';
+                sec->lines += after == text_end && after > next && after[-1] != '\n';
+                next = after;
+            }
+            else
+            {
+                add_statement(&pending, &pending_len, line, eol - line);
+            }
+        }
+        line = next;
+    }
+    run_statements(&pending, &pending_len);
+    sections[n_sections - 1].ns += metrics_now() - section_start;
+
+    if (profiling)
+    {
+        print_profile(path, sections, n_sections, metrics_now() - load_start);
+    }
+}
+
+void rc_first_prompt()
+{
+    if (profiling)
+    {
+        fprintf(stderr, "start to first prompt: %.3f ms\n", (metrics_now() - started) / 1e6);
+        profiling = 0;
+    }
+}
+
+char *rc_expand_aliases(const char *line)
+{
+    char *out = NULL;
+    size_t out_len = 0;
+    FILE *fp;
+    int command_word = 1;
+    int parens = 0;
+    int changed = 0;
+
+    if (n_aliases == 0)
+    {
+        return NULL;
+    }
+    fp = open_memstream(&out, &out_len);
+    for (const char *p = line; *p != '\0';)
+    {
+        if (command_word)
+        {
+            while (*p != '\0' && isspace((unsigned char)*p))
+                fputc(*p++, fp);
+            const char *end = p;
+            while (*end != '\0' && !isspace((unsigned char)*end) && strchr(";&|<>()'\"\\$`", *end) == NULL)
+                end++;
+            rc_def *def;
+            if (end > p && (*end == '\0' || isspace((unsigned char)*end) || strchr(";&|", *end) != NULL) &&
+                (def = rc_lookup(p, end - p, RC_ALIAS)) != NULL)
+            {
+                fputs(alias_value(def), fp);
+                p = end;
+                changed = 1;
+            }
+            command_word = 0;
+            continue;
+        }
+
+        if (*p == '\\' && p[1] != '\0')
+        {
+            fputc(*p++, fp);
+        }
+        else if (*p == '\'' || *p == '"')
+        {
+            // copied up to the closing quote
+            char quote = *p;
+            fputc(*p++, fp);
+            while (*p != '\0' && *p != quote)
+            {
+                if (quote == '"' && *p == '\\' && p[1] != '\0')
+                    fputc(*p++, fp);
+                fputc(*p++, fp);
+            }
+            if (*p == '\0')
+                break;
+        }
+        else if (*p == '(')
+        {
+            parens++;
+        }
+        else if (*p == ')' && parens > 0)
+        {
+            parens--;
+        }
+        else if (parens == 0 && strchr(";&|\n", *p) != NULL)
+        {
+            command_word = 1;
+        }
+        fputc(*p++, fp);
+    }
+    fclose(fp);
+
+    if (!changed)
+    {
+        free(out);
+        return NULL;
+    }
+    return out;
+}
+
+int rc_is_function(const char *name)
+{
+    return rc_lookup(name, strlen(name), RC_FUNCTION) != NULL;
+}
+
+int rc_call(char **argv)
+{
+    rc_def *fn = rc_lookup(argv[0], strlen(argv[0]), RC_FUNCTION);
+    script *prog;
+    char **params;
+    int n = 0;
+
+    if (fn == NULL)
+    {
+        return 127;
+    }
+    if (depth == RC_MAX_DEPTH)
+    {
+        fprintf(stderr, "%s: functions nested too deeply\n", argv[0]);
+        return last_status = 1;
+    }
+
+    // compiled on the first call; a call from inside gets its own copy
+    prog = fn->running == 0 ? fn->prog : NULL;
+    if (prog == NULL)
+    {
+        char *body = strndup(fn->text, fn->len);
+        int status = script_compile(body, &prog);
+        free(body);
+        if (status != SCRIPT_OK)
+        {
+            if (status == SCRIPT_INCOMPLETE)
+                fprintf(stderr, "%s: syntax error: unexpected end of input\n", argv[0]);
+            return last_status = 2;
+        }
+        if (fn->running == 0)
+            fn->prog = prog;
+    }
+
+    while (argv[n + 1] != NULL)
+    {
+        n++;
+    }
+    params = malloc((n + 1) * sizeof(char *));
+    for (int i = 0; i < n; i++)
+    {
+        params[i] = strdup(argv[i + 1]);
+    }
+    params[n] = NULL;
+
+    char **old = vars_set_positional(params);
+    fn->running++;
+    depth++;
+    script_run(prog);
+    depth--;
+    fn->running--;
+    vars_set_positional(old);
+
+    for (int i = 0; i < n; i++)
+    {
+        free(params[i]);
+    }
+    free(params);
+    if (prog != fn->prog)
+    {
+        script_free(prog);
+    }
+    return last_status;
+}
+
+/* Prints an alias so that it can be read back */
+static void print_alias(rc_def *def)
+{
+    printf("alias %s='", def->name);
+    for (const char *s = alias_value(def); *s != '\0'; s++)
+    {
+        if (*s == '\'')
+            fputs("'\\''", stdout);
+        else
+            putchar(*s);
+    }
+    printf("'\n");
+}
+
+static int compare_defs(const void *a, const void *b)
+{
+    return strcmp((*(rc_def *const *)a)->name, (*(rc_def *const *)b)->name);
+}
+
+int builtin_alias(command *cmd)
+{
+    int status = 0;
+
+    if (cmd->argv[1] == NULL)
+    {
+        rc_def **sorted = malloc((n_aliases + 1) * sizeof(rc_def *));
+        int n = 0;
+        for (int b = 0; b < RC_BUCKETS; b++)
+        {
+            for (rc_def *def = table[b]; def != NULL; def = def->next)
+            {
+                if (def->kind == RC_ALIAS)
+                    sorted[n++] = def;
+            }
+        }
+        qsort(sorted, n, sizeof(rc_def *), compare_defs);
+        for (int i = 0; i < n; i++)
+        {
+            print_alias(sorted[i]);
+        }
+        free(sorted);
+        return 0;
+    }
+
+    for (int i = 1; cmd->argv[i] != NULL; i++)
+    {
+        const char *eq = strchr(cmd->argv[i], '=');
+        if (eq != NULL)
+        {
+            rc_def *def = rc_define(cmd->argv[i], eq - cmd->argv[i], RC_ALIAS);
+            def->value = strdup(eq + 1);
+            continue;
+        }
+        rc_def *def = rc_lookup(cmd->argv[i], strlen(cmd->argv[i]), RC_ALIAS);
+        if (def != NULL)
+        {
+            print_alias(def);
+        }
+        else
+        {
+            fprintf(stderr, "alias: %s: not found\n", cmd->argv[i]);
+            status = 1;
+        }
+    }
+    return status;
+}
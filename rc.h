@@ -0,0 +1,124 @@
+#ifndef RC_H
+#define RC_H
+
+/*
+ * Rc.h
+ * The startup file ~/.simpleshrc, run by the interactive shell before
+ * the first prompt, and the aliases and functions it defines, which are
+ * indexed when the file is read and parsed when first used
+ * Authors : Aloysious Kok & Gerald
+ * Last Update : 18/10/26
+ */
+
+#include <stdint.h>
+#include "shell.h"
+
+/* Name of the startup file in $HOME, unless SIMPLESHRC names one */
+#define RC_FILE_NAME ".simpleshrc"
+
+/* Command line flag: report the time spent in each section of the file */
+#define RC_PROFILE_FLAG "--startup-profile"
+
+/* A comment line starting with this names the section that follows */
+#define RC_SECTION_MARK "## "
+
+/* Most sections reported on; later ones count towards the last */
+#define RC_MAX_SECTIONS 64
+
+/* Buckets of the table of aliases and functions */
+#define RC_BUCKETS 4096
+
+/* Deepest nesting of function calls */
+#define RC_MAX_DEPTH 100
+
+/* void rc_load(uint64_t start, int profile)
+ *
+ * This function reads the startup file and runs it, a section at a
+ * time. Lines of the form
+ *      alias name=value
+ *      name() { ... }
+ * are only indexed: the text of the value or body is remembered and
+ * parsed when the alias or function is first used, so startup does not
+ * grow with the number of definitions. The body of a function ends at
+ * the first line holding just '}', or with the line itself when the
+ * '{' is followed by commands. Everything else runs as a script. With
+ * profile set, the time spent in each section is printed on stderr.
+ *
+ * Arguments :
+ *      start - metrics_now() when the shell started
+ *      profile - RC_PROFILE_FLAG was given
+ *
+ * Returns :
+ *      None
+ */
+void rc_load(uint64_t start, int profile);
+
+/* void rc_first_prompt()
+ *
+ * This function is called when the first prompt has been rendered.
+ * With RC_PROFILE_FLAG it prints the time since the shell started.
+ *
+ * Returns :
+ *      None
+ */
+void rc_first_prompt();
+
+/* char *rc_expand_aliases(const char *line)
+ *
+ * This function replaces the first word of every statement of a line,
+ * the words after ';', '|' and '&', by the value of the alias it names.
+ * Quoted words and words inside (...) are left alone, and a value is
+ * not expanded again.
+ *
+ * Arguments :
+ *      line - a command line or simple statement, before parsing
+ *
+ * Returns :
+ *      the line with the aliases replaced, to be freed by the caller
+ *      NULL - no alias was used, line stands as it is
+ */
+char *rc_expand_aliases(const char *line);
+
+/* int rc_is_function(const char *name)
+ *
+ * Checks whether a command name is a function from the startup file.
+ *
+ * Returns :
+ *      1 - name is a function
+ *      0 - otherwise
+ */
+int rc_is_function(const char *name);
+
+/* int rc_call(char **argv)
+ *
+ * This function runs a function in the current shell, with the
+ * arguments as its positional parameters $1, $2, ... The body is
+ * compiled on the first call and kept; a function calling itself gets
+ * a fresh copy for the inner call.
+ *
+ * Arguments :
+ *      argv - the function name and its arguments, expanded
+ *
+ * Returns :
+ *      the exit status of the last command of the body
+ *      2 - the body could not be compiled
+ */
+int rc_call(char **argv);
+
+/* int builtin_alias(command *cmd)
+ *
+ * alias [name[=value]]...
+ * This function defines the aliases given with a value, prints those
+ * given without one, and with no arguments prints every alias, in a
+ * form that can be read back.
+ *
+ * Arguments :
+ *      cmd - the command struct to be processed
+ *
+ * Returns :
+ *      0 - success
+ *      1 - an alias to print does not exist
+ */
+int builtin_alias(command *cmd);
+
+#endif
@@ -0,0 +1,965 @@
+/*
+ * Script.c
+ * Compiles compound commands into a compact bytecode and runs them with a
+ * small interpreter loop. Simple statements are parsed only once, when the
+ * program is compiled, so loop bodies are never re-tokenized.
+ * Authors : Aloysious Kok & Gerald
+ * Last Update : 18/10/26
+ */
+
+#include <ctype.h>
+#include <fnmatch.h>
+#include <sys/mman.h>
+#include "script.h"
+#include "vars.h"
+#include "rc.h"
+#include "par.h"
+
+/* Token types produced by the lexer */
+enum tok_type
+{
+    TOK_WORD,
+    TOK_SEMI,
+    TOK_DSEMI,
+    TOK_NEWLINE,
+    TOK_AMP,
+    TOK_PIPE,
+    TOK_LPAREN,
+    TOK_RPAREN,
+    TOK_EOF,
+};
+
+typedef struct Token_struct
+{
+    int type;
+    const char *start;
+    const char *end;
+} token;
+
+/* Pending break jumps of the innermost enclosing loop */
+typedef struct Loop_ctx_struct
+{
+    int continue_target;
+    int *breaks;
+    int n_breaks;
+    struct Loop_ctx_struct *outer;
+} loop_ctx;
+
+typedef struct Compiler_struct
+{
+    const char *pos;
+    script *prog;
+    loop_ctx *loop;
+    int status;
+} compiler;
+
+// words that start a compound command
+static const char *compound_words[] = {"if", "while", "until", "for", "case"};
+
+// words that may only appear where a compound command expects them
+static const char *reserved_words[] = {"then", "elif", "else", "fi", "do", "done", "esac"};
+
+static int compile_list(compiler *c, const char **stops, int n_stops);
+
+static int in_list(const char *word, size_t len, const char **list, int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        if (strlen(list[i]) == len && strncmp(word, list[i], len) == 0)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Returns the end of the word starting at p. Quotes, backslash escapes
+ * and $(...) / `...` / <(...) / >(...) substitutions are kept inside the word. Sets
+ * *incomplete if the text ends inside a quote or substitution.
+ */
+static const char *scan_word(const char *p, int *incomplete)
+{
+    while (*p != '\0' && !isspace((unsigned char)*p) && strchr(";&|()", *p) == NULL)
+    {
+        if (*p == '\\')
+        {
+            p += (p[1] != '\0') ? 2 : 1;
+        }
+        else if (*p == '\'' || *p == '"' || *p == '`')
+        {
+            char quote = *p++;
+            while (*p != '\0' && *p != quote)
+            {
+                if (*p == '\\' && quote != '\'' && p[1] != '\0')
+                    p++;
+                p++;
+            }
+            if (*p == '\0')
+            {
+                *incomplete = 1;
+                return p;
+            }
+            p++;
+        }
+        else if ((*p == '$' && p[1] == '(') || IS_PROC_SUBST(p))
+        {
+            int depth = 0;
+            p++;
+            do
+            {
+                if (*p == '(')
+                    depth++;
+                else if (*p == ')')
+                    depth--;
+                else if (*p == '\'' || *p == '"')
+                {
+                    char quote = *p++;
+                    while (*p != '\0' && *p != quote)
+                        p++;
+                    if (*p == '\0')
+                        break;
+                }
+                p++;
+            } while (*p != '\0' && depth > 0);
+            if (depth > 0)
+            {
+                *incomplete = 1;
+                return p;
+            }
+        }
+        else
+        {
+            p++;
+        }
+    }
+    return p;
+}
+
+/* Reads the next token without consuming it */
+static token peek_token(compiler *c)
+{
+    token t;
+    const char *p = c->pos;
+    int incomplete = 0;
+
+    // skip blanks and comments
+    while (*p == ' ' || *p == '\t' || (*p == '\\' && p[1] == '\n'))
+    {
+        p += (*p == '\\') ? 2 : 1;
+    }
+    if (*p == '#')
+    {
+        while (*p != '\0' && *p != '\n')
+            p++;
+    }
+
+    t.start = p;
+    switch (*p)
+    {
+    case '\0':
+        t.type = TOK_EOF;
+        t.end = p;
+        return t;
+    case '\n':
+        t.type = TOK_NEWLINE;
+        t.end = p + 1;
+        return t;
+    case ';':
+        t.type = (p[1] == ';') ? TOK_DSEMI : TOK_SEMI;
+        t.end = p + ((p[1] == ';') ? 2 : 1);
+        return t;
+    case '&':
+        t.type = TOK_AMP;
+        t.end = p + 1;
+        return t;
+    case '|':
+        t.type = TOK_PIPE;
+        t.end = p + 1;
+        return t;
+    case '(':
+        t.type = TOK_LPAREN;
+        t.end = p + 1;
+        return t;
+    case ')':
+        t.type = TOK_RPAREN;
+        t.end = p + 1;
+        return t;
+    }
+
+    t.type = TOK_WORD;
+    t.end = scan_word(p, &incomplete);
+    if (incomplete)
+    {
+        // an open quote behaves like the end of the text
+        t.type = TOK_EOF;
+        t.start = t.end;
+    }
+    return t;
+}
+
+static token next_token(compiler *c)
+{
+    token t = peek_token(c);
+    c->pos = t.end;
+    return t;
+}
+
+static int is_word(token t, const char *word)
+{
+    return t.type == TOK_WORD && in_list(t.start, t.end - t.start, &word, 1);
+}
+
+/* Records a syntax error, or an incomplete program if t is the end */
+static int syntax_error(compiler *c, token t)
+{
+    if (t.type == TOK_EOF)
+    {
+        c->status = SCRIPT_INCOMPLETE;
+    }
+    else
+    {
+        fprintf(stderr, "syntax error near '%.*s'\n",
+                t.type == TOK_NEWLINE ? 7 : (int)(t.end - t.start),
+                t.type == TOK_NEWLINE ? "newline" : t.start);
+        c->status = SCRIPT_ERROR;
+    }
+    return -1;
+}
+
+static int expect_word(compiler *c, const char *word)
+{
+    token t = next_token(c);
+
+    if (!is_word(t, word))
+    {
+        return syntax_error(c, t);
+    }
+    return 0;
+}
+
+static void skip_newlines(compiler *c)
+{
+    while (peek_token(c).type == TOK_NEWLINE)
+    {
+        next_token(c);
+    }
+}
+
+static int emit(compiler *c, int op, int a, int b)
+{
+    script *prog = c->prog;
+
+    prog->code = realloc(prog->code, (prog->n_code + 1) * sizeof(instr));
+    prog->code[prog->n_code].op = op;
+    prog->code[prog->n_code].a = a;
+    prog->code[prog->n_code].b = b;
+    return prog->n_code++;
+}
+
+/*
+ * Adds a copy of the word, as written, to the string table. Words are
+ * expanded each time the instruction using them runs.
+ */
+static int add_string(compiler *c, const char *start, const char *end)
+{
+    script *prog = c->prog;
+
+    prog->strings = realloc(prog->strings, (prog->n_strings + 1) * sizeof(char *));
+    prog->strings[prog->n_strings] = strndup(start, end - start);
+    return prog->n_strings++;
+}
+
+/*
+ * Compiles a simple statement: everything up to the next ';', ';;' or
+ * newline, which process_cmd_line() turns into a command stack once.
+ */
+static int compile_simple(compiler *c)
+{
+    script *prog = c->prog;
+    const char *start = c->pos;
+    const char *end;
+    token t;
+
+    while (1)
+    {
+        t = peek_token(c);
+        if (t.type == TOK_WORD || t.type == TOK_PIPE)
+        {
+            next_token(c);
+        }
+        else if (t.type == TOK_AMP)
+        {
+            next_token(c);
+            // 'cmd & done' and 'cmd & for ...' end the statement at the '&'
+            t = peek_token(c);
+            if (t.type == TOK_WORD && (in_list(t.start, t.end - t.start, reserved_words,
+                                               sizeof(reserved_words) / sizeof(reserved_words[0])) ||
+                                       in_list(t.start, t.end - t.start, compound_words,
+                                               sizeof(compound_words) / sizeof(compound_words[0]))))
+            {
+                break;
+            }
+        }
+        else if (t.type == TOK_LPAREN || t.type == TOK_RPAREN)
+        {
+            return syntax_error(c, t);
+        }
+        else
+        {
+            break;
+        }
+    }
+    end = c->pos;
+
+    // trim surrounding blanks before handing the text to the parser
+    while (start < end && isspace((unsigned char)*start))
+        start++;
+    while (end > start && isspace((unsigned char)end[-1]))
+        end--;
+
+    char *text = strndup(start, end - start);
+    char *aliased = text != NULL ? rc_expand_aliases(text) : NULL;
+    if (aliased != NULL)
+    {
+        free(text);
+        text = aliased;
+    }
+    if (!text)
+    {
+        fprintf(stderr, "Memory allocation failed\n");
+        c->status = SCRIPT_ERROR;
+        return -1;
+    }
+    if (strlen(text) >= MIN_LENGTH && check_cmd_input(text) != 0)
+    {
+        fprintf(stderr, "Error: command line syntax: %s\n", text);
+        free(text);
+        c->status = SCRIPT_ERROR;
+        return -1;
+    }
+
+    prog->stacks = realloc(prog->stacks, (prog->n_stacks + 1) * sizeof(command **));
+    prog->stacks[prog->n_stacks] = process_cmd_line(text, 1);
+    free(text);
+    if (prog->stacks[prog->n_stacks] == NULL)
+    {
+        c->status = SCRIPT_ERROR;
+        return -1;
+    }
+    emit(c, OP_RUN, prog->n_stacks++, 0);
+    return 0;
+}
+
+/* if list; then list; [elif list; then list;]... [else list;] fi */
+static int compile_if(compiler *c)
+{
+    static const char *cond_stops[] = {"then"};
+    static const char *body_stops[] = {"elif", "else", "fi"};
+    static const char *else_stops[] = {"fi"};
+    int end_jumps[64];
+    int n_end = 0;
+    int skip;
+    token t;
+
+    do
+    {
+        if (compile_list(c, cond_stops, 1) < 0 || expect_word(c, "then") < 0)
+            return -1;
+        skip = emit(c, OP_JFALSE, -1, 0);
+        if (compile_list(c, body_stops, 3) < 0)
+            return -1;
+        if (n_end == sizeof(end_jumps) / sizeof(end_jumps[0]))
+        {
+            fprintf(stderr, "syntax error: too many elif branches\n");
+            c->status = SCRIPT_ERROR;
+            return -1;
+        }
+        end_jumps[n_end++] = emit(c, OP_JMP, -1, 0);
+        c->prog->code[skip].a = c->prog->n_code;
+        t = next_token(c);
+    } while (is_word(t, "elif"));
+
+    if (is_word(t, "else"))
+    {
+        if (compile_list(c, else_stops, 1) < 0)
+            return -1;
+        t = next_token(c);
+    }
+    else
+    {
+        // no branch taken: the if command succeeds
+        emit(c, OP_STATUS, 0, 0);
+    }
+
+    if (!is_word(t, "fi"))
+    {
+        return syntax_error(c, t);
+    }
+    for (int i = 0; i < n_end; i++)
+    {
+        c->prog->code[end_jumps[i]].a = c->prog->n_code;
+    }
+    return 0;
+}
+
+/* Compiles 'do list; done' as the body of the innermost loop */
+static int compile_loop_body(compiler *c, loop_ctx *loop)
+{
+    static const char *body_stops[] = {"done"};
+    int status;
+
+    skip_newlines(c);
+    loop->outer = c->loop;
+    c->loop = loop;
+    status = expect_word(c, "do");
+    if (status == 0)
+        status = compile_list(c, body_stops, 1);
+    if (status == 0)
+        status = expect_word(c, "done");
+    c->loop = loop->outer;
+    return status;
+}
+
+/* Points every break of the loop at the current end of the program */
+static void patch_breaks(compiler *c, loop_ctx *loop)
+{
+    for (int i = 0; i < loop->n_breaks; i++)
+    {
+        c->prog->code[loop->breaks[i]].a = c->prog->n_code;
+    }
+    free(loop->breaks);
+}
+
+/* while list; do list; done   and   until list; do list; done */
+static int compile_while(compiler *c, int until)
+{
+    static const char *cond_stops[] = {"do"};
+    loop_ctx loop = {0};
+    int exit_jump;
+
+    loop.continue_target = c->prog->n_code;
+    if (compile_list(c, cond_stops, 1) < 0)
+        return -1;
+    exit_jump = emit(c, until ? OP_JTRUE : OP_JFALSE, -1, 0);
+    if (compile_loop_body(c, &loop) < 0)
+    {
+        free(loop.breaks);
+        return -1;
+    }
+    emit(c, OP_JMP, loop.continue_target, 0);
+
+    // leaving through the condition is not a failure of the loop
+    c->prog->code[exit_jump].a = c->prog->n_code;
+    emit(c, OP_STATUS, 0, 0);
+    patch_breaks(c, &loop);
+    return 0;
+}
+
+/* for name in words; do list; done */
+static int compile_for(compiler *c)
+{
+    script *prog = c->prog;
+    loop_ctx loop = {0};
+    script_loop *fl;
+    int index;
+    int next;
+    token t;
+
+    t = next_token(c);
+    if (t.type != TOK_WORD)
+        return syntax_error(c, t);
+
+    prog->loops = realloc(prog->loops, (prog->n_loops + 1) * sizeof(script_loop));
+    index = prog->n_loops++;
+    fl = &prog->loops[index];
+    fl->var = add_string(c, t.start, t.end);
+    fl->first_word = prog->n_strings;
+    fl->n_words = 0;
+
+    skip_newlines(c);
+    if (expect_word(c, "in") < 0)
+        return -1;
+    while ((t = peek_token(c)).type == TOK_WORD)
+    {
+        next_token(c);
+        add_string(c, t.start, t.end);
+        prog->loops[index].n_words++;
+    }
+    if (t.type != TOK_SEMI && t.type != TOK_NEWLINE)
+        return syntax_error(c, t);
+    next_token(c);
+
+    emit(c, OP_FOR_INIT, index, 0);
+    loop.continue_target = c->prog->n_code;
+    next = emit(c, OP_FOR_NEXT, index, -1);
+    if (compile_loop_body(c, &loop) < 0)
+    {
+        free(loop.breaks);
+        return -1;
+    }
+    emit(c, OP_JMP, loop.continue_target, 0);
+    c->prog->code[next].b = c->prog->n_code;
+    patch_breaks(c, &loop);
+    return 0;
+}
+
+/* case word in [(]pattern[|pattern]...) list ;; ... esac */
+static int compile_case(compiler *c)
+{
+    static const char *item_stops[] = {"esac"};
+    int end_jumps[256];
+    int n_end = 0;
+    token t;
+
+    t = next_token(c);
+    if (t.type != TOK_WORD)
+        return syntax_error(c, t);
+    emit(c, OP_SUBJECT, add_string(c, t.start, t.end), 0);
+    skip_newlines(c);
+    if (expect_word(c, "in") < 0)
+        return -1;
+
+    while (1)
+    {
+        int matches[64];
+        int n_matches = 0;
+        int next_item;
+
+        skip_newlines(c);
+        t = next_token(c);
+        if (is_word(t, "esac"))
+            break;
+        if (t.type == TOK_LPAREN)
+            t = next_token(c);
+
+        // pattern list, each alternative jumps to the item body
+        while (1)
+        {
+            if (t.type != TOK_WORD || n_matches == sizeof(matches) / sizeof(matches[0]))
+                return syntax_error(c, t);
+            matches[n_matches++] = emit(c, OP_CASE, add_string(c, t.start, t.end), -1);
+            t = next_token(c);
+            if (t.type == TOK_RPAREN)
+                break;
+            if (t.type != TOK_PIPE)
+                return syntax_error(c, t);
+            t = next_token(c);
+        }
+
+        next_item = emit(c, OP_JMP, -1, 0);
+        for (int i = 0; i < n_matches; i++)
+        {
+            c->prog->code[matches[i]].b = c->prog->n_code;
+        }
+        if (compile_list(c, item_stops, 1) < 0)
+            return -1;
+        if (n_end == sizeof(end_jumps) / sizeof(end_jumps[0]))
+        {
+            fprintf(stderr, "syntax error: too many case items\n");
+            c->status = SCRIPT_ERROR;
+            return -1;
+        }
+        end_jumps[n_end++] = emit(c, OP_JMP, -1, 0);
+        c->prog->code[next_item].a = c->prog->n_code;
+
+        t = next_token(c);
+        if (is_word(t, "esac"))
+            break;
+        if (t.type != TOK_DSEMI)
+            return syntax_error(c, t);
+    }
+
+    // no pattern matched: the case command succeeds
+    emit(c, OP_STATUS, 0, 0);
+    for (int i = 0; i < n_end; i++)
+    {
+        c->prog->code[end_jumps[i]].a = c->prog->n_code;
+    }
+    return 0;
+}
+
+/* break and continue jump out of / back to the innermost loop */
+static int compile_loop_jump(compiler *c, int is_break)
+{
+    token t = peek_token(c);
+    loop_ctx *loop = c->loop;
+
+    if (t.type == TOK_WORD)
+        return syntax_error(c, t);
+    if (loop == NULL)
+    {
+        // outside a loop these do nothing
+        emit(c, OP_STATUS, 0, 0);
+        return 0;
+    }
+    if (is_break)
+    {
+        loop->breaks = realloc(loop->breaks, (loop->n_breaks + 1) * sizeof(int));
+        loop->breaks[loop->n_breaks++] = emit(c, OP_JMP, -1, 0);
+    }
+    else
+    {
+        emit(c, OP_JMP, loop->continue_target, 0);
+    }
+    return 0;
+}
+
+/*
+ * Compiles statements until one of the stop words is found in command
+ * position (it is left unconsumed) or ';;' or the end of the text.
+ */
+static int compile_list(compiler *c, const char **stops, int n_stops)
+{
+    token t;
+
+    while (1)
+    {
+        t = peek_token(c);
+        if (t.type == TOK_SEMI || t.type == TOK_NEWLINE)
+        {
+            next_token(c);
+            continue;
+        }
+        if (t.type == TOK_EOF || t.type == TOK_DSEMI)
+        {
+            return 0;
+        }
+        if (t.type != TOK_WORD)
+        {
+            next_token(c);
+            return syntax_error(c, t);
+        }
+
+        size_t len = t.end - t.start;
+        if (in_list(t.start, len, stops, n_stops))
+        {
+            return 0;
+        }
+        if (in_list(t.start, len, reserved_words, sizeof(reserved_words) / sizeof(reserved_words[0])))
+        {
+            next_token(c);
+            return syntax_error(c, t);
+        }
+
+        int status;
+        if (is_word(t, "if"))
+        {
+            next_token(c);
+            status = compile_if(c);
+        }
+        else if (is_word(t, "while") || is_word(t, "until"))
+        {
+            next_token(c);
+            status = compile_while(c, is_word(t, "until"));
+        }
+        else if (is_word(t, "for"))
+        {
+            next_token(c);
+            status = compile_for(c);
+        }
+        else if (is_word(t, "case"))
+        {
+            next_token(c);
+            status = compile_case(c);
+        }
+        else if (is_word(t, "break") || is_word(t, "continue"))
+        {
+            next_token(c);
+            status = compile_loop_jump(c, is_word(t, "break"));
+        }
+        else
+        {
+            status = compile_simple(c);
+        }
+        if (status < 0)
+        {
+            return -1;
+        }
+    }
+}
+
+int script_is_compound(const char *line)
+{
+    const char *p = line;
+    char quote = 0;
+    int start = 1; // at the start of a statement
+
+    // a keyword may start any statement of the line, not just the first;
+    // a line taken as compound by mistake still compiles as simple ones
+    while (*p != '\0')
+    {
+        if (quote != 0)
+        {
+            if (*p == '\\' && quote == '"' && p[1] != '\0')
+                p++;
+            else if (*p == quote)
+                quote = 0;
+            p++;
+            continue;
+        }
+        if (*p == ' ' || *p == '\t')
+        {
+            p++;
+            continue;
+        }
+        // compile_simple() ends a statement there, not at '&&' or '|'
+        if (*p == ';' || *p == '\n' || (*p == '&' && p[1] != '&' && (p == line || p[-1] != '&')))
+        {
+            start = 1;
+            p++;
+            continue;
+        }
+        if (start)
+        {
+            const char *end = p;
+            while (*end != '\0' && !isspace((unsigned char)*end) && strchr(";&|", *end) == NULL)
+            {
+                end++;
+            }
+            if (in_list(p, end - p, compound_words, sizeof(compound_words) / sizeof(compound_words[0])))
+                return 1;
+            start = 0;
+        }
+        if (*p == '\\' && p[1] != '\0')
+            p++;
+        else if (*p == '\'' || *p == '"')
+            quote = *p;
+        p++;
+    }
+    return 0;
+}
+
+int script_compile(const char *src, script **prog)
+{
+    compiler c = {0};
+    token t;
+
+    c.pos = src;
+    c.prog = calloc(1, sizeof(script));
+    if (!c.prog)
+    {
+        fprintf(stderr, "Memory allocation failed\n");
+        return SCRIPT_ERROR;
+    }
+
+    if (compile_list(&c, NULL, 0) == 0)
+    {
+        t = peek_token(&c);
+        if (t.type != TOK_EOF)
+        {
+            syntax_error(&c, t);
+        }
+    }
+
+    if (c.status != SCRIPT_OK)
+    {
+        script_free(c.prog);
+        return c.status;
+    }
+    *prog = c.prog;
+    return SCRIPT_OK;
+}
+
+/* Whether a command stack holds a single statement, a command or pipeline */
+static int single_statement(command **stack)
+{
+    int i = 0;
+
+    while (stack[i] != NULL && stack[i]->pipe_to > 0)
+    {
+        i++;
+    }
+    return stack[i] != NULL && stack[i + 1] == NULL;
+}
+
+/*
+ * set -o autopar: each statement of a script is a stack of its own, so
+ * the statements of consecutive OP_RUN instructions are put together
+ * for par_execute(). Returns the instruction after the batch, or 0 if
+ * no batch ran.
+ */
+static int script_run_batch(script *prog, int pc)
+{
+    command *stack[2 * PAR_MAX_STATEMENTS + 1];
+    int starts[PAR_MAX_STATEMENTS + 1];
+    int n = 0, len = 0;
+
+    for (int at = pc; at < prog->n_code && prog->code[at].op == OP_RUN && n < PAR_MAX_STATEMENTS; at++)
+    {
+        command **st = prog->stacks[prog->code[at].a];
+        int st_len = 0;
+
+        if (!single_statement(st))
+            break;
+        while (st[st_len] != NULL)
+        {
+            st_len++;
+        }
+        if (len + st_len > 2 * PAR_MAX_STATEMENTS)
+            break;
+        memcpy(&stack[len], st, st_len * sizeof(command *));
+        starts[n++] = len;
+        len += st_len;
+    }
+    if (n < 2)
+    {
+        return 0;
+    }
+    stack[len] = NULL;
+    starts[n] = len;
+
+    int next = par_execute(stack, 0);
+    for (int i = 1; i <= n && next > 0; i++)
+    {
+        if (starts[i] == next)
+            return pc + i;
+    }
+    return 0;
+}
+
+int script_run(script *prog)
+{
+    int *iter = calloc(prog->n_loops + 1, sizeof(int));
+    strlist *words = calloc(prog->n_loops + 1, sizeof(strlist));
+    char *subject = NULL;
+    char *pattern;
+    int pc = 0;
+
+    // Ctrl-C, or a command killed by it, stops the script
+    while (pc < prog->n_code && !interrupted)
+    {
+        instr *in = &prog->code[pc++];
+
+        switch (in->op)
+        {
+        case OP_RUN:
+        {
+            int next;
+            if (shell_option(OPT_AUTOPAR) && (next = script_run_batch(prog, pc - 1)) > 0)
+            {
+                pc = next;
+                break;
+            }
+            execute_stack(prog->stacks[in->a]);
+            break;
+        }
+        case OP_JMP:
+            pc = in->a;
+            break;
+        case OP_JTRUE:
+            if (last_status == 0)
+                pc = in->a;
+            break;
+        case OP_JFALSE:
+            if (last_status != 0)
+                pc = in->a;
+            break;
+        case OP_STATUS:
+            last_status = in->a;
+            break;
+        case OP_FOR_INIT:
+        {
+            // the word list is expanded once, when the loop is entered
+            script_loop *fl = &prog->loops[in->a];
+            strlist_free(&words[in->a]);
+            for (int i = 0; i < fl->n_words; i++)
+            {
+                expand_word(prog->strings[fl->first_word + i], &words[in->a]);
+            }
+            iter[in->a] = 0;
+            last_status = 0;
+            break;
+        }
+        case OP_FOR_NEXT:
+            if (iter[in->a] < words[in->a].count)
+            {
+                var_set(prog->strings[prog->loops[in->a].var], words[in->a].items[iter[in->a]++], VAR_KEEP);
+            }
+            else
+            {
+                pc = in->b;
+            }
+            break;
+        case OP_SUBJECT:
+            free(subject);
+            subject = expand_string(prog->strings[in->a], 0);
+            break;
+        case OP_CASE:
+            pattern = expand_string(prog->strings[in->a], EXP_PATTERN);
+            if (subject != NULL && pattern != NULL && fnmatch(pattern, subject, 0) == 0)
+                pc = in->b;
+            free(pattern);
+            break;
+        }
+    }
+
+    for (int i = 0; i < prog->n_loops; i++)
+    {
+        strlist_free(&words[i]);
+    }
+    free(words);
+    free(subject);
+    free(iter);
+    return last_status;
+}
+
+int script_run_text(const char *src)
+{
+    script *prog = NULL;
+    int status = script_compile(src, &prog);
+
+    if (status != SCRIPT_OK)
+    {
+        if (status == SCRIPT_INCOMPLETE)
+        {
+            fprintf(stderr, "syntax error: unexpected end of input\n");
+        }
+        last_status = 2;
+        return last_status;
+    }
+
+    script_run(prog);
+    script_free(prog);
+    return last_status;
+}
+
+void script_free(script *prog)
+{
+    if (prog == NULL)
+    {
+        return;
+    }
+    if (prog->map != NULL)
+    {
+        // only the command structures were allocated, the words are mapped
+        for (int i = 0; i < prog->n_stacks; i++)
+        {
+            for (command **stack = prog->stacks[i]; *stack != NULL; stack++)
+            {
+                free((*stack)->argv);
+                free((*stack)->redirect_tee);
+                free(*stack);
+            }
+            free(prog->stacks[i]);
+        }
+        free(prog->stacks);
+        free(prog->strings);
+        munmap(prog->map, prog->map_len);
+        free(prog);
+        return;
+    }
+    for (int i = 0; i < prog->n_stacks; i++)
+    {
+        clean_up(prog->stacks[i]);
+    }
+    for (int i = 0; i < prog->n_strings; i++)
+    {
+        free(prog->strings[i]);
+    }
+    free(prog->stacks);
+    free(prog->strings);
+    free(prog->loops);
+    free(prog->code);
+    free(prog);
+}
@@ -0,0 +1,140 @@
+#ifndef SCRIPT_H
+#define SCRIPT_H
+
+/*
+ * Script.h
+ * Compiler and interpreter for the compound commands
+ * if/then/elif/else/fi, while/until/do/done, for/in/do/done and case/esac
+ * Authors : Aloysious Kok & Gerald
+ * Last Update : 18/10/26
+ */
+
+#include "shell.h"
+
+/* Return values of script_compile() */
+#define SCRIPT_OK 0
+#define SCRIPT_INCOMPLETE 1
+#define SCRIPT_ERROR 2
+
+/* Bytecode operations */
+enum script_op
+{
+    OP_RUN,       // execute_stack(stacks[a])
+    OP_JMP,       // jump to a
+    OP_JTRUE,     // jump to a if last_status == 0
+    OP_JFALSE,    // jump to a if last_status != 0
+    OP_STATUS,    // last_status = a
+    OP_FOR_INIT,  // reset the iterator of loop a
+    OP_FOR_NEXT,  // assign the next word of loop a, or jump to b when done
+    OP_SUBJECT,   // strings[a] becomes the word tested by OP_CASE
+    OP_CASE,      // jump to b if the subject matches the pattern strings[a]
+};
+
+/* A single bytecode instruction */
+typedef struct Instr_struct
+{
+    unsigned char op;
+    int a;
+    int b;
+} instr;
+
+/* A for loop: the variable name and its word list, as string indexes */
+typedef struct Script_loop_struct
+{
+    int var;
+    int first_word;
+    int n_words;
+} script_loop;
+
+/* A compiled program. Every simple statement is parsed once into a
+ * command stack at compile time; loops only re-run the bytecode. */
+typedef struct Script_struct
+{
+    instr *code;
+    int n_code;
+    command ***stacks;
+    int n_stacks;
+    char **strings;
+    int n_strings;
+    script_loop *loops;
+    int n_loops;
+    /* The compiled file the program was loaded from (see shc.h), NULL
+     * otherwise: the code, loops and every string lie in the mapping */
+    void *map;
+    size_t map_len;
+} script;
+
+/* int script_is_compound(const char *line)
+ *
+ * This function checks whether a statement of the command line, the
+ * first or one after ';', '&' or a newline, starts with one of the compound
+ * command keywords (if, while, until, for, case).
+ *
+ * Arguments :
+ *      line - the command line read from the user
+ *
+ * Returns :
+ *      1 - the line must be compiled with script_compile()
+ *      0 - the line is a plain command line
+ */
+int script_is_compound(const char *line);
+
+/* int script_compile(const char *src, script **prog)
+ *
+ * This function compiles the source text into bytecode. Simple
+ * statements are separated by ';' or newlines and are handed to
+ * process_cmd_line(), so '&' and '|' keep their usual meaning.
+ *
+ * Arguments :
+ *      src - the source text (not modified)
+ *      prog - receives the compiled program when SCRIPT_OK is returned
+ *
+ * Returns :
+ *      SCRIPT_OK - the program was compiled
+ *      SCRIPT_INCOMPLETE - the text ends inside a compound command
+ *      SCRIPT_ERROR - syntax error (a message has been printed)
+ */
+int script_compile(const char *src, script **prog);
+
+/* int script_run(script *prog)
+ *
+ * This function executes a compiled program with a small interpreter
+ * loop over its bytecode.
+ *
+ * Arguments :
+ *      prog - the program to execute
+ *
+ * Returns :
+ *      the exit status of the last command executed
+ */
+int script_run(script *prog);
+
+/* int script_run_text(const char *src)
+ *
+ * This function compiles the source text, runs it and frees the
+ * program. Used where a complete piece of text has to be executed,
+ * such as the body of a command substitution.
+ *
+ * Arguments :
+ *      src - the source text
+ *
+ * Returns :
+ *      the exit status of the last command executed
+ *      2 - the text could not be compiled
+ */
+int script_run_text(const char *src);
+
+/* void script_free(script *prog)
+ *
+ * This function frees a compiled program and its command stacks, and
+ * unmaps the file it was loaded from, if any.
+ *
+ * Arguments :
+ *      prog - the program to free (may be NULL)
+ *
+ * Returns :
+ *      None
+ */
+void script_free(script *prog);
+
+#endif
@@ -0,0 +1,294 @@
+/*
+ * Serve.c
+ * The daemon and its client. The daemon forks one worker per connection
+ * and the worker is the session: cd, export and background jobs change
+ * the worker process only, exactly as they would change an interactive
+ * shell, so sessions are isolated without any state being copied around.
+ * A line runs with the client's descriptors as stdin, stdout and stderr,
+ * so output is streamed by the kernel rather than relayed by the daemon.
+ * Authors : Aloysious Kok & Gerald
+ * Last Update : 18/10/26
+ */
+
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "serve.h"
+#include "parser.h"
+#include "script.h"
+#include "common.h"
+
+/* Closes every descriptor a message carried, for a message that is refused */
+static void close_passed_fds(struct msghdr *msg)
+{
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL; cmsg = CMSG_NXTHDR(msg, cmsg))
+    {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+            continue;
+        size_t n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (size_t i = 0; i < n; i++)
+        {
+            int fd;
+            memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(fd));
+            close(fd);
+        }
+    }
+}
+
+/* Runs in a worker: serves the lines of one connection, then exits */
+static void serve_session(int conn)
+{
+    char *line = malloc(SERVE_LINE_MAX);
+    char control[CMSG_SPACE(3 * sizeof(int))];
+    int null = open("/dev/null", O_RDWR | O_CLOEXEC);
+
+    // between lines the standard descriptors lead nowhere
+    for (int i = 0; i < 3; i++)
+    {
+        dup2(null, i);
+    }
+
+    while (1)
+    {
+        struct iovec iov = {line, SERVE_LINE_MAX - 1};
+        struct msghdr msg = {0};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        ssize_t n = recvmsg(conn, &msg, MSG_CMSG_CLOEXEC);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break; // the client has gone
+
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        int fds[3];
+        serve_reply reply = {2};
+        if (cmsg == NULL || cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(3 * sizeof(int)) ||
+            (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)))
+        {
+            // the descriptors passed are not used, they must not pile up
+            close_passed_fds(&msg);
+            send(conn, &reply, sizeof(reply), MSG_NOSIGNAL);
+            continue;
+        }
+        memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+        line[n] = '\0';
+
+        for (int i = 0; i < 3; i++)
+        {
+            dup2(fds[i], i);
+        }
+        for (int i = 0; i < 3; i++)
+        {
+            if (fds[i] > 2)
+                close(fds[i]);
+        }
+
+        if (script_is_compound(line) || strchr(line, '\n') != NULL)
+            script_run_text(line);
+        else
+            run_line(line);
+
+        fflush(stdout);
+        fflush(stderr);
+        for (int i = 0; i < 3; i++)
+        {
+            dup2(null, i);
+        }
+        reply.status = last_status;
+        send(conn, &reply, sizeof(reply), MSG_NOSIGNAL);
+    }
+    exit(last_status);
+}
+
+void serve_main(int argc, char **argv)
+{
+    struct epoll_event ev, events[SERVE_EVENTS];
+    sigset_t mask, old_mask;
+    int workers = SERVE_WORKERS;
+    int n_workers = 0;
+    int accepting = 1;
+
+    if (argc == 5 && strcmp(argv[3], "-j") == 0)
+    {
+        workers = atoi(argv[4]);
+    }
+    if ((argc != 3 && argc != 5) || workers < 1)
+    {
+        fprintf(stderr, "usage: shell %s socket [-j workers]\n", SERVE_FLAG);
+        exit(2);
+    }
+    int sock = unix_listen(argv[2], SOCK_SEQPACKET | SOCK_NONBLOCK, SOMAXCONN);
+    if (sock < 0)
+    {
+        exit(EXIT_FAILURE);
+    }
+
+    // worker exits are read from a signalfd in the same epoll as accepts
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, &old_mask);
+    signal(SIGCHLD, SIG_DFL);
+    signal(SIGPIPE, SIG_IGN);
+    int sfd = signalfd(-1, &mask, SFD_CLOEXEC);
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    ev.events = EPOLLIN;
+    ev.data.fd = sock;
+    epoll_ctl(ep, EPOLL_CTL_ADD, sock, &ev);
+    ev.data.fd = sfd;
+    epoll_ctl(ep, EPOLL_CTL_ADD, sfd, &ev);
+
+    printf("Serving on %s, %d workers at most\n", argv[2], workers);
+    fflush(stdout);
+
+    while (1)
+    {
+        int n = epoll_wait(ep, events, SERVE_EVENTS, -1);
+        if (n == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("epoll_wait");
+            exit(EXIT_FAILURE);
+        }
+
+        for (int i = 0; i < n; i++)
+        {
+            if (events[i].data.fd == sfd)
+            {
+                struct signalfd_siginfo si;
+                read(sfd, &si, sizeof(si));
+                while (waitpid(-1, NULL, WNOHANG) > 0)
+                    n_workers--;
+                continue;
+            }
+
+            while (n_workers < workers)
+            {
+                int conn = accept4(sock, NULL, NULL, SOCK_CLOEXEC);
+                if (conn == -1)
+                    break;
+
+                pid_t pid = fork();
+                if (pid == 0)
+                {
+                    close(sock);
+                    close(sfd);
+                    close(ep);
+                    sigprocmask(SIG_SETMASK, &old_mask, NULL);
+                    setup_signal_handlers();
+                    signal(SIGPIPE, SIG_DFL);
+                    serve_session(conn);
+                }
+                close(conn);
+                if (pid > 0)
+                    n_workers++;
+                else
+                    perror("fork");
+            }
+        }
+
+        // at the limit the listen socket is left out of the epoll set, and
+        // new connections wait in its queue until a worker exits
+        if (accepting != (n_workers < workers))
+        {
+            accepting = n_workers < workers;
+            ev.events = accepting ? EPOLLIN : 0;
+            ev.data.fd = sock;
+            epoll_ctl(ep, EPOLL_CTL_MOD, sock, &ev);
+        }
+    }
+}
+
+/* Sends one line with the descriptors it is to run with */
+static int serve_send(int sock, const char *line, const int *fds)
+{
+    char control[CMSG_SPACE(3 * sizeof(int))] = {0};
+    struct iovec iov = {(void *)line, strlen(line)};
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(3 * sizeof(int));
+    memcpy(CMSG_DATA(cmsg), fds, 3 * sizeof(int));
+
+    if (sendmsg(sock, &msg, MSG_NOSIGNAL) != (ssize_t)iov.iov_len)
+    {
+        return -1;
+    }
+    serve_reply reply;
+    ssize_t n;
+    while ((n = recv(sock, &reply, sizeof(reply), 0)) == -1 && errno == EINTR)
+        ;
+    return n == sizeof(reply) ? reply.status : -1; // -1: the session is over
+}
+
+void serve_connect(const char *path, char **lines)
+{
+    struct sockaddr_un addr;
+    int status = 0;
+
+    if (path == NULL || unix_address(path, &addr) < 0)
+    {
+        exit(2);
+    }
+    int sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (sock == -1 || connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+    {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+
+    if (lines[0] != NULL)
+    {
+        int fds[3] = {0, 1, 2};
+        for (int i = 0; lines[i] != NULL; i++)
+        {
+            if (strlen(lines[i]) >= SERVE_LINE_MAX)
+            {
+                fprintf(stderr, "line too long\n");
+                continue;
+            }
+            int result = serve_send(sock, lines[i], fds);
+            if (result < 0)
+                break;
+            status = result;
+        }
+    }
+    else
+    {
+        // stdin carries the lines, so the commands get /dev/null
+        int fds[3] = {open("/dev/null", O_RDONLY | O_CLOEXEC), 1, 2};
+        char *line = NULL;
+        size_t size = 0;
+        ssize_t len;
+        while ((len = getline(&line, &size, stdin)) != -1)
+        {
+            if (len > 0 && line[len - 1] == '\n')
+                line[--len] = '\0';
+            if (len == 0)
+                continue;
+            if (len >= SERVE_LINE_MAX)
+            {
+                fprintf(stderr, "line too long\n");
+                continue;
+            }
+            int result = serve_send(sock, line, fds);
+            if (result < 0)
+                break;
+            status = result;
+        }
+        free(line);
+    }
+
+    // a session closed by the daemon (exit, for one) ends the client too
+    exit(status);
+}
@@ -0,0 +1,75 @@
+#ifndef SERVE_H
+#define SERVE_H
+
+/*
+ * Serve.h
+ * Daemon mode: a resident shell accepting command lines from local
+ * clients over a Unix domain socket, and the client side of it
+ * Authors : Aloysious Kok & Gerald
+ * Last Update : 18/10/26
+ */
+
+#include "shell.h"
+
+/* Command line flags: shell --serve socket [-j workers], and
+ * shell --connect socket [line]... */
+#define SERVE_FLAG "--serve"
+#define CONNECT_FLAG "--connect"
+
+/* Default number of connections served at once */
+#define SERVE_WORKERS 16
+
+/* Largest command line in a request, '\0' included */
+#define SERVE_LINE_MAX CMD_LENGTH
+
+/* Number of epoll events collected per epoll_wait() call */
+#define SERVE_EVENTS 16
+
+/*
+ * Protocol. The socket is SOCK_SEQPACKET: every message is one request
+ * or reply. A request is the command line, with the descriptors that
+ * become its stdin, stdout and stderr passed along as SCM_RIGHTS, so
+ * the output of the command goes straight to the client. The reply is
+ * the exit status, once the line has run. A connection is a session:
+ * its directory, variables and background jobs carry over from one
+ * line to the next and are not seen by other connections.
+ */
+typedef struct Serve_reply_struct
+{
+    int status;
+} serve_reply;
+
+/* void serve_main(int argc, char **argv)
+ *
+ * This function runs the daemon: the socket is created, connections
+ * are accepted from an epoll loop, and each one is handed to a worker,
+ * a fork of the daemon that keeps the session. While the worker limit
+ * is reached new connections wait in the listen queue. Returns only by
+ * exiting.
+ *
+ * Arguments :
+ *      argc, argv - the arguments of the shell: SERVE_FLAG, the socket
+ *                   path and optionally -j and the worker limit
+ *
+ * Returns :
+ *      None
+ */
+void serve_main(int argc, char **argv);
+
+/* void serve_connect(const char *path, char **lines)
+ *
+ * The client: sends each line to the daemon and exits with the status
+ * of the last one. Lines given as arguments get the client's stdin;
+ * without arguments the lines are read from stdin and the commands get
+ * /dev/null instead. stdout and stderr are always the client's own.
+ *
+ * Arguments :
+ *      path - the socket of the daemon
+ *      lines - the command lines, NULL terminated; may be empty
+ *
+ * Returns :
+ *      None
+ */
+void serve_connect(const char *path, char **lines);
+
+#endif
@@ -0,0 +1,449 @@
+/*
+ * Shc.c
+ * A compiled script is written section by section from growable
+ * buffers, each section starting on an 8 byte boundary so the code and
+ * loops can be used in place once mapped. The mapping is private and
+ * writable: the shell never writes to the words of a command, but a
+ * write would only touch its own copy of the page. Everything read from
+ * the file is checked against its size before it is used, so a damaged
+ * file is refused rather than followed.
+ * Authors : Aloysious Kok & Gerald
+ * Last Update : 18/10/26
+ */
+
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "shc.h"
+#include "common.h"
+
+#define SHC_ALIGN 8
+
+// a section being written
+typedef struct Shc_buf_struct
+{
+    char *data;
+    size_t len;
+    size_t cap;
+} shc_buf;
+
+static size_t buf_add(shc_buf *b, const void *p, size_t n)
+{
+    size_t at = b->len;
+
+    if (b->len + n > b->cap)
+    {
+        b->cap = (b->len + n) * 2 + 64;
+        b->data = realloc(b->data, b->cap);
+    }
+    memcpy(b->data + b->len, p, n);
+    b->len += n;
+    return at;
+}
+
+static uint32_t buf_string(shc_buf *data, const char *s)
+{
+    return s != NULL ? (uint32_t)buf_add(data, s, strlen(s) + 1) : SHC_NONE;
+}
+
+/* Lays the sections out after the header and writes the file to fd */
+static int shc_write(int fd, shc_header *h, shc_buf *sections[], uint64_t *offsets[], int n)
+{
+    static const char zeros[SHC_ALIGN] = {0};
+    uint64_t at = sizeof(shc_header);
+
+    for (int i = 0; i < n; i++)
+    {
+        at = (at + SHC_ALIGN - 1) & ~(uint64_t)(SHC_ALIGN - 1);
+        *offsets[i] = at;
+        at += sections[i]->len;
+    }
+    if (write(fd, h, sizeof(*h)) != sizeof(*h))
+    {
+        return -1;
+    }
+    at = sizeof(shc_header);
+    for (int i = 0; i < n; i++)
+    {
+        size_t pad = *offsets[i] - at;
+        if ((pad > 0 && write(fd, zeros, pad) != (ssize_t)pad) ||
+            (sections[i]->len > 0 && write(fd, sections[i]->data, sections[i]->len) != (ssize_t)sections[i]->len))
+            return -1;
+        at = *offsets[i] + sections[i]->len;
+    }
+    return 0;
+}
+
+/* Serializes a compiled program, with what identifies its source */
+static int shc_save(script *prog, const char *src, const struct stat *src_st, const char *text, size_t len,
+                    const char *out)
+{
+    shc_buf code = {0}, loops = {0}, stacks = {0}, cmds = {0}, words = {0}, strings = {0}, data = {0};
+    shc_header h = {0};
+    char real[PATH_MAX];
+    char tmp[PATH_MAX + 16];
+    uint32_t n_cmds = 0, n_words = 0;
+    int status = -1;
+
+    h.magic = SHC_MAGIC;
+    h.src_path = buf_string(&data, realpath(src, real) != NULL ? real : src);
+    h.src_mtime_sec = src_st->st_mtim.tv_sec;
+    h.src_mtime_nsec = src_st->st_mtim.tv_nsec;
+    h.src_size = src_st->st_size;
+    h.src_hash = hash64(text, len);
+
+    buf_add(&code, prog->code, prog->n_code * sizeof(instr));
+    buf_add(&loops, prog->loops, prog->n_loops * sizeof(script_loop));
+    for (int i = 0; i < prog->n_strings; i++)
+    {
+        uint32_t off = buf_string(&data, prog->strings[i]);
+        buf_add(&strings, &off, sizeof(off));
+    }
+    for (int i = 0; i < prog->n_stacks; i++)
+    {
+        shc_stack s = {n_cmds, 0};
+        for (command **stack = prog->stacks[i]; *stack != NULL; stack++, s.n_cmds++, n_cmds++)
+        {
+            command *cmd = *stack;
+            shc_cmd c = {cmd->background, cmd->sequential, cmd->pipe_to, n_words, 0, 0, 0,
+                         buf_string(&data, cmd->redirect_in), buf_string(&data, cmd->redirect_out)};
+            for (int j = 0; cmd->argv != NULL && cmd->argv[j] != NULL; j++, c.argc++, n_words++)
+            {
+                uint32_t off = buf_string(&data, cmd->argv[j]);
+                buf_add(&words, &off, sizeof(off));
+            }
+            c.first_tee = n_words;
+            for (int j = 0; cmd->redirect_tee != NULL && cmd->redirect_tee[j] != NULL; j++, c.n_tee++, n_words++)
+            {
+                uint32_t off = buf_string(&data, cmd->redirect_tee[j]);
+                buf_add(&words, &off, sizeof(off));
+            }
+            buf_add(&cmds, &c, sizeof(c));
+        }
+        buf_add(&stacks, &s, sizeof(s));
+    }
+    h.n_code = prog->n_code;
+    h.n_loops = prog->n_loops;
+    h.n_stacks = prog->n_stacks;
+    h.n_cmds = n_cmds;
+    h.n_words = n_words;
+    h.n_strings = prog->n_strings;
+    h.data_len = data.len;
+
+    snprintf(tmp, sizeof(tmp), "%s.XXXXXX", out);
+    int fd = mkstemp(tmp);
+    if (fd != -1)
+    {
+        shc_buf *sections[] = {&code, &loops, &stacks, &cmds, &words, &strings, &data};
+        uint64_t *offsets[] = {&h.code_off, &h.loops_off, &h.stacks_off, &h.cmds_off, &h.words_off, &h.strings_off,
+                               &h.data_off};
+        // the offsets are only known once the sections are laid out
+        if (shc_write(fd, &h, sections, offsets, 7) == 0 && pwrite(fd, &h, sizeof(h), 0) == sizeof(h) &&
+            fchmod(fd, 0644) == 0 && rename(tmp, out) == 0)
+        {
+            status = 0;
+        }
+        else
+        {
+            unlink(tmp);
+        }
+        close(fd);
+    }
+
+    free(code.data);
+    free(loops.data);
+    free(stacks.data);
+    free(cmds.data);
+    free(words.data);
+    free(strings.data);
+    free(data.data);
+    return status;
+}
+
+void shc_compile_main(int argc, char **argv)
+{
+    const char *src = argc >= 3 ? argv[2] : NULL;
+    char out[PATH_MAX];
+    struct stat st;
+    script *prog = NULL;
+    size_t len;
+    char *text;
+
+    if (src == NULL || (argc != 3 && (argc != 5 || strcmp(argv[3], "-o") != 0)))
+    {
+        fprintf(stderr, "usage: shell %s script [-o file%s]\n", SHC_COMPILE_FLAG, SHC_EXTENSION);
+        exit(1);
+    }
+    if (argc == 5)
+    {
+        snprintf(out, sizeof(out), "%s", argv[4]);
+    }
+    else
+    {
+        const char *dot = strrchr(src, '.');
+        int keep = dot != NULL && strchr(dot, '/') == NULL ? (int)(dot - src) : (int)strlen(src);
+        snprintf(out, sizeof(out), "%.*s%s", keep, src, SHC_EXTENSION);
+    }
+
+    if (stat(src, &st) == -1 || (text = read_whole_file(src, &len)) == NULL)
+    {
+        perror(src);
+        exit(1);
+    }
+    int status = script_compile(text, &prog);
+    if (status == SCRIPT_INCOMPLETE)
+    {
+        fprintf(stderr, "%s: syntax error: unexpected end of input\n", src);
+    }
+    if (status != SCRIPT_OK)
+    {
+        free(text);
+        exit(1);
+    }
+    if (shc_save(prog, src, &st, text, len, out) == -1)
+    {
+        perror(out);
+        status = SCRIPT_ERROR;
+    }
+    script_free(prog);
+    free(text);
+    exit(status == SCRIPT_OK ? 0 : 1);
+}
+
+/* Whether count elements of size bytes at off lie within the file */
+static int section_ok(uint64_t off, uint64_t count, size_t size, size_t file_len)
+{
+    return off % SHC_ALIGN == 0 && off <= file_len && count <= (file_len - off) / size;
+}
+
+/* Whether the source recorded in a compiled file still reads the same */
+static int shc_current(const shc_header *h, const char *src)
+{
+    struct stat st;
+    size_t len;
+    char *text;
+    int same;
+
+    if (stat(src, &st) == -1)
+    {
+        return 1;
+    }
+    if ((uint64_t)st.st_size == h->src_size && st.st_mtim.tv_sec == h->src_mtime_sec &&
+        st.st_mtim.tv_nsec == h->src_mtime_nsec)
+    {
+        return 1;
+    }
+    // touched, but perhaps not changed
+    if ((uint64_t)st.st_size != h->src_size || (text = read_whole_file(src, &len)) == NULL)
+    {
+        return 0;
+    }
+    same = len == h->src_size && hash64(text, len) == h->src_hash;
+    free(text);
+    return same;
+}
+
+/* Checks the tables of a mapped file; returns 0 if every reference is in bounds */
+static int shc_check(const char *map, size_t len)
+{
+    const shc_header *h = (const shc_header *)map;
+    const char *data = map + h->data_off;
+
+    if (!section_ok(h->code_off, h->n_code, sizeof(instr), len) ||
+        !section_ok(h->loops_off, h->n_loops, sizeof(script_loop), len) ||
+        !section_ok(h->stacks_off, h->n_stacks, sizeof(shc_stack), len) ||
+        !section_ok(h->cmds_off, h->n_cmds, sizeof(shc_cmd), len) ||
+        !section_ok(h->words_off, h->n_words, sizeof(uint32_t), len) ||
+        !section_ok(h->strings_off, h->n_strings, sizeof(uint32_t), len) || !section_ok(h->data_off, h->data_len, 1, len) ||
+        h->data_len == 0 || data[h->data_len - 1] != '\0' || h->src_path >= h->data_len)
+    {
+        return -1;
+    }
+
+    const uint32_t *words = (const uint32_t *)(map + h->words_off);
+    const uint32_t *strings = (const uint32_t *)(map + h->strings_off);
+    for (uint32_t i = 0; i < h->n_words; i++)
+    {
+        if (words[i] >= h->data_len)
+            return -1;
+    }
+    for (uint32_t i = 0; i < h->n_strings; i++)
+    {
+        if (strings[i] >= h->data_len)
+            return -1;
+    }
+
+    const shc_stack *stacks = (const shc_stack *)(map + h->stacks_off);
+    for (uint32_t i = 0; i < h->n_stacks; i++)
+    {
+        if (stacks[i].first_cmd > h->n_cmds || stacks[i].n_cmds > h->n_cmds - stacks[i].first_cmd)
+            return -1;
+    }
+    const shc_cmd *cmds = (const shc_cmd *)(map + h->cmds_off);
+    for (uint32_t i = 0; i < h->n_cmds; i++)
+    {
+        const shc_cmd *c = &cmds[i];
+        if (c->first_word > h->n_words || c->argc > h->n_words - c->first_word || c->first_tee > h->n_words ||
+            c->n_tee > h->n_words - c->first_tee || (c->redirect_in != SHC_NONE && c->redirect_in >= h->data_len) ||
+            (c->redirect_out != SHC_NONE && c->redirect_out >= h->data_len))
+            return -1;
+    }
+
+    const script_loop *loops = (const script_loop *)(map + h->loops_off);
+    for (uint32_t i = 0; i < h->n_loops; i++)
+    {
+        const script_loop *l = &loops[i];
+        if (l->var < 0 || (uint32_t)l->var >= h->n_strings || l->first_word < 0 || l->n_words < 0 ||
+            (uint64_t)l->first_word + l->n_words > h->n_strings)
+            return -1;
+    }
+    const instr *code = (const instr *)(map + h->code_off);
+    for (uint32_t i = 0; i < h->n_code; i++)
+    {
+        const instr *in = &code[i];
+        uint32_t limit = in->op == OP_RUN                                 ? h->n_stacks
+                         : in->op == OP_FOR_INIT || in->op == OP_FOR_NEXT ? h->n_loops
+                         : in->op == OP_SUBJECT || in->op == OP_CASE      ? h->n_strings
+                                                                          : UINT32_MAX;
+        if (in->op > OP_CASE || (limit != UINT32_MAX && (in->a < 0 || (uint32_t)in->a >= limit)))
+            return -1;
+    }
+    return 0;
+}
+
+/* Builds the program around a checked mapping */
+static script *shc_build(char *map, size_t len)
+{
+    const shc_header *h = (const shc_header *)map;
+    const uint32_t *words = (const uint32_t *)(map + h->words_off);
+    const uint32_t *strings = (const uint32_t *)(map + h->strings_off);
+    const shc_stack *stacks = (const shc_stack *)(map + h->stacks_off);
+    const shc_cmd *cmds = (const shc_cmd *)(map + h->cmds_off);
+    char *data = map + h->data_off;
+    script *prog = calloc(1, sizeof(script));
+
+    prog->map = map;
+    prog->map_len = len;
+    prog->code = (instr *)(map + h->code_off);
+    prog->n_code = h->n_code;
+    prog->loops = (script_loop *)(map + h->loops_off);
+    prog->n_loops = h->n_loops;
+    prog->strings = malloc((h->n_strings + 1) * sizeof(char *));
+    prog->n_strings = h->n_strings;
+    for (uint32_t i = 0; i < h->n_strings; i++)
+    {
+        prog->strings[i] = data + strings[i];
+    }
+
+    prog->stacks = malloc((h->n_stacks + 1) * sizeof(command **));
+    prog->n_stacks = h->n_stacks;
+    for (uint32_t i = 0; i < h->n_stacks; i++)
+    {
+        command **stack = malloc((stacks[i].n_cmds + 1) * sizeof(command *));
+        for (uint32_t j = 0; j < stacks[i].n_cmds; j++)
+        {
+            const shc_cmd *c = &cmds[stacks[i].first_cmd + j];
+            command *cmd = calloc(1, sizeof(command));
+
+            cmd->background = c->background;
+            cmd->sequential = c->sequential;
+            cmd->pipe_to = c->pipe_to;
+            cmd->argv = malloc((c->argc + 1) * sizeof(char *));
+            for (uint32_t k = 0; k < c->argc; k++)
+                cmd->argv[k] = data + words[c->first_word + k];
+            cmd->argv[c->argc] = NULL;
+            cmd->com_name = cmd->argv[0];
+            if (c->n_tee > 0)
+            {
+                cmd->redirect_tee = malloc((c->n_tee + 1) * sizeof(char *));
+                for (uint32_t k = 0; k < c->n_tee; k++)
+                    cmd->redirect_tee[k] = data + words[c->first_tee + k];
+                cmd->redirect_tee[c->n_tee] = NULL;
+            }
+            cmd->redirect_in = c->redirect_in != SHC_NONE ? data + c->redirect_in : NULL;
+            cmd->redirect_out = c->redirect_out != SHC_NONE ? data + c->redirect_out : NULL;
+            stack[j] = cmd;
+        }
+        stack[stacks[i].n_cmds] = NULL;
+        prog->stacks[i] = stack;
+    }
+    return prog;
+}
+
+int shc_load(const char *path, script **prog)
+{
+    shc_header h;
+    struct stat st;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    if (fd == -1)
+    {
+        perror(path);
+        return SCRIPT_ERROR;
+    }
+    ssize_t n = fstat(fd, &st) == 0 ? pread(fd, &h, sizeof(h), 0) : -1;
+    if (n < (ssize_t)sizeof(h.magic) || h.magic != SHC_MAGIC)
+    {
+        close(fd);
+        return SCRIPT_INCOMPLETE;
+    }
+    char *map = n == sizeof(h) ? mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (n != sizeof(h) || (map != MAP_FAILED && shc_check(map, st.st_size) != 0))
+    {
+        fprintf(stderr, "%s: damaged compiled script\n", path);
+        if (map != MAP_FAILED)
+            munmap(map, st.st_size);
+        return SCRIPT_ERROR;
+    }
+    if (map == MAP_FAILED)
+    {
+        perror(path);
+        return SCRIPT_ERROR;
+    }
+
+    const char *src = map + h.data_off + h.src_path;
+    if (!shc_current(&h, src))
+    {
+        // stale: the source is the truth
+        size_t len;
+        char *text = read_whole_file(src, &len);
+        int status = text != NULL ? script_compile(text, prog) : SCRIPT_ERROR;
+        if (text == NULL)
+            perror(src);
+        else if (status == SCRIPT_INCOMPLETE)
+            fprintf(stderr, "%s: syntax error: unexpected end of input\n", src);
+        free(text);
+        munmap(map, st.st_size);
+        return status == SCRIPT_OK ? SCRIPT_OK : SCRIPT_ERROR;
+    }
+    *prog = shc_build(map, st.st_size);
+    return SCRIPT_OK;
+}
+
+int shc_run_file(const char *path)
+{
+    script *prog = NULL;
+    int status = shc_load(path, &prog);
+
+    if (status == SCRIPT_INCOMPLETE)
+    {
+        size_t len;
+        char *text = read_whole_file(path, &len);
+        if (text == NULL)
+        {
+            perror(path);
+            return 2;
+        }
+        script_run_text(text);
+        free(text);
+        return last_status;
+    }
+    if (status != SCRIPT_OK)
+    {
+        return 2;
+    }
+    script_run(prog);
+    script_free(prog);
+    return last_status;
+}
@@ -0,0 +1,120 @@
+#ifndef SHC_H
+#define SHC_H
+
+/*
+ * Shc.h
+ * Precompiled scripts: shell --compile writes the program compiled by
+ * script_compile() to a .shc file, which the shell maps and runs
+ * without parsing the script again
+ * Authors : Aloysious Kok & Gerald
+ * Last Update : 18/10/26
+ */
+
+#include <stdint.h>
+#include "script.h"
+
+/* Command line flag: shell --compile script [-o file.shc] */
+#define SHC_COMPILE_FLAG "--compile"
+
+/* Extension of the compiled file when -o is not given */
+#define SHC_EXTENSION ".shc"
+
+/* Identifies a compiled script and its layout */
+#define SHC_MAGIC 0x31435353 // "SSC1"
+
+/* An absent string, such as a redirection that was not given */
+#define SHC_NONE UINT32_MAX
+
+/*
+ * Layout. The file holds no pointers: sections are found by their
+ * offset from the start of the file, strings by their offset in the
+ * data section, so the file can be mapped anywhere. The code and loops
+ * are the instr and script_loop arrays of the program, used in place.
+ * The source the file was compiled from is recorded so a stale file can
+ * be told from a current one.
+ */
+typedef struct Shc_header_struct
+{
+    uint32_t magic;
+    uint32_t src_path; // string: the source, as an absolute path
+    int64_t src_mtime_sec;
+    int64_t src_mtime_nsec;
+    uint64_t src_size;
+    uint64_t src_hash; // FNV-1a of the source text
+    uint32_t n_code, n_loops, n_stacks, n_cmds, n_words, n_strings;
+    uint64_t code_off, loops_off, stacks_off, cmds_off, words_off, strings_off;
+    uint64_t data_off, data_len;
+} shc_header;
+
+/* A command stack: n_cmds commands from first_cmd, NULL terminated when loaded */
+typedef struct Shc_stack_struct
+{
+    uint32_t first_cmd;
+    uint32_t n_cmds;
+} shc_stack;
+
+/* A parsed command; its words are consecutive in the word table */
+typedef struct Shc_cmd_struct
+{
+    int32_t background;
+    int32_t sequential;
+    int32_t pipe_to;
+    uint32_t first_word, argc;
+    uint32_t first_tee, n_tee;
+    uint32_t redirect_in, redirect_out;
+} shc_cmd;
+
+/* void shc_compile_main(int argc, char **argv)
+ *
+ * shell --compile script [-o file.shc]
+ * This function compiles the script and writes it to the .shc file,
+ * by default the script name with its .sh extension replaced by .shc.
+ * The file is written to a temporary name and renamed into place.
+ * Returns only by exiting: 0 on success, 1 on a syntax or I/O error.
+ *
+ * Arguments :
+ *      argc, argv - the arguments of the shell, SHC_COMPILE_FLAG first
+ *
+ * Returns :
+ *      None
+ */
+void shc_compile_main(int argc, char **argv);
+
+/* int shc_load(const char *path, script **prog)
+ *
+ * This function maps a .shc file and builds a program around it: the
+ * code, loops and strings are used where they lie in the mapping, only
+ * the command structures are allocated. The program is freed with
+ * script_free(), which also unmaps the file. When the source it was
+ * compiled from has changed since, by size or modification time, and
+ * its text hashes differently, the source is compiled instead; a
+ * source that no longer exists leaves the compiled file in charge.
+ *
+ * Arguments :
+ *      path - the .shc file
+ *      prog - receives the program when SCRIPT_OK is returned
+ *
+ * Returns :
+ *      SCRIPT_OK - the program is ready to run
+ *      SCRIPT_INCOMPLETE - path is not a compiled script
+ *      SCRIPT_ERROR - the file is damaged, or the stale source failed to
+ *                     compile (a message has been printed)
+ */
+int shc_load(const char *path, script **prog);
+
+/* int shc_run_file(const char *path)
+ *
+ * shell file
+ * This function runs a script file: a .shc file through shc_load(), any
+ * other file by compiling its text.
+ *
+ * Arguments :
+ *      path - the script
+ *
+ * Returns :
+ *      the exit status of the last command executed
+ *      2 - the script could not be read or compiled
+ */
+int shc_run_file(const char *path);
+
+#endif
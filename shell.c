@@ -6,9 +6,28 @@
  */
 
 #include "shell.h"
+#include "utils.h"
+#include "script.h"
+#include "vars.h"
+#include "jobs.h"
+#include "pin.h"
+#include "spawn.h"
+#include "term.h"
+#include "edit.h"
+#include "prompt.h"
+#include "serve.h"
+#include "dirs.h"
+#include "metrics.h"
+#include "audit.h"
+#include "pipes.h"
+#include "memo.h"
+#include "watch.h"
+#include "par.h"
+#include "shc.h"
+#include "rc.h"
 
 // builtin commands
-const char *builtin_cmds[] = {"cd", "pwd", "help", "prompt", "exit", "history"};
+const char *builtin_cmds[] = {"cd", "pwd", "help", "prompt", "exit", "history", "export", "unset", "set", "wait", "pushd", "popd", "dirs", "z", "stats", "watch", "alias"};
 
 // default % prompt string
 char prompt_str[MAX_BUF_SIZE] = "% ";
@@ -28,6 +47,18 @@ int prev_dir_flag = 0;
 // current command index position
 int curr_idx = 0;
 
+// exit status of the last command executed
+int last_status = 0;
+
+// Ctrl-C was pressed during the current command line
+volatile sig_atomic_t interrupted = 0;
+
+// pid of the last background command
+pid_t last_bg_pid = 0;
+
+// exit status reported by builtins that have one (wait)
+static int builtin_status = 0;
+
 char *command_history[HISTORY_SIZE]; // Array to store history commands
 int history_count = 0;               // Counter for the number of commands in history
 
@@ -62,24 +93,69 @@ void cleanup_history()
     }
 }
 
-int main(void)
+int main(int argc, char **argv)
 {
+    uint64_t start = metrics_now();
+    int profile = 0;
+
+    // the shell binary doubles as the spawn server (see spawn.h)
+    if (argc == 3 && strcmp(argv[1], SPAWN_SERVER_FLAG) == 0)
+    {
+        spawn_serve(atoi(argv[2]));
+    }
+    if (argc >= 2 && strcmp(argv[1], CONNECT_FLAG) == 0)
+    {
+        serve_connect(argv[2], argv + 3);
+    }
+    if (argc >= 2 && strcmp(argv[1], SERVE_FLAG) == 0)
+    {
+        vars_init(environ);
+        metrics_init();
+        serve_main(argc, argv);
+    }
+    if (argc >= 2 && strcmp(argv[1], SHC_COMPILE_FLAG) == 0)
+    {
+        shc_compile_main(argc, argv);
+    }
+    if (argc >= 2 && strcmp(argv[1], RC_PROFILE_FLAG) == 0)
+    {
+        profile = 1;
+    }
+    // shell script: run it, compiled or not, instead of reading commands
+    else if (argc >= 2 && argv[1][0] != '-')
+    {
+        vars_init(environ);
+        metrics_init();
+        setup_signal_handlers();
+        exit(shc_run_file(argv[1]));
+    }
+
     printf("\nSimple Unix Shell.\n\n");
 
+    vars_init(environ);
+    metrics_init();
+    term_init();
     setup_signal_handlers();
+    rc_load(start, profile);
     run_shell_loop();
     cleanup_history(); // Cleanup command history
 
     return EXIT_SUCCESS;
 }
 
+static void note_interrupt(int sig)
+{
+    (void)sig;
+    interrupted = 1;
+}
+
 void setup_signal_handlers()
 {
     struct sigaction action = {0};
     action.sa_handler = SIG_IGN; // ignore signals
 
-    // Handle SIGTSTP, SIGINT, and SIGQUIT with the same handler
-    const int signals_to_ignore[] = {SIGTSTP, SIGINT, SIGQUIT};
+    // Ignore SIGTSTP and SIGQUIT
+    const int signals_to_ignore[] = {SIGTSTP, SIGQUIT};
     for (size_t i = 0; i < sizeof(signals_to_ignore) / sizeof(signals_to_ignore[0]); i++)
     {
         if (sigaction(signals_to_ignore[i], &action, NULL) != 0)
@@ -89,6 +165,17 @@ void setup_signal_handlers()
         }
     }
 
+    // SIGINT is caught rather than ignored: execve() restores the default
+    // action for the commands, and loops see that Ctrl-C was pressed
+    struct sigaction sa_int = {0};
+    sa_int.sa_handler = note_interrupt;
+    sa_int.sa_flags = SA_RESTART;
+    if (sigaction(SIGINT, &sa_int, NULL) != 0)
+    {
+        perror("sigaction");
+        exit(EXIT_FAILURE);
+    }
+
     // Setup handler for SIGCHLD to clean up zombie processes
     struct sigaction sa_child = {0};
     sa_child.sa_handler = claim_zombies;
@@ -103,12 +190,13 @@ void setup_signal_handlers()
 void run_shell_loop()
 {
     char *line = NULL;
-    command **cmd_stack = NULL;
+    const char *prompt;
 
     while (1)
     {
-        printf("%s", prompt_str);
-        line = read_command_line(); // This function will handle the EINTR case internally
+        prompt = prompt_render(prompt_str);
+        rc_first_prompt();
+        line = read_command_line(prompt); // This function will handle the EINTR case internally
 
         // Check if the command is a history command
         if (line != NULL && line[0] == '!')
@@ -133,102 +221,103 @@ void run_shell_loop()
             continue; // Empty line or read error, just start the loop again
         }
 
-        int cmd_status = check_cmd_input(line);
-        if (cmd_status == 0)
-        {
-            cmd_stack = process_cmd_line(line, 1);
-            execute_stack(cmd_stack);
-            clean_up(cmd_stack);
-        }
-        else if (cmd_status == 2)
-        {
-            // Specific case, possibly handle differently
-        }
-        else
+        interrupted = 0;
+
+        // Compound commands are compiled once and run by the interpreter,
+        // as are pasted blocks of several lines
+        if (script_is_compound(line) || strchr(line, '\n') != NULL)
         {
-            printf("Error: command line syntax \n\n");
+            run_compound(line);
+            free(line);
+            continue;
         }
 
+        run_line(line);
         free(line); // Ensure we always free the line after we're done with it
     }
 }
 
-// The read_command_line function would encapsulate reading from stdin and handling EINTR
-// Replace the read_command_line function with a new version
-char *read_command_line()
+void run_line(char *line)
 {
-    static struct termios oldt, newt;
-    int ch, history_index = history_count - 1;
-    char *line = (char *)malloc(CMD_LENGTH);
-    int position = 0;
-
-    // Save old settings and set new terminal mode
-    tcgetattr(STDIN_FILENO, &oldt);
-    newt = oldt;
-    newt.c_lflag &= ~(ICANON | ECHO);
-    tcsetattr(STDIN_FILENO, TCSANOW, &newt);
+    command **cmd_stack = NULL;
+    char *aliased = rc_expand_aliases(line);
 
-    while (1)
+    if (aliased != NULL)
+    {
+        line = aliased;
+    }
+    int cmd_status = check_cmd_input(line);
+    if (cmd_status == 0)
+    {
+        uint64_t parse_start = metrics_now();
+        cmd_stack = process_cmd_line(line, 1);
+        metrics_observe(H_PARSE, parse_start);
+        execute_stack(cmd_stack);
+        clean_up(cmd_stack);
+    }
+    else if (cmd_status == 2)
+    {
+        // Specific case, possibly handle differently
+    }
+    else
     {
-        ch = getchar();
+        printf("Error: command line syntax \n\n");
+    }
+    free(aliased);
+}
 
-        // Handle Ctrl-D (EOF)
-        if (ch == EOF)
-        {
-            clearerr(stdin);            // Clear the EOF condition
-            printf("\n%s", prompt_str); // Reprint the prompt
-            continue;                   // Continue the loop to read the next line
-        }
+/* script_compile() with its duration recorded as parse time */
+static int compile_timed(const char *src, script **prog)
+{
+    uint64_t start = metrics_now();
+    int status = script_compile(src, prog);
 
-        // Handle special characters (Ctrl-Z, Ctrl-C, Ctrl-\)
-        if (ch == 26 || ch == 3 || ch == 28)
-        {
-            printf("^%c", ch + 64); // Display ^Z, ^C, ^\ (ASCII art for control characters)
-            continue;
-        }
-        if (ch == '\n' || ch == '\r')
-        {
-            line[position] = '\0';
-            printf("\n");
-            break;
-        }
-        else if (ch == 27) // Arrow key prefix
-        {
-            getchar(); // Skip '['
-            ch = getchar();
-            if (ch == 'A' && history_index >= 0)
-            { // Up arrow
-                strcpy(line, command_history[history_index--]);
-                printf("\33[2K\r%s%s", prompt_str, line);
-                position = strlen(line);
-            }
-            else if (ch == 'B' && history_index < history_count - 1)
-            { // Down arrow
-                strcpy(line, command_history[++history_index]);
-                printf("\33[2K\r%s%s", prompt_str, line);
-                position = strlen(line);
-            }
-        }
-        else if (ch == 127) // Backspace
-        {
-            if (position > 0)
-            {
-                position--;
-                line[position] = '\0';
-                printf("\b \b");
-            }
-        }
-        else if (position < CMD_LENGTH - 1)
+    metrics_observe(H_PARSE, start);
+    return status;
+}
+
+void run_compound(char *line)
+{
+    script *prog = NULL;
+    char *src = strdup(line);
+    int status;
+
+    // Keep reading lines until the compound command is complete
+    while (src != NULL && (status = compile_timed(src, &prog)) == SCRIPT_INCOMPLETE)
+    {
+        char *more = read_command_line("> ");
+        char *joined = malloc(strlen(src) + strlen(more) + 2);
+        if (joined != NULL)
         {
-            line[position++] = ch;
-            printf("%c", ch);
+            sprintf(joined, "%s\n%s", src, more);
         }
+        free(src);
+        free(more);
+        src = joined;
     }
 
-    // Restore old settings
-    tcsetattr(STDIN_FILENO, TCSANOW, &oldt);
+    if (src == NULL)
+    {
+        fprintf(stderr, "Memory allocation failed\n");
+        return;
+    }
+    if (status == SCRIPT_OK)
+    {
+        script_run(prog);
+        script_free(prog);
+    }
+    free(src);
+}
 
-    if (position > 0)
+char *read_command_line(const char *prompt)
+{
+    char *line;
+
+    // raw mode stays on until a foreground command needs the terminal
+    term_raw();
+    line = edit_line(prompt, command_history, history_count);
+
+    if (line[0] != '\0')
     { // If line is not empty
         add_command_to_history(line);
     }
@@ -240,19 +329,73 @@ int execute_stack(command **cmd_stack)
 {
     curr_idx = 0;
     int builtin_exists;
+    int first, last, next;
 
-    while (cmd_stack[curr_idx] != NULL)
+    // after Ctrl-C the rest of the list is not run
+    while (cmd_stack[curr_idx] != NULL && !interrupted)
     {
-        // Execute builtin commands if exist
+        // Run it along with the independent statements after it
+        if (shell_option(OPT_AUTOPAR) && (next = par_execute(cmd_stack, curr_idx)) > 0)
+        {
+            curr_idx = next;
+            continue;
+        }
+
+        // Expand the command, or every stage of the pipeline it starts
+        first = last = curr_idx;
+        while (cmd_stack[last]->pipe_to > 0 && cmd_stack[last + 1] != NULL)
+        {
+            last++;
+        }
         builtin_exists = 0;
-        builtin_exists = builtin_menu(cmd_stack[curr_idx]);
-        if (builtin_exists > 0)
+        for (int i = first; i <= last; i++)
+        {
+            if (expand_command(cmd_stack[i]) < 0)
+            {
+                builtin_exists = -1;
+            }
+        }
+
+        audit_begin();
+        if (builtin_exists < 0) // Expansion failed, skip the command
+        {
+            last_status = 1;
+            curr_idx = last + 1;
+        }
+        else if (cmd_stack[curr_idx]->argv[0] == NULL) // Only assignments
+        {
+            for (int i = 0; cmd_stack[curr_idx]->assigns != NULL && cmd_stack[curr_idx]->assigns[i] != NULL; i++)
+            {
+                char *assign = cmd_stack[curr_idx]->assigns[i];
+                char *eq = strchr(assign, '=');
+                *eq = '\0';
+                var_set(assign, eq + 1, VAR_KEEP);
+                *eq = '=';
+            }
+            last_status = 0;
+            curr_idx = last + 1;
+        }
+        // Functions run in the shell, unless the command needs a child of its own
+        else if (first == last && cmd_stack[curr_idx]->background != 1 && cmd_stack[curr_idx]->redirect_in == NULL &&
+                 cmd_stack[curr_idx]->redirect_out == NULL && rc_is_function(cmd_stack[curr_idx]->argv[0]))
         {
+            int saved_idx = curr_idx;
+            metrics_count(M_COMMANDS, 1);
+            rc_call(cmd_stack[curr_idx]->argv);
+            curr_idx = saved_idx + 1;
+        }
+        // Execute builtin commands if exist
+        else if ((builtin_exists = builtin_menu(cmd_stack[curr_idx])) != 0)
+        {
+            metrics_count(M_COMMANDS, 1);
+            metrics_count(M_BUILTINS, 1);
+            last_status = (builtin_exists < 0) ? 1 : builtin_status;
+            audit_end(cmd_stack, curr_idx, curr_idx, 1);
             curr_idx++;
-            continue;
         }
         else // Other Commmands
         {
+            metrics_count(M_COMMANDS, last - first + 1);
             if (cmd_stack[curr_idx]->pipe_to > 0)
             {
                 exec_pipe(cmd_stack, curr_idx);
@@ -269,21 +412,120 @@ int execute_stack(command **cmd_stack)
             {
                 exec_sequential(cmd_stack, curr_idx);
             }
+            pipes_fanout_wait();
+            audit_end(cmd_stack, first, last, 0);
             curr_idx++;
         }
+
+        for (int i = first; i <= last; i++)
+        {
+            unexpand_command(cmd_stack[i]);
+        }
     }
     return 0;
 }
 
+void exec_command(command *cmd, char **argv)
+{
+    char **envp;
+    char path[MAX_BUF_SIZE];
+    const char *search;
+    int saved_errno = ENOENT;
+
+    if (argv[0] == NULL)
+    {
+        exit(EXIT_SUCCESS);
+    }
+
+    // name=value words before the command only affect its environment
+    for (int i = 0; cmd->assigns != NULL && cmd->assigns[i] != NULL; i++)
+    {
+        char *eq = strchr(cmd->assigns[i], '=');
+        *eq = '\0';
+        var_set(cmd->assigns[i], eq + 1, VAR_EXPORT);
+    }
+    envp = vars_envp();
+
+    // a function in a pipeline, in the background or redirected runs here
+    if (rc_is_function(argv[0]))
+    {
+        exit(rc_call(argv));
+    }
+
+    // memo: replay the cached output, or run the rest of the line and
+    // cache it
+    if (memo_is_prefix(argv[0]) && (argv = memo_apply(argv, envp)) == NULL)
+    {
+        exit(2);
+    }
+
+    // pin/affinity: place this process, then run the rest of the line
+    if (pin_is_prefix(argv[0]) && (argv = pin_apply(argv)) == NULL)
+    {
+        exit(2);
+    }
+    metrics_exec_start();
+
+    if (strchr(argv[0], '/') != NULL)
+    {
+        execve(argv[0], argv, envp);
+        saved_errno = errno;
+    }
+    else
+    {
+        // search the directories of the shell's own PATH variable
+        search = var_get("PATH");
+        if (search == NULL)
+        {
+            search = "/bin:/usr/bin";
+        }
+        while (*search != '\0')
+        {
+            size_t len = strcspn(search, ":");
+            snprintf(path, sizeof(path), "%.*s%s%s", (int)len, search, len ? "/" : "", argv[0]);
+            execve(path, argv, envp);
+            // remember a permission problem over a plain miss
+            if (errno != ENOENT && errno != ENOTDIR)
+            {
+                saved_errno = errno;
+            }
+            search += len;
+            if (*search == ':')
+            {
+                search++;
+            }
+        }
+    }
+
+    fprintf(stderr, "%s: %s\n", argv[0], saved_errno == ENOENT ? "command not found" : strerror(saved_errno));
+    exit(saved_errno == ENOENT ? 127 : 126);
+}
+
 int exec_sequential(command **cmd_stack, int current)
 {
     pid_t pid;
     pid_t child_pid;
     int status;
     int w_count;
+    util_fn util;
 
     w_count = wildcard_handler(cmd_stack, current);
 
+    // in-process utilities run without fork() and execvp()
+    util = util_lookup(cmd_stack[current]->argv[0]);
+    if (util != NULL)
+    {
+        status = util_run_redirected(cmd_stack[current],
+                                     w_count > 0 ? &globbuf.gl_pathv[0] : cmd_stack[current]->argv,
+                                     util);
+        if (status != UTIL_EXTERNAL)
+        {
+            metrics_count(M_BUILTINS, 1);
+            last_status = status;
+            return 0;
+        }
+    }
+
     int inputfile = 0;
     int rd_in_flag = 0;
     int outputfile = 0;
@@ -303,14 +545,41 @@ int exec_sequential(command **cmd_stack, int current)
     else if (cmd_stack[current]->redirect_out != NULL)
     {
         rd_out_flag = 1;
-        // write/create a output file with read and execute access
-        if ((outputfile = open(cmd_stack[current]->redirect_out, O_WRONLY | O_CREAT, 0755)) == -1)
+        if ((outputfile = pipes_open_output(cmd_stack[current], 0)) == -1)
         {
             return -1;
         }
     }
 
+    // the command gets the terminal in cooked mode
+    term_cooked();
+
+    // set -o zygote: the spawn server forks the command instead of us;
+    // process substitutions are pipes of this process, the server has none
+    if (cmd_stack[current]->assigns == NULL && cmd_stack[current]->subst_fds == NULL &&
+        !rc_is_function(cmd_stack[current]->argv[0]))
+    {
+        int fds[3] = {rd_in_flag ? inputfile : STDIN_FILENO,
+                      rd_out_flag ? outputfile : STDOUT_FILENO,
+                      STDERR_FILENO};
+        if (spawn_run(w_count > 0 ? &globbuf.gl_pathv[0] : cmd_stack[current]->argv,
+                      vars_envp(), fds, &status) == 0)
+        {
+            audit_child(0, NULL);
+            last_status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+            if (WIFSIGNALED(status) && WTERMSIG(status) == SIGINT)
+                interrupted = 1;
+            if (rd_in_flag)
+                close(inputfile);
+            if (rd_out_flag)
+                close(outputfile);
+            return 0;
+        }
+    }
+
     // child process
+    fflush(stdout);
+    metrics_fork_start();
     pid = fork();
     if (pid == 0)
     {
@@ -328,17 +597,13 @@ int exec_sequential(command **cmd_stack, int current)
         // if command contains wildcards execute with glob_t
         if (w_count > 0)
         {
-            execvp(cmd_stack[current]->argv[0], &globbuf.gl_pathv[0]);
-            perror("execvp error: ");
-            exit(EXIT_FAILURE);
+            exec_command(cmd_stack[current], &globbuf.gl_pathv[0]);
         }
 
         // execute regular command
         else
         {
-            execvp(cmd_stack[current]->argv[0], cmd_stack[current]->argv);
-            perror("execvp error: ");
-            exit(EXIT_FAILURE);
+            exec_command(cmd_stack[current], cmd_stack[current]->argv);
         }
     }
     else if (pid < 0)
@@ -348,8 +613,17 @@ int exec_sequential(command **cmd_stack, int current)
     // Parent process
     else
     {
+        struct rusage usage;
         child_pid = pid;
-        waitpid(child_pid, &status, 0);
+        if (rd_out_flag)
+            close(outputfile);
+        if (wait4(child_pid, &status, 0, &usage) == child_pid)
+        {
+            audit_child(child_pid, &usage);
+            last_status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+            if (WIFSIGNALED(status) && WTERMSIG(status) == SIGINT)
+                interrupted = 1;
+        }
         if (WIFEXITED(status) != 0)
         {
             return -1;
@@ -364,8 +638,12 @@ int exec_concurrent(command **cmd_stack, int current)
     pid_t pid;
     pid_t child_pid;
     int w_count;
+    int pin_slot;
+    util_fn util;
 
     w_count = wildcard_handler(cmd_stack, current);
+    util = util_lookup(cmd_stack[current]->argv[0]);
+    pin_slot = pin_next_slot(cmd_stack[current]->argv);
 
     int inputfile = 0;
     int rd_in_flag = 0;
@@ -387,20 +665,27 @@ int exec_concurrent(command **cmd_stack, int current)
     else if (cmd_stack[current]->redirect_out != NULL)
     {
         rd_out_flag = 1;
-        // write/create a output file with read and execute access
-        if ((outputfile = open(cmd_stack[current]->redirect_out, O_WRONLY | O_CREAT, 0755)) == -1)
+        if ((outputfile = pipes_open_output(cmd_stack[current], 1)) == -1)
         {
             return -1;
         }
     }
 
     // child process
+    fflush(stdout);
+    metrics_fork_start();
     pid = fork();
     if (pid == 0)
     {
         // setpgid: to put child in new process group allow exec function to run
         setpgid(0, 0);
 
+        // set -o autopin / autonuma: spread the jobs round-robin
+        if (pin_slot >= 0)
+        {
+            pin_auto(pin_slot);
+        }
+
         // redirect input
         if (rd_in_flag != 0)
         {
@@ -412,20 +697,27 @@ int exec_concurrent(command **cmd_stack, int current)
             dup2(outputfile, STDOUT_FILENO);
         }
 
+        // in-process utility: no exec needed in the child
+        if (util != NULL)
+        {
+            int util_status = util(w_count > 0 ? &globbuf.gl_pathv[0] : cmd_stack[current]->argv);
+            if (util_status != UTIL_EXTERNAL)
+            {
+                metrics_count(M_BUILTINS, 1);
+                exit(util_status);
+            }
+        }
+
         // if command contains wildcards execute with glob_t
         if (w_count > 0)
         {
-            execvp(cmd_stack[current]->argv[0], &globbuf.gl_pathv[0]);
-            perror("execvp error: ");
-            exit(EXIT_FAILURE);
+            exec_command(cmd_stack[current], &globbuf.gl_pathv[0]);
         }
 
         // execute regular command
         else
         {
-            execvp(cmd_stack[current]->argv[0], cmd_stack[current]->argv);
-            perror("execvp error: ");
-            exit(EXIT_FAILURE);
+            exec_command(cmd_stack[current], cmd_stack[current]->argv);
         }
     }
     else if (pid < 0) // error forking child
@@ -436,11 +728,34 @@ int exec_concurrent(command **cmd_stack, int current)
     else
     {
         child_pid = pid;
+        last_bg_pid = child_pid;
+        if (rd_out_flag)
+            close(outputfile);
+        jobs_track(child_pid, 1);
         printf("\nbackground process: %d is running\n\n", child_pid);
     }
     return 0;
 }
 
+/*
+ * Gives up a pipeline after stage i could not be started: the pipe made
+ * for it is closed, the shell reads its own stdin again and the meters
+ * started for the stages before are waited for.
+ */
+static int exec_pipe_abort(int pipefd[2], int stdin_desc, const pid_t *meters, int metered, int i)
+{
+    close(pipefd[0]);
+    close(pipefd[1]);
+    dup2(stdin_desc, STDIN_FILENO);
+    close(stdin_desc);
+    for (int j = 0; metered && j < i && j < PIPES_METER_MAX; j++)
+    {
+        if (meters[j] > 0)
+            waitpid(meters[j], NULL, 0);
+    }
+    return -1;
+}
+
 int exec_pipe(command **cmd_stack, int current)
 {
     int idx = current;
@@ -460,17 +775,26 @@ int exec_pipe(command **cmd_stack, int current)
 
     idx = current;
 
+    // any stage may read from the terminal
+    term_cooked();
+
     // to prevent segmentation fault
     stdin_desc = dup(0);
 
+    // background pipelines are not metered: nobody waits for the report
+    int metered = shell_option(OPT_PIPEMETER) && cmd_stack[current + p_count]->background != 1;
+    pid_t meters[PIPES_METER_MAX];
+
     for (int i = 0; i < p_count; i++)
     {
         pid_t pid;
         int w_count;
+        util_fn util;
         int pipefd[2];
-        pipe(pipefd);
+        pipes_open(pipefd);
 
-        w_count = wildcard_handler(cmd_stack, current);
+        w_count = wildcard_handler(cmd_stack, idx);
+        util = util_lookup(cmd_stack[idx]->argv[0]);
 
         int inputfile = 0;
         int rd_in_flag = 0;
@@ -483,21 +807,22 @@ int exec_pipe(command **cmd_stack, int current)
             // read from input file
             if ((inputfile = open(cmd_stack[idx]->redirect_in, O_RDONLY)) == -1)
             {
-                return -1;
+                return exec_pipe_abort(pipefd, stdin_desc, meters, metered, i);
             }
         }
         // redirect output
         else if (cmd_stack[idx]->redirect_out != NULL)
         {
             rd_out_flag = 1;
-            // write/create a output file with read and execute access
-            if ((outputfile = open(cmd_stack[idx]->redirect_out, O_WRONLY | O_CREAT, 0755)) == -1)
+            if ((outputfile = pipes_open_output(cmd_stack[idx], cmd_stack[current + p_count]->background == 1)) == -1)
             {
-                return -1;
+                return exec_pipe_abort(pipefd, stdin_desc, meters, metered, i);
             }
         }
 
         // child process
+        fflush(stdout);
+        metrics_fork_start();
         pid = fork();
         if (pid == 0)
         {
@@ -505,6 +830,12 @@ int exec_pipe(command **cmd_stack, int current)
             dup2(pipefd[1], STDOUT_FILENO);
             close(pipefd[0]);
 
+            // a background pipeline shares the terminal but not Ctrl-C
+            if (cmd_stack[current + p_count]->background == 1)
+            {
+                signal(SIGINT, SIG_IGN);
+            }
+
             if (rd_in_flag != 0) // redirect input
             {
                 dup2(inputfile, STDIN_FILENO);
@@ -514,31 +845,61 @@ int exec_pipe(command **cmd_stack, int current)
                 dup2(outputfile, STDOUT_FILENO);
             }
 
+            // in-process utility as a pipeline stage: no exec needed
+            if (util != NULL)
+            {
+                int util_status = util(w_count > 0 ? &globbuf.gl_pathv[0] : cmd_stack[idx]->argv);
+                if (util_status != UTIL_EXTERNAL)
+                {
+                    metrics_count(M_BUILTINS, 1);
+                    exit(util_status);
+                }
+            }
+
             // if command contains wildcards execute with glob_t
             if (w_count > 0)
             {
-                execvp(cmd_stack[idx]->argv[0], &globbuf.gl_pathv[0]);
-                perror("execvp error: ");
-                exit(EXIT_FAILURE);
+                exec_command(cmd_stack[idx], &globbuf.gl_pathv[0]);
             }
 
             // execute regular command
             else
             {
-                execvp(cmd_stack[idx]->argv[0], cmd_stack[idx]->argv);
-                perror("execvp error: ");
-                exit(EXIT_FAILURE);
+                exec_command(cmd_stack[idx], cmd_stack[idx]->argv);
             }
         }
         else if (pid < 0) // fork error
         {
-            return -1;
+            if (rd_in_flag)
+                close(inputfile);
+            if (rd_out_flag)
+                close(outputfile);
+            return exec_pipe_abort(pipefd, stdin_desc, meters, metered, i);
         }
 
-        // wait(NULL);//parent waits for child to finish
+        // the stage is reaped through the child table (see jobs.h)
+        jobs_track(pid, 0);
+        audit_stage(pid);
+        if (rd_out_flag)
+            close(outputfile);
 
-        // Read from pipe and close write end
+        // the next stage reads the pipe, or a second one fed by a meter
+        if (metered && i < PIPES_METER_MAX)
+        {
+            int meterfd[2];
+            meters[i] = -1;
+            if (pipes_open(meterfd) == 0)
+            {
+                meters[i] = pipes_meter(pipefd, meterfd, i);
+                close(pipefd[0]);
+                close(meterfd[1]);
+                pipefd[0] = meterfd[0];
+            }
+        }
+
+        // Read from pipe and close both ends
         dup2(pipefd[0], STDIN_FILENO);
+        close(pipefd[0]);
         close(pipefd[1]);
 
         idx++;
@@ -562,12 +923,26 @@ int exec_pipe(command **cmd_stack, int current)
     dup2(stdin_desc, 0);
     close(stdin_desc);
 
+    if (metered)
+    {
+        pipes_report(cmd_stack, current, meters, p_count < PIPES_METER_MAX ? p_count : PIPES_METER_MAX);
+    }
+    return 0;
+}
+
+int is_builtin(const char *name)
+{
+    for (size_t i = 0; i < sizeof(builtin_cmds) / sizeof(char *); i++) {
+        if (strcmp(name, builtin_cmds[i]) == 0)
+            return i + 1;
+    }
     return 0;
 }
 
 int builtin_menu(command *cmd)
 {
-    int builtin_idx = 0;
+    int builtin_idx;
+    builtin_status = 0;
 
     // Check if cmd is not NULL
     if (cmd == NULL) {
@@ -582,12 +957,7 @@ int builtin_menu(command *cmd)
     }
 
     // Check for built-in commands
-    for (int i = 0; i < (sizeof(builtin_cmds) / sizeof(char *)); i++) {
-        if (strcmp(cmd->argv[0], builtin_cmds[i]) == 0) {
-            builtin_idx = i + 1;
-            break;
-        }
-    }
+    builtin_idx = is_builtin(cmd->argv[0]);
 
     switch (builtin_idx)
     {
@@ -612,6 +982,47 @@ int builtin_menu(command *cmd)
     case 6:
         builtin_history();
         break;
+    case 7:
+        if (builtin_export(cmd) < 0)
+            return -1;
+        break;
+    case 8:
+        builtin_unset(cmd);
+        break;
+    case 9:
+        if (builtin_set(cmd) < 0)
+            return -1;
+        break;
+    case 10:
+        builtin_status = builtin_wait(cmd);
+        break;
+    case 11:
+        if (builtin_pushd(cmd) < 0)
+            return -1;
+        break;
+    case 12:
+        if (builtin_popd(cmd) < 0)
+            return -1;
+        break;
+    case 13:
+        if (builtin_dirs(cmd) < 0)
+            return -1;
+        break;
+    case 14:
+        if (builtin_z(cmd) < 0)
+            return -1;
+        break;
+    case 15:
+        if (builtin_stats(cmd) < 0)
+            return -1;
+        break;
+    case 16:
+        if ((builtin_status = builtin_watch(cmd)) < 0)
+            return -1;
+        break;
+    case 17:
+        builtin_status = builtin_alias(cmd);
+        break;
     default:
         break;
     }
@@ -639,9 +1050,7 @@ int builtin_cd(command *cmd)
     if (strlen(path) == 0 || strcmp(path, "~") == 0 || strcmp(path, ".") == 0)
     {
         // Go to home directory
-        prev_dir_flag = 1;
-        getcwd(prev_dir, MAX_BUF_SIZE);
-        if (chdir(getenv("HOME")) != 0)
+        if (dirs_chdir(var_get("HOME")) != 0)
         {
             perror("cd");
             return -1;
@@ -652,7 +1061,7 @@ int builtin_cd(command *cmd)
         // Go to previous directory
         if (prev_dir_flag)
         {
-            if (chdir(prev_dir) != 0)
+            if (dirs_chdir(prev_dir) != 0)
             {
                 perror("cd");
                 return -1;
@@ -666,9 +1075,7 @@ int builtin_cd(command *cmd)
     else
     {
         // Go to specified path
-        prev_dir_flag = 1;
-        getcwd(prev_dir, MAX_BUF_SIZE);
-        if (chdir(path) != 0)
+        if (dirs_chdir(path) != 0)
         {
             perror("cd");
             return -1;
@@ -695,11 +1102,26 @@ int builtin_prompt(command *cmd)
     int space_left = sizeof(new_prompt) - 2; // Reserve 2 bytes (for space and null terminator)
     for (int i = 1; cmd->argv[i] != NULL && space_left > 0; i++)
     {
-        // Check for special characters
-        if (strchr(cmd->argv[i], '&') || strchr(cmd->argv[i], '|') || strchr(cmd->argv[i], ';'))
+        // Check for special characters, except inside \(...) segments
+        for (const char *p = cmd->argv[i]; *p != '\0'; p++)
         {
-            printf("Error: prompt cannot contain '&' or '|' or ';'\n\n");
-            return -1;
+            if (p[0] == '\\' && p[1] == '(')
+            {
+                const char *end = prompt_skip_segment(p);
+                if (end == NULL)
+                {
+                    printf("Error: missing ')' in prompt\n\n");
+                    return -1;
+                }
+                p = end - 1;
+            }
+            else if (*p == '\\' && p[1] != '\0')
+                p++;
+            else if (*p == '&' || *p == '|' || *p == ';')
+            {
+                printf("Error: prompt cannot contain '&' or '|' or ';'\n\n");
+                return -1;
+            }
         }
 
         int len = snprintf(new_prompt + strlen(new_prompt), space_left, "%s%s",
@@ -757,14 +1179,118 @@ int builtin_help()
 
     printf("prompt [string]\n");
     printf("    Sets the shell prompt to the specified string. Special characters are not\n");
-    printf("    allowed. Example usage: prompt myshell> \n\n");
+    printf("    allowed. Example usage: prompt myshell> \n");
+    printf("    Escapes: \\w cwd, \\W its last component, \\? last status, \\j running\n");
+    printf("    jobs, \\g git branch, \\u user, \\h host, \\$ # or $, \\e escape, \\\\ backslash.\n");
+    printf("    \\(command) shows the output of a command, run in the background and\n");
+    printf("    cached until the directory changes. Example: prompt '\\W (\\g) \\?>'\n\n");
 
     printf("pwd\n");
     printf("    Displays the current working directory.\n\n");
 
+    printf("pushd [dir | +N], popd [+N], dirs [-c] [-v]\n");
+    printf("    Keep a stack of directories. pushd saves the current directory and\n");
+    printf("    changes to dir, popd returns to the last saved one, dirs lists them.\n\n");
+
+    printf("z [-l] [term]...\n");
+    printf("    Jumps to the most frecent (frequent and recent) visited directory\n");
+    printf("    whose path contains the terms, e.g. z proj. -l lists the matches.\n");
+    printf("    Visits are recorded in ~/.simpleshell_z across sessions.\n\n");
+
     printf("exit\n");
     printf("    Exits the Simple Unix Shell. No arguments required.\n\n");
 
+    printf("memo command\n");
+    printf("    Runs command and caches its output and exit status; run again with\n");
+    printf("    the same arguments, directory, $PATH and variables named in $MEMO_ENV,\n");
+    printf("    and unchanged files among its arguments and input, the output is\n");
+    printf("    replayed instead. Cached in $MEMO_DIR, by default ~/.simpleshell_memo,\n");
+    printf("    up to $MEMO_SIZE bytes (64M by default), least recently used first.\n\n");
+
+    printf("pin [-c cpus] [-N nodes] [-m nodes] command (also: affinity)\n");
+    printf("    Runs command on the listed CPUs (-c) or on the CPUs of the listed NUMA\n");
+    printf("    nodes (-N), with its memory bound to the listed nodes (-m). Lists are\n");
+    printf("    written like 0-7,16. set -o autopin or set -o autonuma spread the\n");
+    printf("    background commands round-robin across CPUs or NUMA nodes.\n\n");
+
+    printf("set -o audit\n");
+    printf("    Appends a binary record of every command (time, directory, command\n");
+    printf("    line, pid, status, wall and CPU time, max RSS) to $AUDIT_LOG, by default\n");
+    printf("    ~/.simpleshell_audit. Decode it with shell-logdump.\n\n");
+
+    printf("set -o bigpipe, set -o pipemeter\n");
+    printf("    bigpipe enlarges the pipes of a pipeline to $PIPE_SIZE bytes, at most\n");
+    printf("    /proc/sys/fs/pipe-max-size, the default. pipemeter reports the bytes\n");
+    printf("    and rate of every pipe once the pipeline finishes, and how long it\n");
+    printf("    waited for each side: the stage waited for most is the bottleneck.\n\n");
+
+    printf("set -o multios\n");
+    printf("    Output redirected to several files, as in cmd > a > b, goes to all\n");
+    printf("    of them. The copies are made in the kernel with tee() and splice().\n\n");
+
+    printf("set -o autopar\n");
+    printf("    Runs consecutive ';' statements that name no file in common at the\n");
+    printf("    same time, and waits for them before one that does. Their output is\n");
+    printf("    still written in statement order. Builtins, assignments and\n");
+    printf("    statements using $?, $! or substitutions are barriers, and so is\n");
+    printf("    any control structure of a script. Every argument counts as a file.\n");
+    printf("    When the shell reads a pipe or file, only one statement of a batch\n");
+    printf("    may read it; statements reading the terminal are not kept apart.\n\n");
+
+    printf("set -o zygote\n");
+    printf("    Starts foreground commands from a small spawn server process instead\n");
+    printf("    of forking the shell, so launching stays fast as the shell grows.\n\n");
+
+    printf("stats [-l socket | -u]\n");
+    printf("    Prints counters and latency histograms of the shell in the Prometheus\n");
+    printf("    text format. -l also serves them on a Unix domain socket, -u stops it.\n\n");
+
+    printf("shell --serve socket [-j workers], shell --connect socket [line]...\n");
+    printf("    Runs the shell as a daemon serving command lines on a Unix domain\n");
+    printf("    socket, and sends lines to it. Each connection is a session with its\n");
+    printf("    own directory and variables; output goes straight to the client.\n\n");
+
+    printf("alias [name[=value]]...\n");
+    printf("    Defines aliases, replacing the first word of a command, or lists them.\n\n");
+
+    printf("~/.simpleshrc, shell --startup-profile\n");
+    printf("    Run before the first prompt ($SIMPLESHRC names another file). Lines\n");
+    printf("    'alias name=value' and functions 'name() { ... }' are only indexed and\n");
+    printf("    parsed on first use. '## name' starts a section; --startup-profile\n");
+    printf("    prints the time spent in each, and the time to the first prompt.\n\n");
+
+    printf("shell script, shell --compile script [-o script.shc]\n");
+    printf("    Runs a script. --compile parses it once into a .shc file, which the\n");
+    printf("    shell maps and runs without parsing; if the script has changed since,\n");
+    printf("    the script itself is run.\n\n");
+
+    printf("watch [-k] [-d ms] -p pattern [-p pattern]... -- command\n");
+    printf("    Runs command, then again whenever files matching the patterns change,\n");
+    printf("    until Ctrl-C. Changes during a run queue another run; -k cancels the\n");
+    printf("    run instead. -d sets the quiet time before a rerun (100 ms).\n\n");
+
+    printf("wait [-n] [pid]...\n");
+    printf("    Waits for all background commands, for the given process ids, or with\n");
+    printf("    -n for the next background command to finish. $! is the last one.\n\n");
+
+    printf("export [name[=value]]..., unset name..., set [-o|+o [option]...]\n");
+    printf("    Export variables to commands, remove variables, list variables.\n");
+    printf("    Variables are assigned with name=value and expanded with $name,\n");
+    printf("    ${name} and ${name:-default}. $? holds the last exit status.\n");
+    printf("    $(command) and `command` are replaced by the output of command.\n");
+    printf("    <(command) and >(command) are replaced by a /dev/fd path that reads\n");
+    printf("    the output of, or writes to the input of, command.\n\n");
+
+    printf("if, while, until, for, case\n");
+    printf("    Compound commands, which may span several lines. Examples:\n");
+    printf("    if test -f x; then echo yes; else echo no; fi\n");
+    printf("    for f in a b c; do echo $f; done\n");
+    printf("    case x in a|b) echo ab ;; *) echo other ;; esac\n\n");
+
+    printf("echo, printf, test, [, true, false, :, cat, cp\n");
+    printf("    Run inside the shell without starting a new process. They honour\n");
+    printf("    input and output redirection and can be used as pipeline stages.\n\n");
+
     printf("--------------------------------------------------------------------------------\n");
     printf("For more information on each command, refer to the assignment documentation\n");
 
@@ -822,7 +1348,7 @@ int wildcard_handler(command **cmd_stack, int current)
     {
         globbuf.gl_offs = wc_count;
         // initialise first wildcard
-        if (glob(cmd_stack[current]->argv[wc_pos[0]], GLOB_DOOFFS, NULL, &globbuf) == GLOB_NOMATCH)
+        if (metrics_glob(cmd_stack[current]->argv[wc_pos[0]], GLOB_DOOFFS, &globbuf) == GLOB_NOMATCH)
         {
             return wc_count = 0;
         }
@@ -830,7 +1356,7 @@ int wildcard_handler(command **cmd_stack, int current)
         // append subsequent wildcards
         for (int i = 1; i < wc_pos_count; i++)
         {
-            glob(cmd_stack[current]->argv[wc_pos[i]], GLOB_DOOFFS | GLOB_APPEND, NULL, &globbuf);
+            metrics_glob(cmd_stack[current]->argv[wc_pos[i]], GLOB_DOOFFS | GLOB_APPEND, &globbuf);
         }
 
         int is_wc = 0;
@@ -861,19 +1387,8 @@ int wildcard_handler(command **cmd_stack, int current)
 // Function to clean up (reap) zombie child processes.
 void claim_zombies()
 {
-    pid_t pid;
-    int status;
-
-    // Repeatedly call waitpid with WNOHANG until no more zombies are found
-    while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
-    {
-        // log the PID and status of reaped children
-        printf("Reaped child process with PID: %d, Status: %d\n", pid, status);
-    }
-
-    // If waitpid returns -1 and errno is set to ECHILD (there are no child processes)
-    if (pid == -1 && errno != ECHILD)
-    {
-        perror("waitpid failed");
-    }
+    // Only the tracked children that have exited are reaped; children
+    // waited for by their owner (foreground commands, substitutions)
+    // are never taken from under it
+    jobs_reap();
 }
@@ -27,18 +27,37 @@
 #define MAX_ARRAY_SIZE 500
 #define HISTORY_SIZE 100
 
-/* int main(void)
+/* Exit status of the last command executed */
+extern int last_status;
+
+/* Set when Ctrl-C reaches the shell or kills a foreground command;
+ * cleared before each command line. Loops and lists stop when it is set. */
+extern volatile sig_atomic_t interrupted;
+
+/* Process id of the last background command */
+extern pid_t last_bg_pid;
+
+/* The directory before the last change of directory, for "cd -" */
+extern char prev_dir[MAX_BUF_SIZE];
+extern int prev_dir_flag;
+
+/* int main(int argc, char **argv)
  * This is the main script that will run when running the shell program
  * Sets the signal blockers and start taking in input from stdin
- *
+ * Started with SPAWN_SERVER_FLAG it runs the spawn server instead, and
+ * with SERVE_FLAG or CONNECT_FLAG the daemon or its client (serve.h),
+ * with SHC_COMPILE_FLAG the script compiler and with a file name that
+ * script (shc.h). Otherwise the startup file is run first (rc.h).
  *
  * Returns :
  *      0 - successful termination of function
  */
-int main(void);
+int main(int argc, char **argv);
 
 /* void setup_signal_handlers()
- * Sets up signal handlers for the shell.
+ * Sets up signal handlers for the shell. SIGTSTP and SIGQUIT are
+ * ignored; SIGINT only sets interrupted, so the commands the shell
+ * executes get the default action back.
  *
  * No arguments.
  *
@@ -55,15 +74,38 @@ void setup_signal_handlers();
  */
 void run_shell_loop();
 
-/* char *read_command_line()
- * Reads a line of input from the user.
+/* char *read_command_line(const char *prompt)
+ * Reads a line of input from the user with the line editor (see edit.h)
+ * and adds it to the history.
  *
- * No arguments.
+ * Arguments :
+ *      prompt - the prompt to print
  *
  * Returns:
  *      A dynamically allocated string containing the input line.
  */
-char *read_command_line();
+char *read_command_line(const char *prompt);
+
+/* void run_line(char *line)
+ * Parses and executes a line of simple commands (no compound commands).
+ *
+ * Arguments :
+ *      line - the command line
+ *
+ * No return value.
+ */
+void run_line(char *line);
+
+/* void run_compound(char *line)
+ * Compiles and runs a compound command (if, while, until, for, case).
+ * Further lines are read with a "> " prompt until the command is complete.
+ *
+ * Arguments:
+ *      line - the first line of the compound command
+ *
+ * No return value.
+ */
+void run_compound(char *line);
 
 /* int execute_stack (command ** cmd_stack);
  *
@@ -81,6 +123,24 @@ char *read_command_line();
  */
 int execute_stack(command **cmd_stack);
 
+/* void exec_command(command *cmd, char **argv)
+ *
+ * This function replaces the current (child) process with the program
+ * named by argv[0]. The program is searched in the directories of the
+ * shell's PATH variable and started with execve() using the cached
+ * environment from vars_envp(). Assignments given before the command
+ * name are added to its environment.
+ *
+ * Arguments :
+ *      cmd - the command struct (for its assignments)
+ *      argv - the argument vector to execute
+ *
+ * Returns :
+ *      Does not return. Exits with 127 if the program was not found
+ *      and 126 if it could not be executed.
+ */
+void exec_command(command *cmd, char **argv);
+
 /* int exec_sequential (command ** cmd_stack, int current)
  *
  * This function sequentially executes command information stored
@@ -136,6 +196,21 @@ int exec_concurrent(command **cmd_stack, int current);
  */
 int exec_pipe(command **cmd_stack, int current);
 
+/* int is_builtin(const char *name)
+ *
+ * This function checks whether a command name is one of the builtin
+ * commands, which run in the shell itself. builtin_menu() dispatches on
+ * the number it returns.
+ *
+ * Arguments :
+ *      name - the command name
+ *
+ * Returns :
+ *      the position of name among the builtins, counting from 1
+ *      0 - name is not a builtin
+ */
+int is_builtin(const char *name);
+
 /* int builtin_menu (command *cmd)
  *
  * This function checks which of the builtin commands is the
@@ -151,6 +226,18 @@ int exec_pipe(command **cmd_stack, int current);
  *	3 - processes builtin_help
  *	4 - processes builtin_prompt
  *	5 - processes builtin_exit
+ *	6 - processes builtin_history
+ *	7 - processes builtin_export
+ *	8 - processes builtin_unset
+ *	9 - processes builtin_set
+ *	10 - processes builtin_wait
+ *	11 - processes builtin_pushd
+ *	12 - processes builtin_popd
+ *	13 - processes builtin_dirs
+ *	14 - processes builtin_z
+ *	15 - processes builtin_stats
+ *	16 - processes builtin_watch
+ *	17 - processes builtin_alias
  *     -1 - error in processing builtin functions
  */
 int builtin_menu(command *cmd);
@@ -179,6 +266,7 @@ int builtin_cd(command *cmd);
  * This function checks the passed command struct if there are arguments.
  * If there are arguments: change the current prompt (e.g. default prompt'%')
  * to the argument passed in as the new prompt (e.g. '$')
+ * The prompt may contain the escapes expanded by prompt_render().
  * If no argument is passed: return error code of -1
  *
  * Arguments :
@@ -236,9 +324,13 @@ int builtin_exit();
  */
 int wildcard_handler(command **cmd_stack, int current);
 
+/* The expansion made by the last wildcard_handler() */
+extern glob_t globbuf;
+
 /* void claim_zombies()
  *
- * This function claims the zombies processes
+ * This function claims the zombies processes. Only the children handed
+ * to jobs_track() are reaped (see jobs.h).
  *
  * Returns :
  *      None
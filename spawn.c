@@ -0,0 +1,305 @@
+/*
+ * Spawn.c
+ * The spawn server and its client. The shell and the server talk over a
+ * SOCK_SEQPACKET socket pair, so every request and reply is one message.
+ * The server is a fresh execve() of the shell binary; it never grows,
+ * so forking it stays cheap however large the interactive shell becomes.
+ * Authors : Aloysious Kok & Gerald
+ * Last Update : 18/10/26
+ */
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/signalfd.h>
+#include "spawn.h"
+#include "vars.h"
+#include "pin.h"
+#include "memo.h"
+#include "metrics.h"
+
+static int server_sock = -1;
+static pid_t server_pid = 0;
+static pid_t owner_pid = 0;
+
+/* Stops the server after a failure; the next request starts a new one */
+static void spawn_stop()
+{
+    close(server_sock);
+    server_sock = -1;
+    waitpid(server_pid, NULL, 0);
+    server_pid = 0;
+}
+
+static int spawn_start()
+{
+    int sv[2];
+    char fd_arg[16];
+
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) == -1)
+    {
+        perror("socketpair");
+        return -1;
+    }
+
+    fflush(stdout);
+    server_pid = fork();
+    if (server_pid == 0)
+    {
+        // only the server end survives the execve(): descriptors of the
+        // shell such as substitution pipes must not be held open by it
+        fcntl(sv[1], F_SETFD, 0);
+        if (sv[1] > 3)
+            close_range(3, sv[1] - 1, 0);
+        close_range(sv[1] + 1, ~0U, 0);
+        snprintf(fd_arg, sizeof(fd_arg), "%d", sv[1]);
+        char *argv[] = {"shell", SPAWN_SERVER_FLAG, fd_arg, NULL};
+        execve("/proc/self/exe", argv, environ);
+        _exit(127);
+    }
+    close(sv[1]);
+    if (server_pid < 0)
+    {
+        perror("fork");
+        close(sv[0]);
+        server_pid = 0;
+        return -1;
+    }
+
+    server_sock = sv[0];
+    owner_pid = getpid();
+    return 0;
+}
+
+/* Appends a string and its '\0' to the request buffer */
+static char *put_string(char *p, const char *s)
+{
+    size_t len = strlen(s) + 1;
+    memcpy(p, s, len);
+    return p + len;
+}
+
+int spawn_run(char **argv, char **envp, const int fds[3], int *status)
+{
+    char cwd[MAX_BUF_SIZE];
+    spawn_request req = {0};
+    spawn_reply reply;
+    size_t size = sizeof(req);
+    char control[CMSG_SPACE(3 * sizeof(int))] = {0};
+
+    // a forked copy of the shell must not talk over the parent's socket
+    if (!shell_option(OPT_ZYGOTE) || (server_pid != 0 && owner_pid != getpid()))
+    {
+        return -1;
+    }
+    if (getcwd(cwd, sizeof(cwd)) == NULL)
+    {
+        return -1;
+    }
+
+    size += strlen(cwd) + 1;
+    for (; argv[req.argc] != NULL; req.argc++)
+        size += strlen(argv[req.argc]) + 1;
+    for (; envp[req.envc] != NULL; req.envc++)
+        size += strlen(envp[req.envc]) + 1;
+    if (size > SPAWN_MSG_MAX)
+    {
+        return -1;
+    }
+    if (server_sock == -1 && spawn_start() < 0)
+    {
+        return -1;
+    }
+
+    char *buf = malloc(size);
+    char *p = buf + sizeof(req);
+    memcpy(buf, &req, sizeof(req));
+    p = put_string(p, cwd);
+    for (int i = 0; i < req.argc; i++)
+        p = put_string(p, argv[i]);
+    for (int i = 0; i < req.envc; i++)
+        p = put_string(p, envp[i]);
+
+    struct iovec iov = {buf, size};
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(3 * sizeof(int));
+    memcpy(CMSG_DATA(cmsg), fds, 3 * sizeof(int));
+
+    fflush(stdout);
+    uint64_t start = metrics_now();
+    ssize_t sent = sendmsg(server_sock, &msg, MSG_NOSIGNAL);
+    free(buf);
+    if (sent != (ssize_t)size)
+    {
+        spawn_stop();
+        return -1;
+    }
+
+    // the first reply says whether the command started
+    if (recv(server_sock, &reply, sizeof(reply), 0) != sizeof(reply) || reply.type != SPAWN_STARTED)
+    {
+        spawn_stop();
+        return -1;
+    }
+    if (reply.pid < 0)
+    {
+        return -1;
+    }
+    metrics_count(M_EXTERNAL, 1);
+    metrics_observe(H_FORK_EXEC, start);
+
+    pid_t pid = reply.pid;
+    while (1)
+    {
+        ssize_t n = recv(server_sock, &reply, sizeof(reply), 0);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n != sizeof(reply))
+        {
+            fprintf(stderr, "spawn server exited while running %s\n", argv[0]);
+            spawn_stop();
+            *status = W_EXITCODE(1, 0);
+            return 0;
+        }
+        if (reply.type == SPAWN_EXITED && reply.pid == pid)
+            break;
+    }
+    *status = reply.status;
+    return 0;
+}
+
+/* Runs in the forked child of the server: becomes the requested command */
+static void spawn_exec(char *cwd, char **argv, char **envp, const int *fds)
+{
+    for (int i = 0; i < 3; i++)
+    {
+        dup2(fds[i], i);
+    }
+    // nothing but the three descriptors reaches the command
+    close_range(3, ~0U, 0);
+    signal(SIGINT, SIG_DFL);
+    if (chdir(cwd) == -1)
+    {
+        perror(cwd);
+        _exit(1);
+    }
+
+    if (memo_is_prefix(argv[0]) && (argv = memo_apply(argv, envp)) == NULL)
+    {
+        _exit(2);
+    }
+    if (pin_is_prefix(argv[0]) && (argv = pin_apply(argv)) == NULL)
+    {
+        _exit(2);
+    }
+
+    // execvp() searches the PATH of the command's own environment
+    environ = envp;
+    execvp(argv[0], argv);
+    fprintf(stderr, "%s: %s\n", argv[0], errno == ENOENT ? "command not found" : strerror(errno));
+    _exit(errno == ENOENT ? 127 : 126);
+}
+
+void spawn_serve(int sock)
+{
+    sigset_t mask, old_mask;
+    spawn_reply reply = {0};
+    char *buf = malloc(SPAWN_MSG_MAX);
+    char control[CMSG_SPACE(3 * sizeof(int))];
+    int status;
+    pid_t pid;
+
+    // exits are read from a signalfd in the same poll() as requests
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, &old_mask);
+    signal(SIGCHLD, SIG_DFL);
+    int sfd = signalfd(-1, &mask, SFD_CLOEXEC);
+    fcntl(sock, F_SETFD, FD_CLOEXEC);
+    // Ctrl-C is for the command, the server outlives it
+    signal(SIGINT, SIG_IGN);
+
+    struct pollfd pfd[2] = {{sock, POLLIN, 0}, {sfd, POLLIN, 0}};
+    while (1)
+    {
+        if (poll(pfd, 2, -1) == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        if (pfd[1].revents & POLLIN)
+        {
+            struct signalfd_siginfo si;
+            read(sfd, &si, sizeof(si));
+            while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+            {
+                reply = (spawn_reply){SPAWN_EXITED, pid, status};
+                send(sock, &reply, sizeof(reply), MSG_NOSIGNAL);
+            }
+        }
+
+        if (pfd[0].revents == 0)
+            continue;
+
+        struct iovec iov = {buf, SPAWN_MSG_MAX - 1};
+        struct msghdr msg = {0};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        ssize_t n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+        if (n <= 0)
+            break; // the shell has gone
+
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        int fds[3];
+        if ((size_t)n < sizeof(spawn_request) || cmsg == NULL || cmsg->cmsg_type != SCM_RIGHTS ||
+            cmsg->cmsg_len != CMSG_LEN(3 * sizeof(int)))
+        {
+            reply = (spawn_reply){SPAWN_STARTED, -EINVAL, 0};
+            send(sock, &reply, sizeof(reply), MSG_NOSIGNAL);
+            continue;
+        }
+        memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+
+        // unpack the strings in place
+        spawn_request req;
+        memcpy(&req, buf, sizeof(req));
+        buf[n] = '\0';
+        char *p = buf + sizeof(req);
+        char *cwd = p;
+        char **argv = malloc((req.argc + 1) * sizeof(char *));
+        char **envp = malloc((req.envc + 1) * sizeof(char *));
+        p += strlen(p) + 1;
+        for (int i = 0; i < req.argc; i++, p += strlen(p) + 1)
+            argv[i] = p;
+        for (int i = 0; i < req.envc; i++, p += strlen(p) + 1)
+            envp[i] = p;
+        argv[req.argc] = NULL;
+        envp[req.envc] = NULL;
+
+        pid = fork();
+        if (pid == 0)
+        {
+            sigprocmask(SIG_SETMASK, &old_mask, NULL);
+            spawn_exec(cwd, argv, envp, fds);
+        }
+        for (int i = 0; i < 3; i++)
+            close(fds[i]);
+        free(argv);
+        free(envp);
+
+        reply = (spawn_reply){SPAWN_STARTED, pid < 0 ? -errno : pid, 0};
+        send(sock, &reply, sizeof(reply), MSG_NOSIGNAL);
+    }
+    exit(EXIT_SUCCESS);
+}
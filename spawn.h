@@ -0,0 +1,75 @@
+#ifndef SPAWN_H
+#define SPAWN_H
+
+/*
+ * Spawn.h
+ * Optional spawn server (set -o zygote). A small helper process launches
+ * external commands on behalf of the shell, so that the cost of starting
+ * a command does not grow with the shell's address space.
+ * Authors : Aloysious Kok & Gerald
+ * Last Update : 18/10/26
+ */
+
+#include "shell.h"
+
+/* Command line flag that turns the shell binary into the spawn server */
+#define SPAWN_SERVER_FLAG "--spawn-server"
+
+/* Largest request (cwd, argv and envp strings) sent to the server */
+#define SPAWN_MSG_MAX (256 * 1024)
+
+/* Types of the replies sent by the server */
+#define SPAWN_STARTED 1 // pid is the new process, or -errno if fork failed
+#define SPAWN_EXITED 2  // the process pid has exited with the raw wait status
+
+/* A request header, followed by the cwd, argv and envp strings, each
+ * terminated by '\0'. The stdin, stdout and stderr of the command are
+ * passed along with it as SCM_RIGHTS. */
+typedef struct Spawn_request_struct
+{
+    int argc;
+    int envc;
+} spawn_request;
+
+/* A reply of the server */
+typedef struct Spawn_reply_struct
+{
+    int type;
+    pid_t pid;
+    int status;
+} spawn_reply;
+
+/* int spawn_run(char **argv, char **envp, const int fds[3], int *status)
+ *
+ * This function runs a foreground command through the spawn server and
+ * waits for it to exit. The server is started the first time it is
+ * needed, by executing the shell binary again with SPAWN_SERVER_FLAG so
+ * that it starts from a fresh, minimal image.
+ *
+ * Arguments :
+ *      argv - the command and its arguments
+ *      envp - the environment of the command
+ *      fds - the descriptors that become its stdin, stdout and stderr
+ *      status - receives the raw wait status of the command
+ *
+ * Returns :
+ *      0 - the command was run through the server
+ *     -1 - the server is off or unusable, the caller must fork() itself
+ */
+int spawn_run(char **argv, char **envp, const int fds[3], int *status);
+
+/* void spawn_serve(int sock)
+ *
+ * The main loop of the spawn server. Requests are read from the socket,
+ * each command is forked and executed, and its pid and exit status are
+ * sent back. Returns only by exiting, when the shell closes the socket.
+ *
+ * Arguments :
+ *      sock - the server end of the socket pair created by the shell
+ *
+ * Returns :
+ *      None
+ */
+void spawn_serve(int sock);
+
+#endif
@@ -0,0 +1,286 @@
+/*
+ * Term.c
+ * The terminal mode is tracked so that tcsetattr() is only called when
+ * the mode really changes: once when a foreground command is started
+ * and once when the next line is read, instead of twice per line.
+ * Echo and redraws are collected in a render buffer that is written
+ * once per batch of input rather than once per character.
+ * Authors : Aloysious Kok & Gerald
+ * Last Update : 18/10/26
+ */
+
+#include <poll.h>
+#include "term.h"
+
+static struct termios cooked, raw;
+
+// render buffer, written out by term_flush()
+static char *out_buf = NULL;
+static size_t out_len = 0;
+static size_t out_size = 0;
+
+// descriptors watched while waiting for input
+static struct
+{
+    int fd;
+    term_handler handler;
+} watches[TERM_MAX_WATCH];
+static int n_watches = 0;
+
+// the current batch of input
+static char in_buf[TERM_IN_SIZE];
+static size_t in_pos = 0;
+static size_t in_len = 0;
+static int is_tty = 0;
+static int in_raw = 0;
+static pid_t term_pid = 0;
+static int paste_mode = 0; // bracketed paste is switched with the raw mode
+
+/* Leaves the terminal usable when the shell exits, through any path */
+static void term_restore()
+{
+    // forked children also run atexit handlers; the terminal is not theirs
+    if (getpid() == term_pid)
+    {
+        term_cooked();
+    }
+}
+
+void term_init()
+{
+    if (!isatty(STDIN_FILENO) || tcgetattr(STDIN_FILENO, &cooked) == -1)
+    {
+        return;
+    }
+
+    raw = cooked;
+    raw.c_lflag &= ~(ICANON | ECHO);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+
+    is_tty = 1;
+    term_pid = getpid();
+    // the escape sequences are only written to a terminal
+    paste_mode = isatty(STDOUT_FILENO);
+    atexit(term_restore);
+}
+
+void term_raw()
+{
+    // a forked child inherits in_raw, but the terminal mode is not its own
+    if (getpid() != term_pid)
+    {
+        return;
+    }
+    if (is_tty && !in_raw && tcsetattr(STDIN_FILENO, TCSANOW, &raw) == 0)
+    {
+        in_raw = 1;
+        // written with the prompt, not on its own
+        if (paste_mode)
+            term_puts(PASTE_ON);
+    }
+}
+
+void term_cooked()
+{
+    if (getpid() != term_pid)
+    {
+        return;
+    }
+    // TCSANOW keeps keystrokes typed ahead, in either direction
+    if (is_tty && in_raw && tcsetattr(STDIN_FILENO, TCSANOW, &cooked) == 0)
+    {
+        in_raw = 0;
+        if (paste_mode)
+            term_puts(PASTE_OFF);
+        term_flush();
+    }
+}
+
+void term_write(const char *s, size_t len)
+{
+    if (out_len + len > out_size)
+    {
+        while (out_len + len > out_size)
+            out_size = out_size ? out_size * 2 : TERM_OUT_SIZE;
+        out_buf = realloc(out_buf, out_size);
+    }
+    memcpy(out_buf + out_len, s, len);
+    out_len += len;
+}
+
+void term_puts(const char *s)
+{
+    term_write(s, strlen(s));
+}
+
+void term_putc(char c)
+{
+    term_write(&c, 1);
+}
+
+void term_flush()
+{
+    size_t done = 0;
+
+    // whatever printf() left behind comes first
+    fflush(stdout);
+    while (done < out_len)
+    {
+        ssize_t n = write(STDOUT_FILENO, out_buf + done, out_len - done);
+        if (n == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        done += n;
+    }
+    out_len = 0;
+}
+
+int term_watch(int fd, term_handler handler)
+{
+    if (n_watches == TERM_MAX_WATCH)
+    {
+        return -1;
+    }
+    watches[n_watches].fd = fd;
+    watches[n_watches].handler = handler;
+    n_watches++;
+    return 0;
+}
+
+void term_unwatch(int fd)
+{
+    for (int i = 0; i < n_watches; i++)
+    {
+        if (watches[i].fd == fd)
+        {
+            watches[i] = watches[--n_watches];
+            return;
+        }
+    }
+}
+
+/* Runs the handlers of watched descriptors until input is available */
+static void wait_input()
+{
+    struct pollfd pfds[TERM_MAX_WATCH + 1];
+
+    while (n_watches > 0)
+    {
+        int n = n_watches;
+        pfds[0] = (struct pollfd){STDIN_FILENO, POLLIN, 0};
+        for (int i = 0; i < n; i++)
+            pfds[i + 1] = (struct pollfd){watches[i].fd, POLLIN, 0};
+
+        if (poll(pfds, n + 1, -1) == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            return;
+        }
+
+        // handlers may unwatch, so look the descriptors up again
+        for (int i = 1; i <= n; i++)
+        {
+            if (pfds[i].revents == 0)
+                continue;
+            for (int j = 0; j < n_watches; j++)
+            {
+                if (watches[j].fd == pfds[i].fd)
+                {
+                    watches[j].handler(pfds[i].fd);
+                    break;
+                }
+            }
+        }
+        term_flush();
+
+        if (pfds[0].revents != 0)
+            return;
+    }
+}
+
+int term_getc()
+{
+    if (in_pos == in_len)
+    {
+        ssize_t n;
+
+        // the previous batch is fully echoed before blocking for more
+        term_flush();
+        wait_input();
+        do
+        {
+            n = read(STDIN_FILENO, in_buf, sizeof(in_buf));
+        } while (n == -1 && errno == EINTR);
+
+        if (n <= 0)
+            return EOF;
+        in_pos = 0;
+        in_len = n;
+    }
+    return (unsigned char)in_buf[in_pos++];
+}
+
+size_t term_read_paste(char *dst, size_t room)
+{
+    static const char end[] = PASTE_END;
+    size_t len = 0;
+    size_t matched = 0;
+    size_t mark = 0; // length of the text before a possible end marker
+
+    while (1)
+    {
+        char *chunk;
+        ssize_t n;
+
+        if (in_pos < in_len)
+        {
+            chunk = in_buf + in_pos;
+            n = in_len - in_pos;
+            in_pos = in_len;
+        }
+        else
+        {
+            // bulk reads straight into the line while it has room
+            chunk = (room - len >= TERM_IN_SIZE) ? dst + len : in_buf;
+            n = read(STDIN_FILENO, chunk, chunk == in_buf ? sizeof(in_buf) : room - len);
+            if (n == -1 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return len;
+        }
+
+        for (ssize_t i = 0; i < n; i++)
+        {
+            char c = chunk[i];
+            int stored = (len < room);
+
+            // a no-op when the chunk was read into dst
+            if (stored)
+                dst[len++] = c;
+
+            if (c == end[matched])
+                matched++;
+            else
+                matched = (c == end[0]);
+            if (matched == 1)
+                mark = stored ? len - 1 : len;
+
+            if (matched == sizeof(end) - 1)
+            {
+                // anything after the marker was typed after the paste
+                size_t rest = n - i - 1;
+                if (rest > sizeof(in_buf))
+                    rest = sizeof(in_buf);
+                memmove(in_buf, chunk + i + 1, rest);
+                in_pos = 0;
+                in_len = rest;
+                return mark;
+            }
+        }
+    }
+}
@@ -0,0 +1,156 @@
+#ifndef TERM_H
+#define TERM_H
+
+/*
+ * Term.h
+ * Terminal manager: the terminal stays in raw mode while the shell reads
+ * command lines and is switched to cooked mode only when a foreground
+ * command is given the terminal
+ * Authors : Aloysious Kok & Gerald
+ * Last Update : 18/10/26
+ */
+
+#include "shell.h"
+
+/* Size of an input batch read by term_getc() */
+#define TERM_IN_SIZE 4096
+
+/* Initial size of the render buffer */
+#define TERM_OUT_SIZE 4096
+
+/* Bracketed paste: switched on in raw mode, and the markers the
+ * terminal puts around pasted text */
+#define PASTE_ON "\33[?2004h"
+#define PASTE_OFF "\33[?2004l"
+#define PASTE_START "\33[200~"
+#define PASTE_END "\33[201~"
+
+/* void term_init()
+ *
+ * This function saves the cooked terminal settings the shell was started
+ * with and registers their restoration at exit. Nothing is done when
+ * standard input is not a terminal.
+ *
+ * Returns :
+ *      None
+ */
+void term_init();
+
+/* void term_raw()
+ *
+ * Puts the terminal in raw mode (no canonical input, no echo) for the
+ * line editor. Does nothing if it already is, so reading a line after
+ * a builtin costs no system call. Only the shell that called
+ * term_init() switches the mode; in a forked child this does nothing.
+ *
+ * Returns :
+ *      None
+ */
+void term_raw();
+
+/* void term_cooked()
+ *
+ * Gives the terminal its saved cooked settings back, before a
+ * foreground command that may read from it is started. Does nothing if
+ * it already has them, and in a forked child, whose parent still
+ * owns the terminal.
+ *
+ * Returns :
+ *      None
+ */
+void term_cooked();
+
+/* void term_write(const char *s, size_t len)
+ *
+ * Appends output for the terminal (echo, cursor movement, redraws) to
+ * the render buffer. Nothing is written until term_flush().
+ *
+ * Arguments :
+ *      s - the bytes to append
+ *      len - the number of bytes
+ *
+ * Returns :
+ *      None
+ */
+void term_write(const char *s, size_t len);
+
+/* void term_puts(const char *s)
+ *
+ * Appends a string to the render buffer.
+ */
+void term_puts(const char *s);
+
+/* void term_putc(char c)
+ *
+ * Appends a character to the render buffer.
+ */
+void term_putc(char c);
+
+/* void term_flush()
+ *
+ * Writes the render buffer to standard output with a single write(),
+ * after anything still buffered by stdio.
+ *
+ * Returns :
+ *      None
+ */
+void term_flush();
+
+/* int term_getc()
+ *
+ * Returns the next input character. Input is read in batches with
+ * read(); the render buffer is flushed only when a batch has been used
+ * up, so a whole batch of keystrokes is echoed with one write().
+ *
+ * Returns :
+ *      the character read
+ *      EOF - end of input or read error
+ */
+int term_getc();
+
+/* Largest number of descriptors watched with term_watch() */
+#define TERM_MAX_WATCH 16
+
+/* Called by term_getc() when a watched descriptor is readable */
+typedef void (*term_handler)(int fd);
+
+/* int term_watch(int fd, term_handler handler)
+ *
+ * This function makes term_getc() watch a descriptor while it waits for
+ * input, and call handler when the descriptor becomes readable. Used
+ * for work that finishes while the user is typing, such as the prompt
+ * segments of prompt.c.
+ *
+ * Arguments :
+ *      fd - the descriptor to watch
+ *      handler - the function to call; it may call term_unwatch()
+ *
+ * Returns :
+ *      0 - successful
+ *     -1 - too many descriptors are watched
+ */
+int term_watch(int fd, term_handler handler);
+
+/* void term_unwatch(int fd)
+ *
+ * Stops watching a descriptor.
+ */
+void term_unwatch(int fd);
+
+/* size_t term_read_paste(char *dst, size_t room)
+ *
+ * This function is called after PASTE_START has been read. It copies
+ * the pasted text up to PASTE_END into dst. Once the current input batch
+ * is used up, the rest of the paste is read with large read() calls
+ * straight into dst. Text that does not fit is read and dropped.
+ *
+ * Arguments :
+ *      dst - where the pasted text is stored
+ *      room - the space left in dst
+ *
+ * Returns :
+ *      the number of bytes stored in dst
+ */
+size_t term_read_paste(char *dst, size_t room);
+
+#endif
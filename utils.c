@@ -0,0 +1,955 @@
+/*
+ * Utils.c
+ * In-process implementations of frequently used utilities, so that
+ * scripts do not pay a fork() and execvp() for every echo or test
+ * Authors : Aloysious Kok & Gerald
+ * Last Update : 18/10/26
+ */
+
+#include <ctype.h>
+#include <libgen.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+#include "utils.h"
+#include "term.h"
+#include "pipes.h"
+
+// table of in-process utilities, searched by util_lookup()
+static const struct
+{
+    const char *name;
+    util_fn fn;
+} util_table[] = {
+    {"echo", util_echo},
+    {"printf", util_printf},
+    {"test", util_test},
+    {"[", util_test},
+    {"true", util_true},
+    {":", util_true},
+    {"false", util_false},
+    {"cat", util_cat},
+    {"cp", util_cp},
+};
+
+// set while cat copies, when Ctrl-C asks it to stop
+static volatile sig_atomic_t copy_interrupted = 0;
+
+static void copy_interrupt(int sig)
+{
+    (void)sig;
+    copy_interrupted = 1;
+}
+
+util_fn util_lookup(const char *name)
+{
+    if (name == NULL)
+    {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < sizeof(util_table) / sizeof(util_table[0]); i++)
+    {
+        if (strcmp(name, util_table[i].name) == 0)
+        {
+            return util_table[i].fn;
+        }
+    }
+    return NULL;
+}
+
+int util_run_redirected(command *cmd, char **argv, util_fn fn)
+{
+    int saved_in = -1;
+    int saved_out = -1;
+    int fd;
+    int status;
+    sigset_t block, old_mask;
+
+    // anything already buffered belongs to the old stdout
+    fflush(stdout);
+
+    // keep claim_zombies() from printing into the redirected stdout
+    sigemptyset(&block);
+    sigaddset(&block, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &block, &old_mask);
+
+    // redirect input
+    if (cmd->redirect_in != NULL)
+    {
+        if ((fd = open(cmd->redirect_in, O_RDONLY)) == -1)
+        {
+            perror(cmd->redirect_in);
+            sigprocmask(SIG_SETMASK, &old_mask, NULL);
+            return 1;
+        }
+        saved_in = dup(STDIN_FILENO);
+        dup2(fd, STDIN_FILENO);
+        close(fd);
+    }
+
+    // redirect output, same mode as for external commands
+    if (cmd->redirect_out != NULL)
+    {
+        if ((fd = pipes_open_output(cmd, 0)) == -1)
+        {
+            if (saved_in != -1)
+            {
+                dup2(saved_in, STDIN_FILENO);
+                close(saved_in);
+            }
+            sigprocmask(SIG_SETMASK, &old_mask, NULL);
+            return 1;
+        }
+        saved_out = dup(STDOUT_FILENO);
+        dup2(fd, STDOUT_FILENO);
+        close(fd);
+    }
+
+    status = fn(argv);
+    fflush(stdout);
+
+    // restore the shell's own descriptors
+    if (saved_out != -1)
+    {
+        dup2(saved_out, STDOUT_FILENO);
+        close(saved_out);
+    }
+    if (saved_in != -1)
+    {
+        dup2(saved_in, STDIN_FILENO);
+        close(saved_in);
+    }
+    sigprocmask(SIG_SETMASK, &old_mask, NULL);
+    return status;
+}
+
+ssize_t util_copy_fd(int in_fd, int out_fd)
+{
+    struct stat in_st, out_st;
+    ssize_t total = 0;
+    ssize_t n = 0;
+    static char buf[COPY_BUF_SIZE];
+
+    if (fstat(in_fd, &in_st) == -1 || fstat(out_fd, &out_st) == -1)
+    {
+        return -1;
+    }
+
+    // file to file: the kernel copies (or shares extents) directly
+    if (S_ISREG(in_st.st_mode) && S_ISREG(out_st.st_mode))
+    {
+        while (!copy_interrupted && (n = copy_file_range(in_fd, NULL, out_fd, NULL, COPY_BUF_SIZE * 64, 0)) > 0)
+        {
+            total += n;
+        }
+        if (copy_interrupted)
+        {
+            errno = EINTR;
+            return -1;
+        }
+        if (n == 0)
+        {
+            return total;
+        }
+        if (errno != EXDEV && errno != EINVAL && errno != ENOSYS &&
+            errno != EOPNOTSUPP && errno != EBADF)
+        {
+            return -1;
+        }
+    }
+
+    // either side is a pipe: move pages without copying them to userspace
+    if (S_ISFIFO(in_st.st_mode) || S_ISFIFO(out_st.st_mode))
+    {
+        while (!copy_interrupted && (n = splice(in_fd, NULL, out_fd, NULL, COPY_BUF_SIZE * 8, SPLICE_F_MOVE)) > 0)
+        {
+            total += n;
+        }
+        if (copy_interrupted)
+        {
+            errno = EINTR;
+            return -1;
+        }
+        if (n == 0)
+        {
+            return total;
+        }
+        if (errno != EINVAL && errno != ENOSYS)
+        {
+            return -1;
+        }
+    }
+
+    // regular file to anything else (sockets, terminals, character devices)
+    if (S_ISREG(in_st.st_mode))
+    {
+        while (!copy_interrupted && (n = sendfile(out_fd, in_fd, NULL, COPY_BUF_SIZE * 64)) > 0)
+        {
+            total += n;
+        }
+        if (copy_interrupted)
+        {
+            errno = EINTR;
+            return -1;
+        }
+        if (n == 0)
+        {
+            return total;
+        }
+        if (errno != EINVAL && errno != ENOSYS)
+        {
+            return -1;
+        }
+    }
+
+    // last resort: copy through a userspace buffer
+    while ((n = read(in_fd, buf, sizeof(buf))) != 0)
+    {
+        if (copy_interrupted)
+        {
+            errno = EINTR;
+            return -1;
+        }
+        if (n == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        for (ssize_t done = 0; done < n;)
+        {
+            ssize_t w = write(out_fd, buf + done, n - done);
+            if (w == -1)
+            {
+                if (errno == EINTR && !copy_interrupted)
+                    continue;
+                return -1;
+            }
+            done += w;
+        }
+        total += n;
+    }
+    return total;
+}
+
+int util_cat(char **argv)
+{
+    int status = 0;
+    int i = 1;
+
+    // -u (unbuffered) is what we do anyway; anything else goes external
+    while (argv[i] != NULL && argv[i][0] == '-' && argv[i][1] != '\0')
+    {
+        if (strcmp(argv[i], "--") == 0)
+        {
+            i++;
+            break;
+        }
+        if (strcmp(argv[i], "-u") != 0)
+        {
+            return UTIL_EXTERNAL;
+        }
+        i++;
+    }
+
+    fflush(stdout);
+
+    // the shell's SIGINT handler lets reads restart; while cat runs,
+    // Ctrl-C interrupts the copy
+    struct sigaction sa = {0}, old_sa;
+    sa.sa_handler = copy_interrupt;
+    sigemptyset(&sa.sa_mask);
+    copy_interrupted = 0;
+    sigaction(SIGINT, &sa, &old_sa);
+
+    // no operands: copy standard input
+    if (argv[i] == NULL)
+    {
+        term_cooked();
+        if (util_copy_fd(STDIN_FILENO, STDOUT_FILENO) == -1 && !copy_interrupted)
+        {
+            perror("cat");
+            status = 1;
+        }
+    }
+
+    for (; argv[i] != NULL && !copy_interrupted; i++)
+    {
+        int fd = STDIN_FILENO;
+
+        if (strcmp(argv[i], "-") == 0)
+        {
+            term_cooked(); // standard input may be the terminal
+        }
+        else if ((fd = open(argv[i], O_RDONLY)) == -1)
+        {
+            fprintf(stderr, "cat: %s: %s\n", argv[i], strerror(errno));
+            status = 1;
+            continue;
+        }
+        if (util_copy_fd(fd, STDOUT_FILENO) == -1 && !copy_interrupted)
+        {
+            fprintf(stderr, "cat: %s: %s\n", argv[i], strerror(errno));
+            status = 1;
+        }
+        if (fd != STDIN_FILENO)
+        {
+            close(fd);
+        }
+    }
+
+    sigaction(SIGINT, &old_sa, NULL);
+    if (copy_interrupted)
+    {
+        copy_interrupted = 0;
+        interrupted = 1;
+        return 128 + SIGINT;
+    }
+    return status;
+}
+
+/*
+ * Copies the file src to dst. If dst is a directory the file is copied
+ * into it under its own name. Returns 0 on success and 1 on failure.
+ */
+static int cp_file(const char *src, const char *dst)
+{
+    char target[MAX_BUF_SIZE];
+    struct stat src_st, dst_st;
+    int in_fd, out_fd;
+    int status = 0;
+
+    if ((in_fd = open(src, O_RDONLY)) == -1 || fstat(in_fd, &src_st) == -1)
+    {
+        fprintf(stderr, "cp: %s: %s\n", src, strerror(errno));
+        if (in_fd != -1)
+            close(in_fd);
+        return 1;
+    }
+    if (S_ISDIR(src_st.st_mode))
+    {
+        fprintf(stderr, "cp: %s: is a directory (not copied)\n", src);
+        close(in_fd);
+        return 1;
+    }
+
+    // copying into a directory keeps the source file name
+    if (stat(dst, &dst_st) == 0 && S_ISDIR(dst_st.st_mode))
+    {
+        char *name = strdup(src);
+        snprintf(target, sizeof(target), "%s/%s", dst, basename(name));
+        free(name);
+        dst = target;
+    }
+
+    if (stat(dst, &dst_st) == 0 && dst_st.st_dev == src_st.st_dev && dst_st.st_ino == src_st.st_ino)
+    {
+        fprintf(stderr, "cp: %s and %s are the same file\n", src, dst);
+        close(in_fd);
+        return 1;
+    }
+
+    if ((out_fd = open(dst, O_WRONLY | O_CREAT | O_TRUNC, src_st.st_mode & 0777)) == -1)
+    {
+        fprintf(stderr, "cp: %s: %s\n", dst, strerror(errno));
+        close(in_fd);
+        return 1;
+    }
+
+    // share the extents outright on reflink capable filesystems
+    if (ioctl(out_fd, FICLONE, in_fd) == -1 && util_copy_fd(in_fd, out_fd) == -1)
+    {
+        fprintf(stderr, "cp: %s: %s\n", dst, strerror(errno));
+        status = 1;
+    }
+
+    close(in_fd);
+    if (close(out_fd) == -1)
+    {
+        fprintf(stderr, "cp: %s: %s\n", dst, strerror(errno));
+        status = 1;
+    }
+    return status;
+}
+
+int util_cp(char **argv)
+{
+    struct stat st;
+    int status = 0;
+    int first = 1;
+    int count = 0;
+
+    // -f is implied by opening with O_TRUNC; anything else goes external
+    while (argv[first] != NULL && argv[first][0] == '-' && argv[first][1] != '\0')
+    {
+        if (strcmp(argv[first], "--") == 0)
+        {
+            first++;
+            break;
+        }
+        if (strcmp(argv[first], "-f") != 0)
+        {
+            return UTIL_EXTERNAL;
+        }
+        first++;
+    }
+
+    while (argv[first + count] != NULL)
+    {
+        count++;
+    }
+    if (count < 2)
+    {
+        fprintf(stderr, "cp: missing file operand\n");
+        return 1;
+    }
+
+    const char *dst = argv[first + count - 1];
+    if (count > 2 && (stat(dst, &st) == -1 || !S_ISDIR(st.st_mode)))
+    {
+        fprintf(stderr, "cp: target %s is not a directory\n", dst);
+        return 1;
+    }
+
+    for (int i = first; i < first + count - 1; i++)
+    {
+        status |= cp_file(argv[i], dst);
+    }
+    return status;
+}
+
+/*
+ * Writes the backslash escape starting at *sp to stdout and advances *sp
+ * past it. Returns 1 if the escape was \c (stop all further output).
+ */
+static int put_escape(const char **sp)
+{
+    const char *s = *sp;
+    int ch;
+    int digits;
+
+    switch (*s)
+    {
+    case 'a': ch = '\a'; s++; break;
+    case 'b': ch = '\b'; s++; break;
+    case 'e': ch = 27; s++; break;
+    case 'f': ch = '\f'; s++; break;
+    case 'n': ch = '\n'; s++; break;
+    case 'r': ch = '\r'; s++; break;
+    case 't': ch = '\t'; s++; break;
+    case 'v': ch = '\v'; s++; break;
+    case '\\': ch = '\\'; s++; break;
+    case 'c':
+        *sp = s + 1;
+        return 1;
+    case '0':
+        // \0nnn octal, up to three digits after the 0
+        s++;
+        ch = 0;
+        for (digits = 0; digits < 3 && *s >= '0' && *s <= '7'; digits++)
+        {
+            ch = ch * 8 + (*s++ - '0');
+        }
+        break;
+    case '\0':
+        ch = '\\';
+        break;
+    default:
+        // unknown escape, keep the backslash
+        putchar('\\');
+        ch = *s++;
+        break;
+    }
+    putchar(ch);
+    *sp = s;
+    return 0;
+}
+
+/*
+ * Writes s to stdout interpreting backslash escapes.
+ * Returns 1 if output was stopped by \c.
+ */
+static int put_escaped(const char *s)
+{
+    while (*s != '\0')
+    {
+        if (*s == '\\')
+        {
+            s++;
+            if (put_escape(&s))
+            {
+                return 1;
+            }
+        }
+        else
+        {
+            putchar(*s++);
+        }
+    }
+    return 0;
+}
+
+int util_echo(char **argv)
+{
+    int newline = 1;
+    int escapes = 0;
+    int i = 1;
+
+    // leading option words made only of n, e and E
+    while (argv[i] != NULL && argv[i][0] == '-' && argv[i][1] != '\0' &&
+           strspn(argv[i] + 1, "neE") == strlen(argv[i] + 1))
+    {
+        for (char *opt = argv[i] + 1; *opt != '\0'; opt++)
+        {
+            if (*opt == 'n')
+                newline = 0;
+            else if (*opt == 'e')
+                escapes = 1;
+            else
+                escapes = 0;
+        }
+        i++;
+    }
+
+    for (; argv[i] != NULL; i++)
+    {
+        if (escapes)
+        {
+            if (put_escaped(argv[i]))
+            {
+                return 0;
+            }
+        }
+        else
+        {
+            fputs(argv[i], stdout);
+        }
+        if (argv[i + 1] != NULL)
+        {
+            putchar(' ');
+        }
+    }
+
+    if (newline)
+    {
+        putchar('\n');
+    }
+    return 0;
+}
+
+/*
+ * Converts a printf numeric argument. A leading quote yields the
+ * character code of the next character, as in POSIX printf.
+ */
+static int printf_number(const char *arg, long long *value)
+{
+    char *end;
+
+    if (arg[0] == '\'' || arg[0] == '"')
+    {
+        *value = (unsigned char)arg[1];
+        return 0;
+    }
+
+    errno = 0;
+    *value = strtoll(arg, &end, 0);
+    if (errno != 0 || end == arg || *end != '\0')
+    {
+        fprintf(stderr, "printf: %s: invalid number\n", arg);
+        return -1;
+    }
+    return 0;
+}
+
+int util_printf(char **argv)
+{
+    const char *format;
+    int arg = 2;
+    int status = 0;
+
+    if (argv[1] == NULL)
+    {
+        fprintf(stderr, "printf: usage: printf format [arguments]\n");
+        return 2;
+    }
+    format = argv[1];
+
+    // the format is reused as long as it consumes arguments
+    do
+    {
+        int first_arg = arg;
+        const char *f = format;
+
+        while (*f != '\0')
+        {
+            if (*f == '\\')
+            {
+                f++;
+                if (put_escape(&f))
+                {
+                    return status;
+                }
+                continue;
+            }
+            if (*f != '%')
+            {
+                putchar(*f++);
+                continue;
+            }
+            if (f[1] == '%')
+            {
+                putchar('%');
+                f += 2;
+                continue;
+            }
+
+            // copy the conversion specification (flags, width, precision)
+            char spec[32];
+            size_t len = 0;
+            spec[len++] = *f++;
+            while (*f != '\0' && strchr("-+ #0123456789.", *f) && len < sizeof(spec) - 4)
+            {
+                spec[len++] = *f++;
+            }
+            if (*f == '\0')
+            {
+                // a '%' ending the format is not a conversion
+                spec[len] = '\0';
+                fputs(spec, stdout);
+                break;
+            }
+
+            char conv = *f++;
+            const char *value = (argv[arg] != NULL) ? argv[arg++] : NULL;
+            long long number = 0;
+
+            switch (conv)
+            {
+            case 's':
+                spec[len++] = 's';
+                spec[len] = '\0';
+                printf(spec, value ? value : "");
+                break;
+            case 'b':
+                if (value && put_escaped(value))
+                {
+                    return status;
+                }
+                break;
+            case 'c':
+            {
+                // printed as a string, so a missing argument prints nothing
+                char c[2] = {value ? value[0] : '\0', '\0'};
+                spec[len++] = 's';
+                spec[len] = '\0';
+                printf(spec, c);
+                break;
+            }
+            case 'd':
+            case 'i':
+            case 'u':
+            case 'o':
+            case 'x':
+            case 'X':
+                if (value && printf_number(value, &number) < 0)
+                {
+                    status = 1;
+                }
+                spec[len++] = 'l';
+                spec[len++] = 'l';
+                spec[len++] = conv;
+                spec[len] = '\0';
+                printf(spec, number);
+                break;
+            default:
+                fprintf(stderr, "printf: %%%c: invalid conversion\n", conv);
+                return 1;
+            }
+        }
+
+        // stop if this pass consumed nothing
+        if (arg == first_arg)
+        {
+            break;
+        }
+    } while (argv[arg] != NULL);
+
+    return status;
+}
+
+/* State of the recursive descent evaluation of a test expression */
+struct test_state
+{
+    char **args;
+    int pos;
+    int count;
+    int error;
+};
+
+static int test_expr(struct test_state *ts);
+
+/* Returns 1 if op is a unary file or string operator. */
+static int test_is_unary(const char *op)
+{
+    return op[0] == '-' && op[1] != '\0' && op[2] == '\0' &&
+           strchr("bcdefghLnprsSwxz", op[1]) != NULL;
+}
+
+/* Returns 1 if op is a binary operator. */
+static int test_is_binary(const char *op)
+{
+    static const char *ops[] = {"=", "==", "!=", "<", ">", "-eq", "-ne", "-lt",
+                                "-le", "-gt", "-ge", "-nt", "-ot", "-ef"};
+
+    for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); i++)
+    {
+        if (strcmp(op, ops[i]) == 0)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int test_integer(struct test_state *ts, const char *s, long long *value)
+{
+    char *end;
+
+    errno = 0;
+    *value = strtoll(s, &end, 10);
+    while (isspace((unsigned char)*end))
+    {
+        end++;
+    }
+    if (errno != 0 || end == s || *end != '\0')
+    {
+        fprintf(stderr, "test: %s: integer expression expected\n", s);
+        ts->error = 1;
+        return -1;
+    }
+    return 0;
+}
+
+static int test_unary(const char *op, const char *arg)
+{
+    struct stat st;
+
+    switch (op[1])
+    {
+    case 'n':
+        return arg[0] != '\0';
+    case 'z':
+        return arg[0] == '\0';
+    case 'h':
+    case 'L':
+        return lstat(arg, &st) == 0 && S_ISLNK(st.st_mode);
+    case 'r':
+        return access(arg, R_OK) == 0;
+    case 'w':
+        return access(arg, W_OK) == 0;
+    case 'x':
+        return access(arg, X_OK) == 0;
+    }
+
+    if (stat(arg, &st) != 0)
+    {
+        return 0;
+    }
+
+    switch (op[1])
+    {
+    case 'b':
+        return S_ISBLK(st.st_mode);
+    case 'c':
+        return S_ISCHR(st.st_mode);
+    case 'd':
+        return S_ISDIR(st.st_mode);
+    case 'e':
+        return 1;
+    case 'f':
+        return S_ISREG(st.st_mode);
+    case 'g':
+        return (st.st_mode & S_ISGID) != 0;
+    case 'p':
+        return S_ISFIFO(st.st_mode);
+    case 's':
+        return st.st_size > 0;
+    case 'S':
+        return S_ISSOCK(st.st_mode);
+    }
+    return 0;
+}
+
+static int test_binary(struct test_state *ts, const char *lhs, const char *op, const char *rhs)
+{
+    long long a, b;
+    struct stat sa, sb;
+
+    if (strcmp(op, "=") == 0 || strcmp(op, "==") == 0)
+        return strcmp(lhs, rhs) == 0;
+    if (strcmp(op, "!=") == 0)
+        return strcmp(lhs, rhs) != 0;
+    if (strcmp(op, "<") == 0)
+        return strcmp(lhs, rhs) < 0;
+    if (strcmp(op, ">") == 0)
+        return strcmp(lhs, rhs) > 0;
+
+    if (strcmp(op, "-nt") == 0 || strcmp(op, "-ot") == 0 || strcmp(op, "-ef") == 0)
+    {
+        int have_a = stat(lhs, &sa) == 0;
+        int have_b = stat(rhs, &sb) == 0;
+
+        if (strcmp(op, "-ef") == 0)
+            return have_a && have_b && sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+        if (strcmp(op, "-nt") == 0)
+            return have_a && (!have_b || sa.st_mtime > sb.st_mtime);
+        return have_b && (!have_a || sa.st_mtime < sb.st_mtime);
+    }
+
+    if (test_integer(ts, lhs, &a) < 0 || test_integer(ts, rhs, &b) < 0)
+    {
+        return 0;
+    }
+    if (strcmp(op, "-eq") == 0)
+        return a == b;
+    if (strcmp(op, "-ne") == 0)
+        return a != b;
+    if (strcmp(op, "-lt") == 0)
+        return a < b;
+    if (strcmp(op, "-le") == 0)
+        return a <= b;
+    if (strcmp(op, "-gt") == 0)
+        return a > b;
+    return a >= b;
+}
+
+static int test_primary(struct test_state *ts)
+{
+    char **args = ts->args + ts->pos;
+    int left = ts->count - ts->pos;
+
+    if (left <= 0)
+    {
+        fprintf(stderr, "test: argument expected\n");
+        ts->error = 1;
+        return 0;
+    }
+
+    // binary operators take precedence so that [ "!" = "!" ] works
+    if (left >= 3 && test_is_binary(args[1]))
+    {
+        ts->pos += 3;
+        return test_binary(ts, args[0], args[1], args[2]);
+    }
+
+    if (strcmp(args[0], "!") == 0)
+    {
+        ts->pos++;
+        return !test_primary(ts);
+    }
+
+    if (strcmp(args[0], "(") == 0)
+    {
+        int value;
+
+        ts->pos++;
+        value = test_expr(ts);
+        if (ts->pos >= ts->count || strcmp(ts->args[ts->pos], ")") != 0)
+        {
+            fprintf(stderr, "test: ')' expected\n");
+            ts->error = 1;
+            return 0;
+        }
+        ts->pos++;
+        return value;
+    }
+
+    if (left >= 2 && test_is_unary(args[0]))
+    {
+        ts->pos += 2;
+        return test_unary(args[0], args[1]);
+    }
+
+    // a lone string is true if it is not empty
+    ts->pos++;
+    return args[0][0] != '\0';
+}
+
+static int test_and(struct test_state *ts)
+{
+    int value = test_primary(ts);
+
+    while (ts->pos < ts->count && strcmp(ts->args[ts->pos], "-a") == 0)
+    {
+        ts->pos++;
+        value = test_primary(ts) && value;
+    }
+    return value;
+}
+
+static int test_expr(struct test_state *ts)
+{
+    int value = test_and(ts);
+
+    while (ts->pos < ts->count && strcmp(ts->args[ts->pos], "-o") == 0)
+    {
+        ts->pos++;
+        value = test_and(ts) || value;
+    }
+    return value;
+}
+
+int util_test(char **argv)
+{
+    struct test_state ts = {0};
+    int value;
+
+    ts.args = argv + 1;
+    while (ts.args[ts.count] != NULL)
+    {
+        ts.count++;
+    }
+
+    // '[' requires a closing ']' which is not part of the expression
+    if (strcmp(argv[0], "[") == 0)
+    {
+        if (ts.count == 0 || strcmp(ts.args[ts.count - 1], "]") != 0)
+        {
+            fprintf(stderr, "[: missing ']'\n");
+            return 2;
+        }
+        ts.count--;
+    }
+
+    // no expression is false
+    if (ts.count == 0)
+    {
+        return 1;
+    }
+
+    value = test_expr(&ts);
+    if (!ts.error && ts.pos < ts.count)
+    {
+        fprintf(stderr, "test: %s: unexpected argument\n", ts.args[ts.pos]);
+        ts.error = 1;
+    }
+    if (ts.error)
+    {
+        return 2;
+    }
+    return value ? 0 : 1;
+}
+
+int util_true(char **argv)
+{
+    (void)argv;
+    return 0;
+}
+
+int util_false(char **argv)
+{
+    (void)argv;
+    return 1;
+}
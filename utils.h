@@ -0,0 +1,161 @@
+#ifndef UTILS_H
+#define UTILS_H
+
+/*
+ * Utils.h
+ * In-process implementations of frequently used utilities
+ * Authors : Aloysious Kok & Gerald
+ * Last Update : 18/10/26
+ */
+
+#include "shell.h"
+
+/* Signature shared by every in-process utility. The utility reads from
+ * STDIN_FILENO, writes to stdout and returns its exit status, or
+ * UTIL_EXTERNAL if it was given options it does not implement and the
+ * external program has to be run instead. */
+typedef int (*util_fn)(char **argv);
+
+#define UTIL_EXTERNAL -1
+
+/* Size of the buffer used when data has to be copied through userspace */
+#define COPY_BUF_SIZE (128 * 1024)
+
+/* util_fn util_lookup(const char *name)
+ *
+ * This function searches the table of in-process utilities for the
+ * given command name.
+ *
+ * Arguments :
+ *      name - the command name (argv[0]) to look up
+ *
+ * Returns :
+ *      the utility function if name is an in-process utility
+ *      NULL - name must be executed as an external program
+ */
+util_fn util_lookup(const char *name);
+
+/* int util_run_redirected(command *cmd, char **argv, util_fn fn)
+ *
+ * This function runs an in-process utility inside the shell process.
+ * The redirect_in and redirect_out fields of the command struct are
+ * honoured by temporarily pointing STDIN_FILENO and STDOUT_FILENO at
+ * the files; the original descriptors are restored before returning.
+ *
+ * Arguments :
+ *      cmd - the command struct holding the redirection information
+ *      argv - the argument vector (after wildcard expansion)
+ *      fn - the utility to run
+ *
+ * Returns :
+ *      the exit status of the utility
+ *      1 - a redirection file could not be opened
+ *      UTIL_EXTERNAL - the external program must be run instead
+ */
+int util_run_redirected(command *cmd, char **argv, util_fn fn);
+
+/* ssize_t util_copy_fd(int in_fd, int out_fd)
+ *
+ * This function copies everything from in_fd to out_fd starting at the
+ * current file offsets, keeping the data inside the kernel where it can.
+ * It uses copy_file_range() between regular files (which shares extents
+ * on reflink capable filesystems), splice() when either side is a pipe,
+ * sendfile() from a regular file to anything else, and finally a
+ * read()/write() loop.
+ *
+ * Arguments :
+ *      in_fd - the descriptor to read from
+ *      out_fd - the descriptor to write to
+ *
+ * Returns :
+ *      the number of bytes copied
+ *     -1 - a read or write error occurred (errno is set)
+ */
+ssize_t util_copy_fd(int in_fd, int out_fd);
+
+/* int util_echo(char **argv)
+ *
+ * Writes its arguments separated by spaces followed by a newline.
+ * Supports -n (no trailing newline), -e (interpret backslash escapes)
+ * and -E (do not interpret escapes).
+ *
+ * Returns :
+ *      0 - always
+ */
+int util_echo(char **argv);
+
+/* int util_printf(char **argv)
+ *
+ * Writes the arguments under control of the format string argv[1].
+ * Supports the %s %b %c %d %i %u %o %x %X %% conversions with flags,
+ * width and precision. The format is reused while arguments remain;
+ * a missing argument is taken as empty, so %c prints nothing for it. A
+ * '%' ending the format is printed as it is.
+ *
+ * Returns :
+ *      0 - successful
+ *      1 - a numeric argument could not be converted
+ */
+int util_printf(char **argv);
+
+/* int util_test(char **argv)
+ *
+ * Evaluates a conditional expression (test and [). Supports the string,
+ * integer and file operators of POSIX test, together with !, -a, -o and
+ * parentheses. When invoked as '[' the last argument must be ']'.
+ *
+ * Returns :
+ *      0 - the expression is true
+ *      1 - the expression is false
+ *      2 - syntax error in the expression
+ */
+int util_test(char **argv);
+
+/* int util_cat(char **argv)
+ *
+ * Concatenates the named files (or standard input, also named by '-')
+ * to standard output using util_copy_fd(). Only the -u option is
+ * accepted; any other option runs the external cat. Ctrl-C stops the
+ * copy, as it would the external cat, though the shell ignores SIGINT.
+ *
+ * Returns :
+ *      0 - successful
+ *      1 - one or more files could not be copied
+ *      128 + SIGINT - interrupted
+ *      UTIL_EXTERNAL - unsupported option given
+ */
+int util_cat(char **argv);
+
+/* int util_cp(char **argv)
+ *
+ * Copies a file to a file, or files into a directory. The destination
+ * is first cloned with the FICLONE ioctl, falling back to
+ * util_copy_fd(). Only the -f option is accepted; any other option
+ * (such as -r) runs the external cp.
+ *
+ * Returns :
+ *      0 - successful
+ *      1 - one or more files could not be copied
+ *      UTIL_EXTERNAL - unsupported option given
+ */
+int util_cp(char **argv);
+
+/* int util_true(char **argv)
+ *
+ * Does nothing, successfully. Also used for ':'.
+ *
+ * Returns :
+ *      0 - always
+ */
+int util_true(char **argv);
+
+/* int util_false(char **argv)
+ *
+ * Does nothing, unsuccessfully.
+ *
+ * Returns :
+ *      1 - always
+ */
+int util_false(char **argv);
+
+#endif
@@ -0,0 +1,1116 @@
+/*
+ * Vars.c
+ * Shell variables kept in an open-addressing hash table, the exported
+ * environment materialised as a cached envp array, and parameter
+ * expansion of command words
+ * Authors : Aloysious Kok & Gerald
+ * Last Update : 18/10/26
+ */
+
+#include <ctype.h>
+#include "vars.h"
+#include "script.h"
+#include "jobs.h"
+#include "common.h"
+
+/* A slot of the variable table. name is NULL for a free slot and
+ * TOMBSTONE for a slot whose variable was unset. */
+typedef struct Var_struct
+{
+    char *name;
+    char *value;
+    unsigned int hash;
+    int exported;
+} var;
+
+static char tombstone_marker;
+#define TOMBSTONE (&tombstone_marker)
+
+static var *table = NULL;
+static size_t table_size = 0;
+static size_t table_live = 0; // slots holding a variable
+static size_t table_used = 0; // slots holding a variable or a tombstone
+
+// envp is rebuilt when env_generation moves past envp_generation
+static unsigned long env_generation = 1;
+static unsigned long envp_generation = 0;
+static char **envp_cache = NULL;
+static int envp_count = 0;
+
+static char **positional = NULL;
+static pid_t shell_pid;
+
+// names of the shell options, in the order of enum shell_opt
+static const char *option_names[OPT_COUNT] = {"autopin", "autonuma", "zygote", "audit", "bigpipe", "pipemeter", "multios", "autopar"};
+static int options[OPT_COUNT];
+
+// pipe ends of process substitutions not yet handed to a command
+static int *subst_fds = NULL;
+static int n_subst_fds = 0;
+static int subst_fds_size = 0;
+
+/* A field being built by the expansion code */
+typedef struct Fieldbuf_struct
+{
+    char *buf;
+    size_t len;
+    size_t size;
+    int quoted; // the field exists even if empty ("" or '')
+} fieldbuf;
+
+static int expand_into(const char *word, strlist *fields, int flags, fieldbuf *fb);
+
+static unsigned int var_hash(const char *name)
+{
+    return hash32(name, strlen(name));
+}
+
+/*
+ * Finds the slot of a variable. If it is not present and insert is set,
+ * returns the slot where it should be inserted (reusing a tombstone).
+ */
+static var *var_find(const char *name, unsigned int hash, int insert)
+{
+    size_t mask = table_size - 1;
+    var *reuse = NULL;
+
+    for (size_t i = hash & mask;; i = (i + 1) & mask)
+    {
+        var *slot = &table[i];
+
+        if (slot->name == NULL)
+        {
+            if (!insert)
+                return NULL;
+            return reuse ? reuse : slot;
+        }
+        if (slot->name == TOMBSTONE)
+        {
+            if (reuse == NULL)
+                reuse = slot;
+        }
+        else if (slot->hash == hash && strcmp(slot->name, name) == 0)
+        {
+            return slot;
+        }
+    }
+}
+
+/* Rehashes into a table of new_size slots, dropping the tombstones */
+static void var_resize(size_t new_size)
+{
+    var *old = table;
+    size_t old_size = table_size;
+
+    table = calloc(new_size, sizeof(var));
+    if (table == NULL)
+    {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    table_size = new_size;
+    table_used = table_live;
+
+    for (size_t i = 0; i < old_size; i++)
+    {
+        if (old[i].name != NULL && old[i].name != TOMBSTONE)
+        {
+            *var_find(old[i].name, old[i].hash, 1) = old[i];
+        }
+    }
+    free(old);
+}
+
+void vars_init(char **envp)
+{
+    shell_pid = getpid();
+    var_resize(VARS_INITIAL_SIZE);
+
+    for (int i = 0; envp != NULL && envp[i] != NULL; i++)
+    {
+        char *eq = strchr(envp[i], '=');
+        if (eq == NULL)
+            continue;
+
+        char *name = strndup(envp[i], eq - envp[i]);
+        var_set(name, eq + 1, VAR_EXPORT);
+        free(name);
+    }
+}
+
+static int valid_name(const char *name)
+{
+    if (!isalpha((unsigned char)*name) && *name != '_')
+        return 0;
+    while (*++name != '\0')
+    {
+        if (!isalnum((unsigned char)*name) && *name != '_')
+            return 0;
+    }
+    return 1;
+}
+
+const char *var_get(const char *name)
+{
+    static char buf[32];
+    var *slot;
+
+    // special parameters
+    if (name[0] != '\0' && name[1] == '\0')
+    {
+        int count = 0;
+
+        switch (name[0])
+        {
+        case '?':
+            snprintf(buf, sizeof(buf), "%d", last_status);
+            return buf;
+        case '$':
+            snprintf(buf, sizeof(buf), "%d", (int)shell_pid);
+            return buf;
+        case '!':
+            if (last_bg_pid == 0)
+                return NULL;
+            snprintf(buf, sizeof(buf), "%d", (int)last_bg_pid);
+            return buf;
+        case '#':
+            while (positional != NULL && positional[count] != NULL)
+                count++;
+            snprintf(buf, sizeof(buf), "%d", count);
+            return buf;
+        case '0':
+            return "shell";
+        }
+        if (isdigit((unsigned char)name[0]))
+        {
+            for (int i = 0; positional != NULL && positional[i] != NULL; i++)
+            {
+                if (i == name[0] - '1')
+                    return positional[i];
+            }
+            return NULL;
+        }
+    }
+
+    slot = var_find(name, var_hash(name), 0);
+    return slot ? slot->value : NULL;
+}
+
+int var_set(const char *name, const char *value, int export_flag)
+{
+    unsigned int hash = var_hash(name);
+    var *slot;
+
+    if (!valid_name(name))
+    {
+        return -1;
+    }
+
+    // keep the load factor under 3/4, counting tombstones
+    if ((table_used + 1) * 4 > table_size * 3)
+    {
+        var_resize(table_live * 2 >= table_size / 2 ? table_size * 2 : table_size);
+    }
+
+    slot = var_find(name, hash, 1);
+    if (slot->name == NULL || slot->name == TOMBSTONE)
+    {
+        if (slot->name == NULL)
+            table_used++;
+        table_live++;
+        slot->name = strdup(name);
+        slot->value = strdup(value ? value : "");
+        slot->hash = hash;
+        slot->exported = (export_flag == VAR_EXPORT);
+        if (slot->exported)
+            env_generation++;
+        return 0;
+    }
+
+    if (value != NULL && strcmp(slot->value, value) != 0)
+    {
+        free(slot->value);
+        slot->value = strdup(value);
+        if (slot->exported)
+            env_generation++;
+    }
+    if (export_flag != VAR_KEEP && export_flag != slot->exported)
+    {
+        slot->exported = export_flag;
+        env_generation++;
+    }
+    return 0;
+}
+
+int var_unset(const char *name)
+{
+    var *slot = var_find(name, var_hash(name), 0);
+
+    if (slot == NULL)
+    {
+        return -1;
+    }
+    if (slot->exported)
+    {
+        env_generation++;
+    }
+    free(slot->name);
+    free(slot->value);
+    slot->name = TOMBSTONE;
+    slot->value = NULL;
+    table_live--;
+    return 0;
+}
+
+char **vars_envp()
+{
+    int n = 0;
+
+    if (envp_generation == env_generation)
+    {
+        return envp_cache;
+    }
+
+    for (int i = 0; i < envp_count; i++)
+    {
+        free(envp_cache[i]);
+    }
+    free(envp_cache);
+
+    envp_cache = malloc((table_live + 1) * sizeof(char *));
+    for (size_t i = 0; i < table_size; i++)
+    {
+        var *slot = &table[i];
+        if (slot->name == NULL || slot->name == TOMBSTONE || !slot->exported)
+            continue;
+
+        envp_cache[n] = malloc(strlen(slot->name) + strlen(slot->value) + 2);
+        sprintf(envp_cache[n], "%s=%s", slot->name, slot->value);
+        n++;
+    }
+    envp_cache[n] = NULL;
+    envp_count = n;
+    envp_generation = env_generation;
+    return envp_cache;
+}
+
+char **vars_set_positional(char **params)
+{
+    char **old = positional;
+    positional = params;
+    return old;
+}
+
+int var_is_assignment(const char *word)
+{
+    const char *eq = strchr(word, '=');
+
+    if (eq == NULL || eq == word)
+        return 0;
+    for (const char *p = word; p < eq; p++)
+    {
+        if (!isalnum((unsigned char)*p) && *p != '_')
+            return 0;
+    }
+    return !isdigit((unsigned char)*word);
+}
+
+void strlist_add(strlist *list, char *item)
+{
+    if (list->count + 2 > list->size)
+    {
+        list->size = list->size ? list->size * 2 : 8;
+        list->items = realloc(list->items, list->size * sizeof(char *));
+    }
+    list->items[list->count++] = item;
+    list->items[list->count] = NULL;
+}
+
+void strlist_free(strlist *list)
+{
+    for (int i = 0; i < list->count; i++)
+    {
+        free(list->items[i]);
+    }
+    free(list->items);
+    list->items = NULL;
+    list->count = list->size = 0;
+}
+
+static void fb_putn(fieldbuf *fb, const char *s, size_t n)
+{
+    if (fb->len + n + 1 > fb->size)
+    {
+        while (fb->len + n + 1 > fb->size)
+            fb->size = fb->size ? fb->size * 2 : 64;
+        fb->buf = realloc(fb->buf, fb->size);
+    }
+    memcpy(fb->buf + fb->len, s, n);
+    fb->len += n;
+    fb->buf[fb->len] = '\0';
+}
+
+static void fb_putc(fieldbuf *fb, char ch)
+{
+    fb_putn(fb, &ch, 1);
+}
+
+/* Ends the current field, if there is one, and adds it to the list */
+static void fb_end_field(fieldbuf *fb, strlist *fields)
+{
+    if (fb->len > 0 || fb->quoted)
+    {
+        strlist_add(fields, strndup(fb->buf ? fb->buf : "", fb->len));
+    }
+    fb->len = 0;
+    fb->quoted = 0;
+}
+
+/*
+ * Appends the value of an expansion. Unquoted values are split into
+ * fields at blanks when fields are being collected.
+ */
+static void fb_put_value(fieldbuf *fb, const char *value, int quoted, strlist *fields)
+{
+    if (quoted || fields == NULL)
+    {
+        fb_putn(fb, value, strlen(value));
+        return;
+    }
+
+    while (*value != '\0')
+    {
+        size_t run = strcspn(value, " \t\n");
+        fb_putn(fb, value, run);
+        value += run;
+        if (*value != '\0')
+        {
+            fb_end_field(fb, fields);
+            value += strspn(value, " \t\n");
+        }
+    }
+}
+
+/*
+ * Runs src in a child shell whose standard output is a pipe and collects
+ * everything it writes into a growing buffer. The trailing newlines are
+ * removed. Returns the buffer (its allocated size in *size), or NULL if
+ * the child could not be started.
+ */
+static char *capture_output(const char *src, size_t *len, size_t *size)
+{
+    int fds[2];
+    int status;
+    pid_t pid;
+    sigset_t block, old_mask;
+    size_t used = 0;
+    ssize_t n;
+    char *buf;
+
+    if (pipe2(fds, O_CLOEXEC) == -1)
+    {
+        perror("pipe");
+        return NULL;
+    }
+    // fewer, larger reads for big outputs; ignored if not permitted
+    fcntl(fds[0], F_SETPIPE_SZ, CAPTURE_PIPE_SIZE);
+
+    // the child's status is collected here, not by claim_zombies()
+    sigemptyset(&block);
+    sigaddset(&block, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &block, &old_mask);
+
+    fflush(stdout);
+    pid = fork();
+    if (pid == 0)
+    {
+        // reaping messages must not end up in the captured output
+        signal(SIGCHLD, SIG_DFL);
+        sigprocmask(SIG_SETMASK, &old_mask, NULL);
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        exit(script_run_text(src));
+    }
+    close(fds[1]);
+    if (pid < 0)
+    {
+        perror("fork");
+        close(fds[0]);
+        sigprocmask(SIG_SETMASK, &old_mask, NULL);
+        return NULL;
+    }
+
+    *size = CAPTURE_BUF_SIZE;
+    buf = malloc(*size);
+    while ((n = read(fds[0], buf + used, *size - used - 1)) != 0)
+    {
+        if (n == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("read");
+            break;
+        }
+        used += n;
+        if (used + 1 == *size)
+        {
+            *size *= 2;
+            buf = realloc(buf, *size);
+        }
+    }
+    close(fds[0]);
+
+    if (waitpid(pid, &status, 0) == pid)
+    {
+        last_status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    }
+    sigprocmask(SIG_SETMASK, &old_mask, NULL);
+
+    while (used > 0 && buf[used - 1] == '\n')
+    {
+        used--;
+    }
+    buf[used] = '\0';
+    *len = used;
+    return buf;
+}
+
+/*
+ * Substitutes the output of src. When nothing precedes it in the field
+ * and it is not split, the capture buffer itself becomes the field.
+ */
+static int substitute(const char *src, int quoted, strlist *fields, fieldbuf *fb)
+{
+    size_t len, size;
+    char *out = capture_output(src, &len, &size);
+
+    if (out == NULL)
+    {
+        return -1;
+    }
+    if (fb->len == 0 && (quoted || fields == NULL))
+    {
+        free(fb->buf);
+        fb->buf = out;
+        fb->len = len;
+        fb->size = size;
+        fb->quoted |= quoted;
+        return 0;
+    }
+    fb_put_value(fb, out, quoted, fields);
+    free(out);
+    return 0;
+}
+
+/*
+ * Starts src for the process substitution <(src) or >(src) and puts the
+ * /dev/fd path of the shell's end of the pipe into fb. The fd is kept
+ * open (and inheritable) until the command that uses it has finished;
+ * the substituted process runs alongside it and is reaped through the
+ * child table.
+ */
+static int process_substitute(const char *src, char dir, fieldbuf *fb)
+{
+    int fds[2];
+    char path[32];
+    pid_t pid;
+
+    if (pipe(fds) == -1)
+    {
+        perror("pipe");
+        return -1;
+    }
+
+    fflush(stdout);
+    pid = fork();
+    if (pid == 0)
+    {
+        // the pipes of other substitutions on the line are not ours
+        for (int i = 0; i < n_subst_fds; i++)
+            close(subst_fds[i]);
+        dup2(dir == '<' ? fds[1] : fds[0], dir == '<' ? STDOUT_FILENO : STDIN_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        exit(script_run_text(src));
+    }
+    if (pid < 0)
+    {
+        perror("fork");
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+
+    // <(...) is read by the command, >(...) is written by it
+    int keep = (dir == '<') ? fds[0] : fds[1];
+    close(dir == '<' ? fds[1] : fds[0]);
+    last_bg_pid = pid;
+    jobs_track(pid, 0);
+
+    if (n_subst_fds == subst_fds_size)
+    {
+        subst_fds_size = subst_fds_size ? subst_fds_size * 2 : 4;
+        subst_fds = realloc(subst_fds, subst_fds_size * sizeof(int));
+    }
+    subst_fds[n_subst_fds++] = keep;
+
+    snprintf(path, sizeof(path), "/dev/fd/%d", keep);
+    fb_putn(fb, path, strlen(path));
+    return 0;
+}
+
+/*
+ * Expands ${...}. p points just after the '{'. Returns a pointer after
+ * the closing '}' or NULL on a bad substitution.
+ */
+static const char *expand_braces(const char *p, int quoted, strlist *fields, fieldbuf *fb)
+{
+    const char *start = p;
+    const char *end;
+    int depth = 1;
+    int length_of = 0;
+
+    // find the matching brace
+    for (end = p; *end != '\0'; end++)
+    {
+        if (*end == '{')
+            depth++;
+        else if (*end == '}' && --depth == 0)
+            break;
+    }
+    if (*end != '}')
+    {
+        fprintf(stderr, "bad substitution: missing '}'\n");
+        return NULL;
+    }
+
+    if (*p == '#' && p + 1 < end)
+    {
+        length_of = 1;
+        p++;
+        start = p;
+    }
+
+    // the parameter name
+    if (isalpha((unsigned char)*p) || *p == '_')
+    {
+        while (isalnum((unsigned char)*p) || *p == '_')
+            p++;
+    }
+    else if (p < end)
+    {
+        p++;
+    }
+
+    char *name = strndup(start, p - start);
+    const char *value = var_get(name);
+    char *alloc = NULL;
+
+    if (length_of)
+    {
+        if (p != end)
+        {
+            fprintf(stderr, "bad substitution: ${#%s\n", name);
+            free(name);
+            return NULL;
+        }
+        static char buf[32];
+        snprintf(buf, sizeof(buf), "%zu", value ? strlen(value) : (size_t)0);
+        value = buf;
+    }
+    else if (p < end)
+    {
+        // ${name-word} ${name:-word} and friends
+        int colon = (*p == ':');
+        char op = p[colon];
+        int is_set = value != NULL && (!colon || value[0] != '\0');
+
+        if (strchr("-=+?", op) == NULL || op == '\0')
+        {
+            fprintf(stderr, "bad substitution: ${%.*s}\n", (int)(end - start), start);
+            free(name);
+            return NULL;
+        }
+
+        char *word_src = strndup(p + colon + 1, end - (p + colon + 1));
+        if ((op == '+' && is_set) || (op != '+' && !is_set))
+        {
+            alloc = expand_string(word_src, 0);
+            if (alloc == NULL)
+            {
+                free(word_src);
+                free(name);
+                return NULL;
+            }
+            value = alloc;
+            if (op == '=')
+            {
+                var_set(name, value, VAR_KEEP);
+            }
+            else if (op == '?')
+            {
+                fprintf(stderr, "%s: %s\n", name, value[0] ? value : "parameter not set");
+                free(alloc);
+                free(word_src);
+                free(name);
+                return NULL;
+            }
+        }
+        else if (op == '+')
+        {
+            value = "";
+        }
+        free(word_src);
+    }
+
+    if (value != NULL)
+    {
+        fb_put_value(fb, value, quoted, fields);
+    }
+    free(alloc);
+    free(name);
+    return end + 1;
+}
+
+/*
+ * Expands the parameter starting at the '$' at p. Returns a pointer to
+ * the first character after it, or NULL on a bad substitution.
+ */
+static const char *expand_dollar(const char *p, int quoted, strlist *fields, fieldbuf *fb)
+{
+    p++;
+
+    if (*p == '{')
+    {
+        return expand_braces(p + 1, quoted, fields, fb);
+    }
+
+    if (*p == '(')
+    {
+        const char *end = skip_substitution(p - 1);
+        if (end[-1] != ')' || end - p < 2)
+        {
+            fprintf(stderr, "bad substitution: missing ')'\n");
+            return NULL;
+        }
+
+        char *src = strndup(p + 1, end - p - 2);
+        int status = substitute(src, quoted, fields, fb);
+        free(src);
+        return (status == 0) ? end : NULL;
+    }
+
+    if (*p == '@' || *p == '*')
+    {
+        // "$@" keeps every parameter as its own field
+        for (int i = 0; positional != NULL && positional[i] != NULL; i++)
+        {
+            if (i > 0)
+            {
+                if (quoted && *p == '@' && fields != NULL)
+                    fb_end_field(fb, fields);
+                else
+                    fb_put_value(fb, " ", quoted, fields);
+            }
+            fb_put_value(fb, positional[i], quoted, fields);
+        }
+        return p + 1;
+    }
+
+    if (strchr("?$!#", *p) != NULL || isdigit((unsigned char)*p))
+    {
+        char name[2] = {*p, '\0'};
+        const char *value = var_get(name);
+        if (value != NULL)
+            fb_put_value(fb, value, quoted, fields);
+        return p + 1;
+    }
+
+    if (isalpha((unsigned char)*p) || *p == '_')
+    {
+        const char *start = p;
+        while (isalnum((unsigned char)*p) || *p == '_')
+            p++;
+
+        char *name = strndup(start, p - start);
+        const char *value = var_get(name);
+        if (value != NULL)
+            fb_put_value(fb, value, quoted, fields);
+        free(name);
+        return p;
+    }
+
+    // a lone '$' is literal
+    fb_putc(fb, '$');
+    return p;
+}
+
+/*
+ * Expands a word into fb. Completed fields go to fields; if fields is
+ * NULL the whole word is collected without splitting.
+ */
+static int expand_into(const char *word, strlist *fields, int flags, fieldbuf *fb)
+{
+    const char *p = word;
+    char quote = 0;
+
+    while (*p != '\0')
+    {
+        if (quote != '"' && *p == '\'')
+        {
+            quote = quote ? 0 : '\'';
+            fb->quoted = 1;
+            p++;
+        }
+        else if (quote == '\'')
+        {
+            if ((flags & EXP_PATTERN) && strchr("*?[]\\", *p))
+                fb_putc(fb, '\\');
+            fb_putc(fb, *p++);
+        }
+        else if (*p == '"')
+        {
+            quote = quote ? 0 : '"';
+            fb->quoted = 1;
+            p++;
+        }
+        else if (*p == '\\' && p[1] != '\0')
+        {
+            // inside double quotes only a few characters can be escaped
+            if (quote == '"' && strchr("$`\"\\\n", p[1]) == NULL)
+            {
+                fb_putc(fb, *p++);
+                continue;
+            }
+            p++;
+            if ((flags & EXP_PATTERN) && strchr("*?[]\\", *p))
+                fb_putc(fb, '\\');
+            fb_putc(fb, *p++);
+        }
+        else if (quote == 0 && IS_PROC_SUBST(p))
+        {
+            const char *end = skip_substitution(p);
+            if (end[-1] != ')' || end - p < 3)
+            {
+                fprintf(stderr, "bad substitution: missing ')'\n");
+                return -1;
+            }
+
+            char *src = strndup(p + 2, end - p - 3);
+            int status = process_substitute(src, *p, fb);
+            free(src);
+            if (status < 0)
+                return -1;
+            p = end;
+        }
+        else if (*p == '$')
+        {
+            p = expand_dollar(p, quote != 0, fields, fb);
+            if (p == NULL)
+                return -1;
+        }
+        else if (*p == '`')
+        {
+            const char *end = skip_substitution(p);
+            if (end - p < 2 || end[-1] != '`')
+            {
+                fprintf(stderr, "bad substitution: missing '`'\n");
+                return -1;
+            }
+
+            // inside backquotes \`, \\ and \$ stand for the character
+            char *src = malloc(end - p);
+            char *out = src;
+            for (const char *q = p + 1; q < end - 1; q++)
+            {
+                if (*q == '\\' && strchr("`\\$", q[1]) != NULL)
+                    q++;
+                *out++ = *q;
+            }
+            *out = '\0';
+
+            int status = substitute(src, quote != 0, fields, fb);
+            free(src);
+            if (status < 0)
+                return -1;
+            p = end;
+        }
+        else
+        {
+            if (quote && (flags & EXP_PATTERN) && strchr("*?[]\\", *p))
+                fb_putc(fb, '\\');
+            fb_putc(fb, *p++);
+        }
+    }
+    return 0;
+}
+
+int expand_word(const char *word, strlist *fields)
+{
+    fieldbuf fb = {0};
+    int status = expand_into(word, fields, 0, &fb);
+
+    if (status == 0)
+    {
+        fb_end_field(&fb, fields);
+    }
+    free(fb.buf);
+    return status;
+}
+
+char *expand_string(const char *word, int flags)
+{
+    fieldbuf fb = {0};
+
+    if (expand_into(word, NULL, flags, &fb) < 0)
+    {
+        free(fb.buf);
+        return NULL;
+    }
+    return fb.buf ? fb.buf : strdup("");
+}
+
+/* Hands the pending process substitution fds over as a -1 terminated array */
+static int *take_subst_fds()
+{
+    if (n_subst_fds == 0)
+    {
+        return NULL;
+    }
+
+    int *fds = malloc((n_subst_fds + 1) * sizeof(int));
+    memcpy(fds, subst_fds, n_subst_fds * sizeof(int));
+    fds[n_subst_fds] = -1;
+    n_subst_fds = 0;
+    return fds;
+}
+
+/* Closes and frees an array returned by take_subst_fds() */
+static void close_subst_fds(int *fds)
+{
+    for (int i = 0; fds != NULL && fds[i] != -1; i++)
+    {
+        close(fds[i]);
+    }
+    free(fds);
+}
+
+int expand_command(command *cmd)
+{
+    strlist args = {0};
+    strlist assigns = {0};
+    char *redirect_in = NULL;
+    char *redirect_out = NULL;
+    strlist redirect_tee = {0};
+    int i = 0;
+
+    if (cmd->expanded || cmd->argv == NULL)
+    {
+        return 0;
+    }
+
+    // leading name=value words are assignments, not arguments
+    for (; cmd->argv[i] != NULL && var_is_assignment(cmd->argv[i]); i++)
+    {
+        char *eq = strchr(cmd->argv[i], '=');
+        char *value = expand_string(eq + 1, 0);
+        if (value == NULL)
+            goto fail;
+
+        char *assign = malloc((eq - cmd->argv[i]) + strlen(value) + 2);
+        sprintf(assign, "%.*s=%s", (int)(eq - cmd->argv[i]), cmd->argv[i], value);
+        free(value);
+        strlist_add(&assigns, assign);
+    }
+
+    for (; cmd->argv[i] != NULL; i++)
+    {
+        if (expand_word(cmd->argv[i], &args) < 0)
+            goto fail;
+    }
+    if (args.items == NULL)
+    {
+        args.items = calloc(1, sizeof(char *));
+    }
+
+    if (cmd->redirect_in != NULL && (redirect_in = expand_string(cmd->redirect_in, 0)) == NULL)
+        goto fail;
+    if (cmd->redirect_out != NULL && (redirect_out = expand_string(cmd->redirect_out, 0)) == NULL)
+        goto fail;
+    for (int j = 0; cmd->redirect_tee != NULL && cmd->redirect_tee[j] != NULL; j++)
+    {
+        char *target = expand_string(cmd->redirect_tee[j], 0);
+        if (target == NULL)
+            goto fail;
+        strlist_add(&redirect_tee, target);
+    }
+
+    cmd->raw_argv = cmd->argv;
+    cmd->raw_redirect_in = cmd->redirect_in;
+    cmd->raw_redirect_out = cmd->redirect_out;
+    cmd->raw_redirect_tee = cmd->redirect_tee;
+    cmd->argv = args.items;
+    cmd->com_name = cmd->argv[0];
+    cmd->redirect_in = redirect_in;
+    cmd->redirect_out = redirect_out;
+    cmd->redirect_tee = redirect_tee.items;
+    cmd->assigns = assigns.items;
+    cmd->subst_fds = take_subst_fds();
+    cmd->expanded = 1;
+    return 0;
+
+fail:
+    strlist_free(&args);
+    strlist_free(&assigns);
+    free(redirect_in);
+    free(redirect_out);
+    strlist_free(&redirect_tee);
+    close_subst_fds(take_subst_fds());
+    return -1;
+}
+
+void unexpand_command(command *cmd)
+{
+    if (!cmd->expanded)
+    {
+        return;
+    }
+
+    for (int i = 0; cmd->argv[i] != NULL; i++)
+    {
+        free(cmd->argv[i]);
+    }
+    free(cmd->argv);
+    for (int i = 0; cmd->assigns != NULL && cmd->assigns[i] != NULL; i++)
+    {
+        free(cmd->assigns[i]);
+    }
+    free(cmd->assigns);
+    free(cmd->redirect_in);
+    free(cmd->redirect_out);
+    for (int i = 0; cmd->redirect_tee != NULL && cmd->redirect_tee[i] != NULL; i++)
+    {
+        free(cmd->redirect_tee[i]);
+    }
+    free(cmd->redirect_tee);
+    // the command is done with its process substitutions
+    close_subst_fds(cmd->subst_fds);
+
+    cmd->argv = cmd->raw_argv;
+    cmd->com_name = cmd->argv[0];
+    cmd->redirect_in = cmd->raw_redirect_in;
+    cmd->redirect_out = cmd->raw_redirect_out;
+    cmd->redirect_tee = cmd->raw_redirect_tee;
+    cmd->raw_argv = NULL;
+    cmd->raw_redirect_in = NULL;
+    cmd->raw_redirect_out = NULL;
+    cmd->raw_redirect_tee = NULL;
+    cmd->assigns = NULL;
+    cmd->subst_fds = NULL;
+    cmd->expanded = 0;
+}
+
+/* Orders table slots by name for listing */
+static int compare_names(const void *a, const void *b)
+{
+    return strcmp((*(var *const *)a)->name, (*(var *const *)b)->name);
+}
+
+/* Prints the variables (only the exported ones if exported_only is set) */
+static void list_vars(int exported_only)
+{
+    var **sorted = malloc((table_live + 1) * sizeof(var *));
+    size_t n = 0;
+
+    for (size_t i = 0; i < table_size; i++)
+    {
+        var *slot = &table[i];
+        if (slot->name != NULL && slot->name != TOMBSTONE && (!exported_only || slot->exported))
+            sorted[n++] = slot;
+    }
+    qsort(sorted, n, sizeof(var *), compare_names);
+
+    for (size_t i = 0; i < n; i++)
+    {
+        printf("%s%s='%s'\n", exported_only ? "export " : "", sorted[i]->name, sorted[i]->value);
+    }
+    free(sorted);
+}
+
+int builtin_export(command *cmd)
+{
+    int status = 0;
+
+    if (cmd->argv[1] == NULL)
+    {
+        list_vars(1);
+        return 0;
+    }
+
+    for (int i = 1; cmd->argv[i] != NULL; i++)
+    {
+        char *eq = strchr(cmd->argv[i], '=');
+        char *name = eq ? strndup(cmd->argv[i], eq - cmd->argv[i]) : strdup(cmd->argv[i]);
+
+        if (var_set(name, eq ? eq + 1 : NULL, VAR_EXPORT) < 0)
+        {
+            fprintf(stderr, "export: %s: not a valid identifier\n", name);
+            status = -1;
+        }
+        free(name);
+    }
+    return status;
+}
+
+int builtin_unset(command *cmd)
+{
+    for (int i = 1; cmd->argv[i] != NULL; i++)
+    {
+        var_unset(cmd->argv[i]);
+    }
+    return 0;
+}
+
+int builtin_set(command *cmd)
+{
+    int on;
+
+    if (cmd->argv[1] == NULL)
+    {
+        list_vars(0);
+        return 0;
+    }
+    if (strcmp(cmd->argv[1], "-o") != 0 && strcmp(cmd->argv[1], "+o") != 0)
+    {
+        fprintf(stderr, "set: usage: set [-o|+o [option]...]\n");
+        return -1;
+    }
+
+    on = (cmd->argv[1][0] == '-');
+    if (cmd->argv[2] == NULL)
+    {
+        for (int i = 0; i < OPT_COUNT; i++)
+            printf("%-12s%s\n", option_names[i], options[i] ? "on" : "off");
+        return 0;
+    }
+
+    for (int i = 2; cmd->argv[i] != NULL; i++)
+    {
+        int opt = 0;
+        while (opt < OPT_COUNT && strcmp(cmd->argv[i], option_names[opt]) != 0)
+            opt++;
+        if (opt == OPT_COUNT)
+        {
+            fprintf(stderr, "set: %s: invalid option name\n", cmd->argv[i]);
+            return -1;
+        }
+        options[opt] = on;
+    }
+    return 0;
+}
+
+int shell_option(int opt)
+{
+    return options[opt];
+}
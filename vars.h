@@ -0,0 +1,258 @@
+#ifndef VARS_H
+#define VARS_H
+
+/*
+ * Vars.h
+ * Shell variables, the exported environment and parameter expansion
+ * Authors : Aloysious Kok & Gerald
+ * Last Update : 18/10/26
+ */
+
+#include "shell.h"
+
+/* Initial number of slots in the variable table (a power of two) */
+#define VARS_INITIAL_SIZE 64
+
+/* Flags for var_set() */
+#define VAR_KEEP -1    // keep the current export flag
+#define VAR_LOCAL 0    // shell variable only
+#define VAR_EXPORT 1   // passed to the environment of commands
+
+/* Command substitution: the pipe is enlarged with F_SETPIPE_SZ to
+ * CAPTURE_PIPE_SIZE and read into a buffer starting at CAPTURE_BUF_SIZE */
+#define CAPTURE_PIPE_SIZE (1024 * 1024)
+#define CAPTURE_BUF_SIZE (64 * 1024)
+
+/* Flags for expand_string() */
+#define EXP_PATTERN 1  // escape quoted glob characters for fnmatch()
+
+/* Shell options, switched with set -o name and set +o name */
+enum shell_opt
+{
+    OPT_AUTOPIN,   // spread background jobs round-robin across CPUs
+    OPT_AUTONUMA,  // spread background jobs round-robin across NUMA nodes
+    OPT_ZYGOTE,    // launch foreground commands through the spawn server
+    OPT_AUDIT,     // append a record of every command to the audit log
+    OPT_BIGPIPE,   // enlarge pipeline pipes up to pipe-max-size
+    OPT_PIPEMETER, // report the throughput of each pipe of a pipeline
+    OPT_MULTIOS,   // cmd > a > b writes to both a and b
+    OPT_AUTOPAR,   // run independent statements of a line concurrently
+    OPT_COUNT
+};
+
+/* A growable NULL terminated list of strings */
+typedef struct Strlist_struct
+{
+    char **items;
+    int count;
+    int size;
+} strlist;
+
+/* void vars_init(char **envp)
+ *
+ * This function creates the variable table and imports every entry of
+ * the environment as an exported variable.
+ *
+ * Arguments :
+ *      envp - the environment the shell was started with
+ *
+ * Returns :
+ *      None
+ */
+void vars_init(char **envp);
+
+/* const char *var_get(const char *name)
+ *
+ * This function looks up a shell variable. The special parameters
+ * ?, $, !, # and the positional parameters 0-9 are also recognised.
+ *
+ * Arguments :
+ *      name - the variable name
+ *
+ * Returns :
+ *      the value of the variable
+ *      NULL - the variable is not set
+ */
+const char *var_get(const char *name);
+
+/* int var_set(const char *name, const char *value, int export_flag)
+ *
+ * This function creates or updates a shell variable. The cached envp
+ * is invalidated only when an exported variable changes.
+ *
+ * Arguments :
+ *      name - the variable name
+ *      value - the new value (NULL keeps the current value, or "")
+ *      export_flag - VAR_EXPORT, VAR_LOCAL or VAR_KEEP
+ *
+ * Returns :
+ *      0 - successful
+ *     -1 - the name is not a valid identifier
+ */
+int var_set(const char *name, const char *value, int export_flag);
+
+/* int var_unset(const char *name)
+ *
+ * This function removes a shell variable.
+ *
+ * Returns :
+ *      0 - the variable was removed
+ *     -1 - the variable was not set
+ */
+int var_unset(const char *name);
+
+/* char **vars_envp()
+ *
+ * This function returns the environment passed to execve(). The array
+ * is materialised once and rebuilt only when the environment generation
+ * has changed since it was last built.
+ *
+ * Returns :
+ *      a NULL terminated array of "name=value" strings owned by vars.c
+ */
+char **vars_envp();
+
+/* char **vars_set_positional(char **params)
+ *
+ * This function replaces the positional parameters $1, $2, ... The
+ * array is not copied and must stay valid until it is replaced.
+ *
+ * Arguments :
+ *      params - NULL terminated array of parameters, or NULL for none
+ *
+ * Returns :
+ *      the previous positional parameters, so that they can be restored
+ */
+char **vars_set_positional(char **params);
+
+/* int var_is_assignment(const char *word)
+ *
+ * Checks whether a word has the form name=value.
+ *
+ * Returns :
+ *      1 - the word is an assignment
+ *      0 - the word is not an assignment
+ */
+int var_is_assignment(const char *word);
+
+/* int expand_word(const char *word, strlist *fields)
+ *
+ * This function performs parameter expansion, command substitution
+ * ($(...) and `...`), process substitution (<(...) and >(...), replaced
+ * by a /dev/fd path), field splitting of unquoted expansions and
+ * quote removal on a raw word, appending the resulting fields to the
+ * list. A word may produce no field at all.
+ *
+ * Arguments :
+ *      word - the word as written on the command line
+ *      fields - the list the fields are appended to
+ *
+ * Returns :
+ *      0 - successful
+ *     -1 - bad substitution (a message has been printed)
+ */
+int expand_word(const char *word, strlist *fields);
+
+/* char *expand_string(const char *word, int flags)
+ *
+ * This function expands a word into exactly one string, without field
+ * splitting. Used for redirection targets, assignments and case words.
+ *
+ * Arguments :
+ *      word - the word as written on the command line
+ *      flags - EXP_PATTERN to keep quoted glob characters literal
+ *
+ * Returns :
+ *      a newly allocated string
+ *      NULL - bad substitution (a message has been printed)
+ */
+char *expand_string(const char *word, int flags);
+
+/* int expand_command(command *cmd)
+ *
+ * This function replaces the argv and redirections of the command with
+ * expanded copies, keeping the parsed originals so that the command can
+ * be executed again (for example in a loop body). Leading name=value
+ * words are moved to cmd->assigns, and the pipe ends of the process
+ * substitutions started by the expansion to cmd->subst_fds.
+ *
+ * Arguments :
+ *      cmd - the command struct to expand
+ *
+ * Returns :
+ *      0 - successful
+ *     -1 - expansion failed, the command must not be executed
+ */
+int expand_command(command *cmd);
+
+/* void unexpand_command(command *cmd)
+ *
+ * This function frees the expanded copies made by expand_command(),
+ * closes the pipe ends of its process substitutions and restores the
+ * parsed originals.
+ *
+ * Arguments :
+ *      cmd - the command struct to restore
+ *
+ * Returns :
+ *      None
+ */
+void unexpand_command(command *cmd);
+
+/* void strlist_add(strlist *list, char *item)
+ *
+ * Appends an allocated string to the list, keeping it NULL terminated.
+ */
+void strlist_add(strlist *list, char *item);
+
+/* void strlist_free(strlist *list)
+ *
+ * Frees every string of the list and the list itself.
+ */
+void strlist_free(strlist *list);
+
+/* int builtin_export(command *cmd)
+ *
+ * export [name[=value]]...
+ * Marks variables for export to the environment of commands. Without
+ * arguments the exported variables are listed.
+ *
+ * Returns :
+ *      0 - successful
+ *     -1 - an argument was not a valid identifier
+ */
+int builtin_export(command *cmd);
+
+/* int builtin_unset(command *cmd)
+ *
+ * unset name...
+ * Removes shell variables.
+ *
+ * Returns :
+ *      0 - successful
+ */
+int builtin_unset(command *cmd);
+
+/* int builtin_set(command *cmd)
+ *
+ * set [-o|+o [option]...]
+ * Lists all shell variables. With -o the options are listed, or the
+ * named options are switched on; +o switches them off.
+ *
+ * Returns :
+ *      0 - successful
+ *     -1 - an option name was not recognised
+ */
+int builtin_set(command *cmd);
+
+/* int shell_option(int opt)
+ *
+ * Checks whether a shell option (OPT_*) is switched on.
+ *
+ * Returns :
+ *      1 - the option is on
+ *      0 - the option is off
+ */
+int shell_option(int opt);
+
+#endif
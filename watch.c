@@ -0,0 +1,352 @@
+/*
+ * Watch.c
+ * Directories rather than files are watched: editors save by writing a
+ * new file and renaming it over the old one, which a watch on the file
+ * itself would lose. An event is then matched against the patterns with
+ * fnmatch(). While watching, SIGINT and SIGCHLD are blocked and read
+ * from a signalfd in the same poll() as the inotify descriptor, so a
+ * single sleeping call covers changes, the end of a run and Ctrl-C.
+ * Authors : Aloysious Kok & Gerald
+ * Last Update : 18/10/26
+ */
+
+#include <fnmatch.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
+#include <sys/stat.h>
+#include "watch.h"
+#include "jobs.h"
+#include "script.h"
+#include "term.h"
+
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE)
+
+// a watched directory
+typedef struct Watch_dir_struct
+{
+    int wd;
+    char *prefix; // as written in the patterns, "" or ending in '/'
+    int whole;    // matched by a pattern itself: any change counts
+} watch_dir;
+
+static watch_dir dirs[WATCH_MAX_DIRS];
+static int n_dirs = 0;
+
+static void watch_usage()
+{
+    fprintf(stderr, "usage: watch [-k] [-d ms] -p pattern [-p pattern]... -- command [args]...\n");
+}
+
+static long now_ms()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* Watches a directory, given as the prefix of paths in it */
+static int watch_dir_add(int fd, const char *prefix, int whole)
+{
+    int wd = inotify_add_watch(fd, prefix[0] != '\0' ? prefix : ".", WATCH_EVENTS);
+
+    if (wd == -1)
+    {
+        return -1;
+    }
+    for (int i = 0; i < n_dirs; i++)
+    {
+        if (dirs[i].wd == wd && strcmp(dirs[i].prefix, prefix) == 0)
+        {
+            dirs[i].whole |= whole;
+            return 0;
+        }
+    }
+    if (n_dirs == WATCH_MAX_DIRS)
+    {
+        return -1;
+    }
+    dirs[n_dirs].wd = wd;
+    dirs[n_dirs].prefix = strdup(prefix);
+    dirs[n_dirs].whole = whole;
+    n_dirs++;
+    return 0;
+}
+
+/* The directory part of a path, '/' included, in buf */
+static const char *dir_prefix(const char *path, char *buf, size_t size)
+{
+    const char *slash = strrchr(path, '/');
+
+    snprintf(buf, size, "%.*s", slash != NULL ? (int)(slash - path + 1) : 0, path);
+    return buf;
+}
+
+/* Watches what a pattern matches now, and where new matches may appear */
+static int watch_pattern(int fd, const char *pattern)
+{
+    char prefix[MAX_BUF_SIZE];
+    char *argv[] = {"watch", strdup(pattern), NULL};
+    command tmp = {0};
+    command *stack[] = {&tmp, NULL};
+    struct stat st;
+    int n = 0;
+
+    dir_prefix(pattern, prefix, sizeof(prefix));
+    if (strpbrk(prefix, "*?[") == NULL && watch_dir_add(fd, prefix, 0) == 0)
+    {
+        n++;
+    }
+
+    // the matches, as any command would see them
+    tmp.argv = argv;
+    int w_count = wildcard_handler(stack, 0);
+    char **matches = w_count > 0 ? &globbuf.gl_pathv[1] : &argv[1];
+    for (int i = 0; matches[i] != NULL; i++)
+    {
+        char path[MAX_BUF_SIZE + 2];
+        if (stat(matches[i], &st) == 0 && S_ISDIR(st.st_mode))
+        {
+            snprintf(path, sizeof(path), "%s%s", matches[i], matches[i][strlen(matches[i]) - 1] == '/' ? "" : "/");
+            n += watch_dir_add(fd, path, 1) == 0;
+        }
+        else if (stat(matches[i], &st) == 0)
+        {
+            n += watch_dir_add(fd, dir_prefix(matches[i], path, sizeof(path)), 0) == 0;
+        }
+    }
+    if (w_count > 0)
+    {
+        globfree(&globbuf);
+    }
+    free(argv[1]);
+    return n;
+}
+
+/* Reads the pending events; returns 1 if one of them is a change that counts */
+static int watch_changed(int fd, char **patterns, int n_patterns)
+{
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    char path[2 * MAX_BUF_SIZE];
+    int changed = 0;
+    ssize_t len;
+
+    while ((len = read(fd, buf, sizeof(buf))) > 0)
+    {
+        for (char *p = buf; p < buf + len; p += sizeof(struct inotify_event) + ((struct inotify_event *)p)->len)
+        {
+            struct inotify_event *ev = (struct inotify_event *)p;
+            if (ev->len == 0 || changed)
+                continue;
+            for (int i = 0; i < n_dirs && !changed; i++)
+            {
+                if (dirs[i].wd != ev->wd)
+                    continue;
+                snprintf(path, sizeof(path), "%s%s", dirs[i].prefix, ev->name);
+                changed = dirs[i].whole;
+                for (int j = 0; j < n_patterns && !changed; j++)
+                    changed = fnmatch(patterns[j], path, FNM_PATHNAME | FNM_PERIOD) == 0;
+            }
+        }
+    }
+    return changed;
+}
+
+/* Quotes the words of a command back into a command line */
+static char *watch_line(char **words)
+{
+    size_t len = 1;
+    char *line, *p;
+
+    if (words[1] == NULL)
+    {
+        return strdup(words[0]);
+    }
+    for (int i = 0; words[i] != NULL; i++)
+    {
+        len += 4 * strlen(words[i]) + 3;
+    }
+    p = line = malloc(len);
+    for (int i = 0; words[i] != NULL; i++)
+    {
+        *p++ = '\'';
+        for (const char *s = words[i]; *s != '\0'; s++)
+        {
+            if (*s == '\'')
+            {
+                memcpy(p, "'\\''", 4);
+                p += 4;
+            }
+            else
+                *p++ = *s;
+        }
+        *p++ = '\'';
+        *p++ = words[i + 1] != NULL ? ' ' : '\0';
+    }
+    return line;
+}
+
+/* Starts a run of the command line in a child shell */
+static pid_t watch_run(const char *line, const sigset_t *old_mask)
+{
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        int null = open("/dev/null", O_RDONLY);
+        char *copy = strdup(line);
+
+        setpgid(0, 0);
+        dup2(null, STDIN_FILENO);
+        close(null);
+        signal(SIGINT, SIG_IGN);
+        sigprocmask(SIG_SETMASK, old_mask, NULL);
+
+        if (script_is_compound(copy) || strchr(copy, '\n') != NULL)
+            script_run_text(copy);
+        else
+            run_line(copy);
+        fflush(stdout);
+        exit(last_status);
+    }
+    if (pid > 0)
+    {
+        setpgid(pid, pid);
+    }
+    else
+    {
+        perror("fork");
+    }
+    return pid;
+}
+
+int builtin_watch(command *cmd)
+{
+    char *patterns[WATCH_MAX_PATTERNS];
+    int n_patterns = 0;
+    int cancel = 0;
+    long debounce = WATCH_DEBOUNCE_MS;
+    int i = 1;
+
+    for (; cmd->argv[i] != NULL && strcmp(cmd->argv[i], "--") != 0; i++)
+    {
+        if (strcmp(cmd->argv[i], "-k") == 0)
+            cancel = 1;
+        else if (strcmp(cmd->argv[i], "-d") == 0 && cmd->argv[i + 1] != NULL)
+            debounce = atol(cmd->argv[++i]);
+        else if (strcmp(cmd->argv[i], "-p") == 0 && cmd->argv[i + 1] != NULL && n_patterns < WATCH_MAX_PATTERNS)
+            patterns[n_patterns++] = cmd->argv[++i];
+        else
+            break;
+    }
+    if (cmd->argv[i] == NULL || strcmp(cmd->argv[i], "--") != 0 || cmd->argv[i + 1] == NULL || n_patterns == 0 ||
+        debounce < 0)
+    {
+        watch_usage();
+        return -1;
+    }
+
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd == -1)
+    {
+        perror("inotify");
+        return -1;
+    }
+    int watched = 0;
+    for (int j = 0; j < n_patterns; j++)
+    {
+        watched += watch_pattern(fd, patterns[j]);
+    }
+    if (watched == 0)
+    {
+        fprintf(stderr, "watch: nothing to watch\n");
+        close(fd);
+        return -1;
+    }
+
+    // Ctrl-C and the end of a run come through a signalfd
+    sigset_t mask, old_mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, &old_mask);
+    struct sigaction old_int;
+    sigaction(SIGINT, NULL, &old_int);
+    signal(SIGINT, SIG_DFL);
+    int sfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+
+    char *line = watch_line(&cmd->argv[i + 1]);
+    int status = 0;
+    int pending = 0;
+    long last_change = 0;
+    term_cooked();
+    pid_t run = watch_run(line, &old_mask);
+
+    struct pollfd pfd[2] = {{fd, POLLIN, 0}, {sfd, POLLIN, 0}};
+    while (1)
+    {
+        int timeout = -1;
+        if (pending && run <= 0)
+        {
+            timeout = last_change + debounce - now_ms();
+            timeout = timeout < 0 ? 0 : timeout;
+        }
+        int n = poll(pfd, 2, timeout);
+        if (n == -1 && errno != EINTR)
+            break;
+
+        if (n == 0 && pending && run <= 0)
+        {
+            pending = 0;
+            run = watch_run(line, &old_mask);
+            continue;
+        }
+
+        if (pfd[0].revents & POLLIN && watch_changed(fd, patterns, n_patterns))
+        {
+            pending = 1;
+            last_change = now_ms();
+            if (cancel && run > 0)
+                kill(-run, SIGTERM);
+        }
+
+        if (pfd[1].revents & POLLIN)
+        {
+            struct signalfd_siginfo si;
+            int stop = 0;
+            while (read(sfd, &si, sizeof(si)) == sizeof(si))
+            {
+                stop |= si.ssi_signo == SIGINT;
+            }
+            int wstatus;
+            if (run > 0 && waitpid(run, &wstatus, WNOHANG) == run)
+            {
+                status = WIFEXITED(wstatus) ? WEXITSTATUS(wstatus) : 128 + WTERMSIG(wstatus);
+                run = 0;
+            }
+            // the handler is blocked: reap the background jobs here
+            jobs_reap();
+            if (stop)
+                break;
+        }
+    }
+
+    if (run > 0)
+    {
+        kill(-run, SIGTERM);
+        waitpid(run, NULL, 0);
+    }
+    free(line);
+    close(sfd);
+    close(fd);
+    for (int j = 0; j < n_dirs; j++)
+    {
+        free(dirs[j].prefix);
+    }
+    n_dirs = 0;
+    sigaction(SIGINT, &old_int, NULL);
+    sigprocmask(SIG_SETMASK, &old_mask, NULL);
+    return status;
+}
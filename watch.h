@@ -0,0 +1,45 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+/*
+ * Watch.h
+ * The watch builtin: reruns a command whenever files matching a set of
+ * patterns change, driven by inotify
+ * Authors : Aloysious Kok & Gerald
+ * Last Update : 18/10/26
+ */
+
+#include "shell.h"
+
+/* Quiet time after a change before the command is rerun, in ms */
+#define WATCH_DEBOUNCE_MS 100
+
+/* Most patterns and watched directories */
+#define WATCH_MAX_PATTERNS 64
+#define WATCH_MAX_DIRS 1024
+
+/* int builtin_watch(command *cmd)
+ *
+ * watch [-k] [-d ms] -p pattern [-p pattern]... -- command [args]...
+ * This function runs the command, then waits for files matching the
+ * patterns to change and runs it again, until interrupted with Ctrl-C.
+ * The patterns are expanded with wildcard_handler(); the directories of
+ * the matches are watched with inotify, so files created later that
+ * match are seen too, and a pattern matching a directory stands for
+ * everything in it. A burst of changes leads to one run once there has
+ * been none for -d ms (WATCH_DEBOUNCE_MS). Changes during a run queue
+ * one more run, or with -k cancel the run and start over. A command
+ * given as one word is a whole command line, which may hold pipelines
+ * and lists. Each run is a child shell in its own process group, with
+ * stdin from /dev/null. Idle, watch sleeps in poll().
+ *
+ * Arguments :
+ *      cmd - the command struct to be processed
+ *
+ * Returns :
+ *      the exit status of the last run
+ *     -1 - bad arguments, or nothing could be watched
+ */
+int builtin_watch(command *cmd);
+
+#endif